@@ -0,0 +1,16 @@
+#include "engine.h"
+#include "multiplayer_master_server.h"
+
+
+//Standalone master server. Usage: seriousproton_masterserver [port]
+int main(int argc, char** argv)
+{
+    int port_nr = 80;
+    if (argc > 1)
+        port_nr = string(argv[1]).toInt();
+
+    new Engine();
+    new MasterServer(port_nr);
+    engine->runMainLoop();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "audio/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace sp {
+namespace audio {
+
+//Zeroth order modified bessel function of the first kind, for the kaiser window.
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k=1; k<32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+Resampler::Resampler(int input_rate, int output_rate)
+: input_rate(input_rate), output_rate(output_rate)
+{
+    int gcd = std::gcd(input_rate, output_rate);
+    up = output_rate / gcd;
+    down = input_rate / gcd;
+    if (up > max_phases)
+    {
+        //Rates without a small ratio get a slightly off one, which is far less then the drift between two sound cards.
+        down = std::max(1, int(std::lround(double(down) * max_phases / up)));
+        up = max_phases;
+    }
+
+    //Kaiser windowed sinc with 80dB stopband attenuation. The stopband starts at the lowest of the two nyquist frequencies,
+    //so nothing folds back into the audible range. In cycles per input sample.
+    const double attenuation = 80.0;
+    const double beta = 0.1102 * (attenuation - 8.7);
+    double transition = (attenuation - 7.95) / (14.36 * taps);
+    double cutoff = 0.5 * std::min(1.0, double(up) / double(down)) - transition / 2.0;
+
+    int length = up * taps;
+    double center = (length - 1) / 2.0;
+    filter.resize(length);
+    for(int p=0; p<up; p++)
+    {
+        double sum = 0.0;
+        for(int k=0; k<taps; k++)
+        {
+            int m = p + k * up;
+            double t = (m - center) / up;    //In input samples.
+            double x = 2.0 * cutoff * t;
+            double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+            double w = (m - center) / center;
+            double window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - w * w))) / besselI0(beta);
+            double value = sinc * window;
+            filter[p * taps + (taps - 1 - k)] = float(value);
+            sum += value;
+        }
+        //Every phase on its own passes DC unchanged, so there is no ripple at the phase rate.
+        for(int k=0; k<taps; k++)
+            filter[p * taps + k] = float(double(filter[p * taps + k]) / sum);
+    }
+    reset();
+}
+
+size_t Resampler::getMaxOutputCount(size_t count) const
+{
+    return (count * up) / down + 2;
+}
+
+size_t Resampler::process(const int16_t* input, size_t count, int16_t* output)
+{
+    size_t written = 0;
+    while(count > 0)
+    {
+        size_t block = std::min(count, block_size);
+        for(size_t n=0; n<block; n++)
+            history[taps - 1 + n] = float(input[n]);
+        size_t end = taps - 1 + block;
+        while(position < end)
+        {
+            const float* coefficients = &filter[phase * taps];
+            const float* samples = &history[position + 1 - taps];
+            //Separate accumulators for the lanes, so the compiler can vectorize this without reordering the additions itself.
+            float sum[8] = {};
+            for(int k=0; k<taps; k+=8)
+                for(int n=0; n<8; n++)
+                    sum[n] += coefficients[k + n] * samples[k + n];
+            float result = ((sum[0] + sum[1]) + (sum[2] + sum[3])) + ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+            output[written++] = int16_t(std::clamp(std::lrint(result), -32768L, 32767L));
+
+            phase += down;
+            position += phase / up;
+            phase %= up;
+        }
+        //The last taps - 1 samples are the history for the next block.
+        std::copy(history.begin() + block, history.begin() + end, history.begin());
+        position -= block;
+        input += block;
+        count -= block;
+    }
+    return written;
+}
+
+void Resampler::reset()
+{
+    std::fill(history.begin(), history.end(), 0.0f);
+    phase = 0;
+    position = taps - 1;
+}
+
+void Resampler::downmix(const int16_t* input, size_t frames, int channels, int16_t* output)
+{
+    if (channels == 1)
+    {
+        if (input != output)
+            std::copy(input, input + frames, output);
+        return;
+    }
+    for(size_t n=0; n<frames; n++)
+    {
+        int sum = 0;
+        for(int c=0; c<channels; c++)
+            sum += input[n * channels + c];
+        output[n] = int16_t(sum / channels);
+    }
+}
+
+}//namespace audio
+}//namespace sp
@@ -0,0 +1,61 @@
+#ifndef SP2_AUDIO_RESAMPLER_H
+#define SP2_AUDIO_RESAMPLER_H
+
+#include "nonCopyable.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <vector>
+
+
+namespace sp {
+namespace audio {
+
+/** Sample rate conversion of a mono stream, with a polyphase windowed sinc filter.
+
+    The rates are reduced to a ratio of up:down, and every output sample is the dot product of taps input samples
+    with one of up filter phases. That keeps the cost at taps multiplications per output sample, whatever the ratio is.
+    The stream can be fed in blocks of any size, the filter history is kept between calls.
+    The output is delayed by taps / 2 input samples.
+
+    Processing does not allocate, so it can run in the audio callbacks. Only the constructor builds the filter table.
+ */
+class Resampler : sp::NonCopyable
+{
+public:
+    static constexpr int taps = 48;
+    static_assert(taps % 8 == 0, "The filter loop works in groups of 8 taps");
+
+    Resampler(int input_rate, int output_rate);
+
+    int getInputRate() const { return input_rate; }
+    int getOutputRate() const { return output_rate; }
+    //The most output samples count input samples can produce.
+    size_t getMaxOutputCount(size_t count) const;
+
+    //Convert input, and write the result to output, which needs room for getMaxOutputCount(count) samples. Returns the number of samples written.
+    size_t process(const int16_t* input, size_t count, int16_t* output);
+    //Forget the history, for a new stream.
+    void reset();
+
+    //Average interleaved channels into a single one. Input and output can be the same buffer.
+    static void downmix(const int16_t* input, size_t frames, int channels, int16_t* output);
+private:
+    static constexpr size_t block_size = 256;
+    static constexpr int max_phases = 1024;
+
+    int input_rate;
+    int output_rate;
+    int up;             //Filter phases, the output position moves down / up input samples per output sample.
+    int down;
+    int phase = 0;
+    size_t position = taps - 1;   //Index in history of the newest input sample used by the next output sample.
+    std::vector<float> filter;    //up phases of taps coefficients, each in the order of the input samples they apply to.
+    std::array<float, taps - 1 + block_size> history;
+};
+
+}//namespace audio
+}//namespace sp
+
+#endif//SP2_AUDIO_RESAMPLER_H
@@ -0,0 +1,115 @@
+#ifndef SP2_AUDIO_RING_BUFFER_H
+#define SP2_AUDIO_RING_BUFFER_H
+
+#include "nonCopyable.h"
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+
+namespace sp {
+namespace audio {
+
+/** Fixed capacity ring buffer between exactly one producer and one consumer thread, for passing data to or from the audio callbacks.
+
+    Neither side ever waits or allocates: each only stores its own index and loads the index of the other side.
+    A write that does not fit writes what fits and counts an overrun, a read of more then there is reads what there is and counts an underrun.
+    The capacity is rounded up to a power of two.
+ */
+template<typename T> class RingBuffer : sp::NonCopyable
+{
+public:
+    explicit RingBuffer(size_t capacity)
+    {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t getCapacity() const { return buffer.size(); }
+    //Items that can be read. Exact for the consumer, at least this many for the producer.
+    size_t available() const { return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire); }
+    //Items that can be written. Exact for the producer, at least this many for the consumer.
+    size_t space() const { return buffer.size() - available(); }
+
+    //Producer side. On an overrun only whole groups of group_size items are written, to keep interleaved channels in step.
+    size_t write(const T* data, size_t count, size_t group_size = 1)
+    {
+        size_t index = write_index.load(std::memory_order_relaxed);
+        size_t free = buffer.size() - (index - read_index.load(std::memory_order_acquire));
+        if (count > free)
+        {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            count = free - free % group_size;
+        }
+        size_t offset = index & mask;
+        size_t first = std::min(count, buffer.size() - offset);
+        std::copy(data, data + first, buffer.begin() + offset);
+        std::copy(data + first, data + count, buffer.begin());
+        write_index.store(index + count, std::memory_order_release);
+        return count;
+    }
+
+    bool push(const T& item)
+    {
+        return write(&item, 1) == 1;
+    }
+
+    //Consumer side.
+    size_t read(T* data, size_t count)
+    {
+        size_t index = read_index.load(std::memory_order_relaxed);
+        size_t filled = write_index.load(std::memory_order_acquire) - index;
+        if (count > filled)
+        {
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            count = filled;
+        }
+        size_t offset = index & mask;
+        size_t first = std::min(count, buffer.size() - offset);
+        std::copy(buffer.begin() + offset, buffer.begin() + offset + first, data);
+        std::copy(buffer.begin(), buffer.begin() + (count - first), data + first);
+        read_index.store(index + count, std::memory_order_release);
+        return count;
+    }
+
+    //Access the oldest item in place, without copying it out. Returns nullptr when empty, which is not an underrun.
+    const T* front() const
+    {
+        size_t index = read_index.load(std::memory_order_relaxed);
+        if (write_index.load(std::memory_order_acquire) == index)
+            return nullptr;
+        return &buffer[index & mask];
+    }
+
+    void pop()
+    {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //Consumer side, drop everything that is buffered.
+    void clear()
+    {
+        read_index.store(write_index.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t getOverruns() const { return overruns.load(std::memory_order_relaxed); }
+    size_t getUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    //On separate cache lines, so the two threads do not keep taking the line from each other.
+    alignas(64) std::atomic<size_t> write_index{0};
+    alignas(64) std::atomic<size_t> read_index{0};
+    std::atomic<size_t> overruns{0};
+    std::atomic<size_t> underruns{0};
+};
+
+}//namespace audio
+}//namespace sp
+
+#endif//SP2_AUDIO_RING_BUFFER_H
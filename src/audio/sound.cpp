@@ -42,7 +42,7 @@ void SoundPlayback::setPitch(float _pitch)
 
 void SoundPlayback::onMixSamples(int16_t* stream, int sample_count)
 {
-    float index_offset = pitch * float(sound->samplerate) / 44100.0f;
+    float index_offset = pitch * float(sound->samplerate) / float(sample_rate);
     if (sound->channels == 1)
     {
         for(int idx=0; idx<sample_count; idx+=2)
@@ -72,7 +72,7 @@ void Source::startAudioSystem()
 {
     SDL_AudioSpec want, have;
     memset(&want, 0, sizeof(want));
-    want.freq = 44100;
+    want.freq = sample_rate;
     want.format = AUDIO_S16SYS;
     want.channels = 2;
     want.samples = 2048;
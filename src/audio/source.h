@@ -19,6 +19,9 @@ namespace audio {
 class Source : sp::NonCopyable
 {
 public:
+    //The mixer runs at this rate, with 2 interleaved channels.
+    static constexpr int sample_rate = 44100;
+
     virtual ~Source();
 
     void start();
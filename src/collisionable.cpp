@@ -23,11 +23,38 @@ static inline b2Vec2 v2b(glm::vec2 v)
     return b2Vec2(v.x / BOX2D_SCALE, v.y / BOX2D_SCALE);
 }
 
-b2World* CollisionManager::world;
+std::shared_ptr<b2World> CollisionManager::world;
+std::shared_ptr<b2World> CollisionManager::scope_world;
+bool CollisionManager::scope_active = false;
 
 void CollisionManager::initialize()
 {
-    world = new b2World(b2Vec2(0, 0));
+    world = createWorld();
+}
+
+std::shared_ptr<b2World> CollisionManager::createWorld()
+{
+    return std::make_shared<b2World>(b2Vec2(0, 0));
+}
+
+std::shared_ptr<b2World> CollisionManager::getScopeWorld()
+{
+    if (scope_active)
+        return scope_world;
+    return world;
+}
+
+CollisionManager::WorldScope::WorldScope(std::shared_ptr<b2World> world)
+: previous(scope_world), previous_active(scope_active)
+{
+    scope_world = world;
+    scope_active = true;
+}
+
+CollisionManager::WorldScope::~WorldScope()
+{
+    scope_world = previous;
+    scope_active = previous_active;
 }
 
 class QueryCallback : public b2QueryCallback
@@ -56,7 +83,9 @@ PVector<Collisionable> CollisionManager::queryArea(glm::vec2 lowerBound, glm::ve
         std::swap(aabb.upperBound.x, aabb.lowerBound.x);
     if (aabb.lowerBound.y > aabb.upperBound.y)
         std::swap(aabb.upperBound.y, aabb.lowerBound.y);
-    world->QueryAABB(&callback, aabb);
+    auto scope_world = getScopeWorld();
+    if (scope_world)
+        scope_world->QueryAABB(&callback, aabb);
     return callback.list;
 }
 
@@ -73,6 +102,11 @@ public:
 };
 
 void CollisionManager::handleCollisions(float delta)
+{
+    handleCollisions(world.get(), delta);
+}
+
+void CollisionManager::handleCollisions(b2World* world, float delta)
 {
     if (delta <= 0.0f)
         return;
@@ -129,6 +163,7 @@ void CollisionManager::handleCollisions(float delta)
 }
 
 Collisionable::Collisionable(float radius)
+: world(CollisionManager::getScopeWorld())
 {
     enable_physics = false;
     static_physics = false;
@@ -139,6 +174,7 @@ Collisionable::Collisionable(float radius)
 }
 
 Collisionable::Collisionable(glm::vec2 box_size, glm::vec2 box_origin)
+: world(CollisionManager::getScopeWorld())
 {
     enable_physics = false;
     static_physics = false;
@@ -148,6 +184,7 @@ Collisionable::Collisionable(glm::vec2 box_size, glm::vec2 box_origin)
 }
 
 Collisionable::Collisionable(const std::vector<glm::vec2>& shape)
+: world(CollisionManager::getScopeWorld())
 {
     enable_physics = false;
     static_physics = false;
@@ -212,7 +249,7 @@ void Collisionable::setCollisionShape(const std::vector<glm::vec2>& shapeList)
         if (offset == 1)
         {
             createBody(&shape);
-        }else{
+        }else if (body){
             b2FixtureDef shapeDef;
             shapeDef.shape = &shape;
             shapeDef.density = 1.f;
@@ -287,13 +324,17 @@ void Collisionable::createBody(b2Shape* shape)
         while(body->GetFixtureList())
             body->DestroyFixture(body->GetFixtureList());
     }else{
+        if (!world)
+            return;
         b2BodyDef bodyDef;
         bodyDef.type = static_physics ? b2_kinematicBody : b2_dynamicBody;
         bodyDef.userData = this;
         bodyDef.allowSleep = false;
         bodyDef.position = v2b(this->position);
         bodyDef.angle = glm::radians(this->rotation);
-        body = CollisionManager::world->CreateBody(&bodyDef);
+        bodyDef.linearVelocity = v2b(this->velocity);
+        bodyDef.angularVelocity = glm::radians(this->angular_velocity);
+        body = world->CreateBody(&bodyDef);
     }
 
     b2FixtureDef shapeDef;
@@ -309,7 +350,9 @@ void Collisionable::destroyBody()
     if (body) {
         this->position = getPosition();
         this->rotation = getRotation();
-        CollisionManager::world->DestroyBody(body);
+        this->velocity = getVelocity();
+        this->angular_velocity = getAngularVelocity();
+        world->DestroyBody(body);
     }
     body = nullptr;
 }
@@ -348,23 +391,27 @@ float Collisionable::getRotation() const
 
 void Collisionable::setVelocity(glm::vec2 velocity)
 {
-    if (body == NULL) return;
-    body->SetLinearVelocity(v2b(velocity));
+    if (body == NULL)
+        this->velocity = velocity;
+    else
+        body->SetLinearVelocity(v2b(velocity));
 }
 glm::vec2 Collisionable::getVelocity() const
 {
-    if (body == NULL) return glm::vec2(0, 0);
+    if (body == NULL) return velocity;
     return b2v(body->GetLinearVelocity());
 }
 
 void Collisionable::setAngularVelocity(float velocity)
 {
-    if (body == NULL) return;
-    body->SetAngularVelocity(glm::radians(velocity));
+    if (body == NULL)
+        angular_velocity = velocity;
+    else
+        body->SetAngularVelocity(glm::radians(velocity));
 }
 float Collisionable::getAngularVelocity() const
 {
-    if (body == NULL) return 0;
+    if (body == NULL) return angular_velocity;
     return glm::degrees(body->GetAngularVelocity());
 }
 
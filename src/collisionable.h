@@ -2,6 +2,8 @@
 #define COLLISIONABLE_H
 
 #include "P.h"
+#include "nonCopyable.h"
+#include <memory>
 
 class b2World;
 class b2Body;
@@ -12,10 +14,33 @@ class CollisionManager
 {
 public:
     static void initialize();
+    //Step the default world.
     static void handleCollisions(float delta);
+    static void handleCollisions(b2World* world, float delta);
+    //Find the collisionables in the world of the current WorldScope.
     static PVector<Collisionable> queryArea(glm::vec2 lowerBound, glm::vec2 upperBound);
+
+    /**
+        Physics worlds are independent of each other, objects in one never collide with objects in another.
+        New collisionables are put in the world of the innermost living WorldScope, or in the default world if there is none.
+        A scope without a world makes collisionables that have no physics body, they only keep their position and movement.
+        Each GameServer::ObjectScope also selects the world of its server.
+     */
+    class WorldScope : sp::NonCopyable
+    {
+    public:
+        explicit WorldScope(std::shared_ptr<b2World> world);
+        ~WorldScope();
+    private:
+        std::shared_ptr<b2World> previous;
+        bool previous_active;
+    };
+    static std::shared_ptr<b2World> createWorld();
+    static std::shared_ptr<b2World> getScopeWorld();
 private:
-    static b2World* world;
+    static std::shared_ptr<b2World> world;
+    static std::shared_ptr<b2World> scope_world;
+    static bool scope_active;
 
     friend class Collisionable;
 };
@@ -25,6 +50,9 @@ class Collisionable : public virtual PObject
 private:
     glm::vec2 position{};
     float rotation = 0.0f;
+    glm::vec2 velocity{};   //Only used without a body, the body keeps these otherwise.
+    float angular_velocity = 0.0f;
+    std::shared_ptr<b2World> world;  //Kept alive as long as our body is in it.
     b2Body* body;
     bool enable_physics;
     bool static_physics;
@@ -25,6 +25,19 @@ PObject* DEBUG_PobjListStart;
 
 Engine* engine;
 
+//Objects of one of multiple servers are updated in the scope of their server, so what they create ends up on that server.
+static void updateObject(Updatable* u, float delta)
+{
+    P<GameServer> server = GameServer::getUpdateScopeServer(u);
+    if (server)
+    {
+        GameServer::ObjectScope scope(server);
+        u->update(delta);
+    }else{
+        u->update(delta);
+    }
+}
+
 Engine::Engine()
 {
     engine = this;
@@ -138,9 +151,10 @@ void Engine::runMainLoop()
             delta *= gameSpeed;
 
             foreach(Updatable, u, updatableList)
-                u->update(delta);
+                updateObject(*u, delta);
             elapsedTime += delta;
             CollisionManager::handleCollisions(delta);
+            GameServer::handleCollisions(delta);
             ScriptObject::clearDestroyedObjects();
             soundManager->updateTick();
 #ifdef STEAMSDK
@@ -179,11 +193,12 @@ void Engine::runMainLoop()
             
             sp::SystemStopwatch engine_timing_stopwatch;
             foreach(Updatable, u, updatableList) {
-                u->update(delta);
+                updateObject(*u, delta);
             }
             elapsedTime += delta;
             engine_timing.update = engine_timing_stopwatch.restart();
             CollisionManager::handleCollisions(delta);
+            GameServer::handleCollisions(delta);
             engine_timing.collision = engine_timing_stopwatch.restart();
             ScriptObject::clearDestroyedObjects();
             soundManager->updateTick();
@@ -39,6 +39,18 @@ public:
         buffer.clear();
         read_index = 0;
     }
+
+    //Exchange the storage with the given vector, so allocated memory can be reused. Resets the read position.
+    void swap(std::vector<uint8_t>& data)
+    {
+        buffer.swap(data);
+        read_index = 0;
+    }
+
+    size_t getCapacity() const
+    {
+        return buffer.capacity();
+    }
     
     const void* getData() const
     {
@@ -124,6 +136,50 @@ public:
     {
         appendRaw(other.buffer.data(), other.buffer.size());
     }
+
+    //Bulk writes, with exactly the same encoding as writing each value by itself, but growing the buffer only once.
+    void writeArray(const int8_t* values, size_t count) { appendRaw(values, count); }
+    void writeArray(const uint8_t* values, size_t count) { appendRaw(values, count); }
+    void writeArray(const int16_t* values, size_t count) { writeVLQArray(values, count); }
+    void writeArray(const uint16_t* values, size_t count) { writeVLQArray(values, count); }
+    void writeArray(const int32_t* values, size_t count) { writeVLQArray(values, count); }
+    void writeArray(const uint32_t* values, size_t count) { writeVLQArray(values, count); }
+    void writeArray(const float* values, size_t count) { appendRaw(values, count * sizeof(float)); }
+    void writeArray(const double* values, size_t count) { appendRaw(values, count * sizeof(double)); }
+    void writeArray(const glm::vec2* values, size_t count)
+    {
+        static_assert(sizeof(glm::vec2) == sizeof(float) * 2, "glm::vec2 is expected to be two packed floats");
+        appendRaw(values, count * sizeof(glm::vec2));
+    }
+
+    //True for the types that have a writeArray/readArray.
+    template<typename T> static constexpr bool hasArraySupport()
+    {
+        return std::is_same<T, int8_t>::value || std::is_same<T, uint8_t>::value || std::is_same<T, int16_t>::value || std::is_same<T, uint16_t>::value
+            || std::is_same<T, int32_t>::value || std::is_same<T, uint32_t>::value || std::is_same<T, float>::value || std::is_same<T, double>::value
+            || std::is_same<T, glm::vec2>::value;
+    }
+
+    //Encode an uint32_t the way write(uint32_t) does, into at most 5 bytes. Returns the amount of bytes used.
+    static size_t encodeVLQu(uint32_t v, uint8_t* out)
+    {
+        if (v < 0x80)
+        {
+            out[0] = uint8_t(v);
+            return 1;
+        }
+        size_t size = 0;
+        if (v >= (1 << 28))
+            out[size++] = uint8_t((v >> 28) | 0x80);
+        if (v >= (1 << 21))
+            out[size++] = uint8_t((v >> 21) | 0x80);
+        if (v >= (1 << 14))
+            out[size++] = uint8_t((v >> 14) | 0x80);
+        if (v >= (1 << 7))
+            out[size++] = uint8_t((v >> 7) | 0x80);
+        out[size++] = uint8_t(v & 0x7F);
+        return size;
+    }
     
     template<typename T, typename... ARGS> void read(T& value, ARGS&... args)
     {
@@ -192,14 +248,46 @@ public:
         read_index += len;
     }
 
+    //Read a string without copying it, the view points into this buffer and is only valid till the buffer is changed.
+    void read(std::string_view& s)
+    {
+        uint32_t len = 0;
+        read(len);
+        if (len == 0 || read_index + len > buffer.size()) { s = std::string_view(); return; }
+        s = std::string_view(reinterpret_cast<const char*>(&buffer[read_index]), len);
+        read_index += len;
+    }
+
     template<class T, class=typename std::enable_if<std::is_enum<T>::value>::type>
     void read(T& enum_value) { uint16_t v=0; read(v); enum_value = T(v); }
 
+    //Bulk reads, the counterpart of writeArray. Values missing from the buffer are zero.
+    void readArray(int8_t* values, size_t count) { readRaw(values, count); }
+    void readArray(uint8_t* values, size_t count) { readRaw(values, count); }
+    void readArray(int16_t* values, size_t count) { for(size_t n=0; n<count; n++) values[n] = int16_t(readVLQs()); }
+    void readArray(uint16_t* values, size_t count) { for(size_t n=0; n<count; n++) values[n] = uint16_t(readVLQu()); }
+    void readArray(int32_t* values, size_t count) { for(size_t n=0; n<count; n++) values[n] = readVLQs(); }
+    void readArray(uint32_t* values, size_t count) { for(size_t n=0; n<count; n++) values[n] = readVLQu(); }
+    void readArray(float* values, size_t count) { readRaw(values, count * sizeof(float)); }
+    void readArray(double* values, size_t count) { readRaw(values, count * sizeof(double)); }
+    void readArray(glm::vec2* values, size_t count) { readRaw(values, count * sizeof(glm::vec2)); }
+
     size_t available() const
     {
         return buffer.size() - read_index;
     }
 
+    //Pointer to the data that has not been read yet.
+    const void* getReadData() const
+    {
+        return buffer.data() + read_index;
+    }
+
+    void skip(size_t size)
+    {
+        read_index = std::min(read_index + size, buffer.size());
+    }
+
     DataBuffer& operator <<(bool data) { write(data); return *this; }
     DataBuffer& operator <<(int8_t data) { write(data); return *this; }
     DataBuffer& operator <<(uint8_t data) { write(data); return *this; }
@@ -222,27 +310,59 @@ public:
     DataBuffer& operator >>(double& data) { read(data); return *this; }
     DataBuffer& operator >>(string& data) { read(data); return *this; }
 private:
+    static uint32_t zigzag(int32_t v)
+    {
+        if (v < 0)
+            return (uint32_t(-v) << 1) | 1;
+        return uint32_t(v) << 1;
+    }
+
     void writeVLQu(uint32_t v) {
-        if (v >= (1 << 28))
-            buffer.push_back((v >> 28) | 0x80);
-        if (v >= (1 << 21))
-            buffer.push_back((v >> 21) | 0x80);
-        if (v >= (1 << 14))
-            buffer.push_back((v >> 14) | 0x80);
-        if (v >= (1 << 7))
-            buffer.push_back((v >> 7) | 0x80);
-        buffer.push_back((v & 0x7F));
+        if (v < 0x80)
+        {
+            buffer.push_back(uint8_t(v));
+            return;
+        }
+        //Encode on the stack first, so the buffer grows once instead of once for every byte.
+        uint8_t data[5];
+        buffer.insert(buffer.end(), data, data + encodeVLQu(v, data));
     }
 
     void writeVLQs(int32_t v) {
-        if (v < 0)
-            writeVLQu((uint32_t(-v) << 1) | 1);
-        else
-            writeVLQu((uint32_t(v) << 1));
+        writeVLQu(zigzag(v));
+    }
+
+    template<typename T> void writeVLQArray(const T* values, size_t count)
+    {
+        //Make room for the worst case once, encode straight into the buffer, and trim what was not used.
+        size_t offset = buffer.size();
+        buffer.resize(offset + count * 5);
+        uint8_t* out = buffer.data() + offset;
+        for(size_t n=0; n<count; n++)
+        {
+            if (std::is_signed<T>::value)
+                out += encodeVLQu(zigzag(int32_t(values[n])), out);
+            else
+                out += encodeVLQu(uint32_t(values[n]), out);
+        }
+        buffer.resize(out - buffer.data());
+    }
+
+    void readRaw(void* data, size_t size)
+    {
+        if (size == 0)
+            return;
+        size_t available_size = std::min(size, available());
+        memcpy(data, buffer.data() + read_index, available_size);
+        memset(static_cast<uint8_t*>(data) + available_size, 0, size - available_size);
+        read_index += available_size;
     }
 
     uint32_t readVLQu()
     {
+        //Most values fit in a single byte.
+        if (read_index < buffer.size() && buffer[read_index] < 0x80)
+            return buffer[read_index++];
         uint32_t result{0};
         uint8_t u;
         do
@@ -0,0 +1,60 @@
+#include <io/dataBufferPool.h>
+
+
+namespace sp {
+namespace io {
+
+DataBufferPool::Buffer::Buffer(DataBufferPool& pool)
+: pool(pool)
+{
+    pool.stats.borrowed++;
+    pool.stats.in_use++;
+    if (pool.stats.in_use > pool.stats.high_water)
+        pool.stats.high_water = pool.stats.in_use;
+    if (pool.storage.empty())
+    {
+        pool.stats.allocated++;
+    }else{
+        pool.stats.retained_bytes -= pool.storage.back().capacity();
+        buffer.swap(pool.storage.back());
+        pool.storage.pop_back();
+    }
+    initial_capacity = buffer.getCapacity();
+}
+
+DataBufferPool::Buffer::~Buffer()
+{
+    pool.giveBack(buffer, initial_capacity);
+}
+
+DataBufferPool::DataBufferPool(size_t max_retained_count, size_t max_retained_capacity)
+: max_retained_count(max_retained_count), max_retained_capacity(max_retained_capacity)
+{
+    storage.reserve(max_retained_count);
+}
+
+void DataBufferPool::resetStats()
+{
+    size_t in_use = stats.in_use;
+    size_t retained_bytes = stats.retained_bytes;
+    stats = Stats();
+    stats.in_use = in_use;
+    stats.high_water = in_use;
+    stats.retained_bytes = retained_bytes;
+}
+
+void DataBufferPool::giveBack(DataBuffer& buffer, size_t initial_capacity)
+{
+    stats.in_use--;
+    if (buffer.getCapacity() > initial_capacity)
+        stats.grown++;
+    if (storage.size() >= max_retained_count || buffer.getCapacity() == 0 || buffer.getCapacity() > max_retained_capacity)
+        return;
+    buffer.clear();
+    storage.emplace_back();
+    buffer.swap(storage.back());
+    stats.retained_bytes += storage.back().capacity();
+}
+
+}//namespace io
+}//namespace sp
@@ -0,0 +1,71 @@
+#ifndef SP2_IO_DATABUFFER_POOL_H
+#define SP2_IO_DATABUFFER_POOL_H
+
+#include <io/dataBuffer.h>
+#include <nonCopyable.h>
+#include <vector>
+
+
+namespace sp {
+namespace io {
+
+/**
+    Keeps the storage of DataBuffers around for reuse, so building packets does not need a heap allocation each time.
+    Buffers are borrowed with borrow() and return to the pool when the borrowed Buffer goes out of scope.
+    Not thread safe, use a pool per thread.
+
+        auto packet = pool.borrow();
+        *packet << CMD_UPDATE_VALUE << id;
+        socket.queue(*packet);
+ */
+class DataBufferPool : sp::NonCopyable
+{
+public:
+    struct Stats
+    {
+        size_t borrowed = 0;    //Buffers handed out.
+        size_t allocated = 0;   //Buffers handed out without storage, as the pool was empty.
+        size_t grown = 0;       //Buffers that came back with more capacity then they were handed out with, so were reallocated while in use.
+        size_t in_use = 0;
+        size_t high_water = 0;  //Most buffers in use at the same time.
+        size_t retained_bytes = 0;  //Capacity kept in the pool for reuse.
+    };
+
+    class Buffer : sp::NonCopyable
+    {
+    public:
+        ~Buffer();
+
+        DataBuffer& operator*() { return buffer; }
+        DataBuffer* operator->() { return &buffer; }
+    private:
+        Buffer(DataBufferPool& pool);
+
+        DataBufferPool& pool;
+        DataBuffer buffer;
+        size_t initial_capacity;
+
+        friend class DataBufferPool;
+    };
+
+    //Buffers with a larger capacity than max_retained_capacity are freed instead of kept, so a single huge packet does not pin its memory.
+    DataBufferPool(size_t max_retained_count = 64, size_t max_retained_capacity = 64 * 1024);
+
+    Buffer borrow() { return Buffer(*this); }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats();
+
+private:
+    void giveBack(DataBuffer& buffer, size_t initial_capacity);
+
+    size_t max_retained_count;
+    size_t max_retained_capacity;
+    std::vector<std::vector<uint8_t>> storage;
+    Stats stats;
+};
+
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_DATABUFFER_POOL_H
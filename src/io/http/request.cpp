@@ -82,9 +82,9 @@ Request::Response Request::request(const string& method, const string& path, con
         if (scheme == Scheme::Auto)
             scheme = ((port == 443) ? Scheme::Https : Scheme::Http);
         if (scheme == Scheme::Http)
-            socket.connect(io::network::Address(headers["Host"]), port);
+            socket.connect(headers["Host"], port);
         else
-            socket.connectSSL(io::network::Address(headers["Host"]), port);
+            socket.connectSSL(headers["Host"], port);
         socket.setTimeout(5000);
     }
     Response response;
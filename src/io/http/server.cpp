@@ -178,6 +178,9 @@ void Server::handlerThread()
             connections.emplace_back(*this);
             Connection& connection = connections.back();
             listen_socket.accept(connection.socket);
+            auto remote_address = connection.socket.getRemoteAddress().getHumanReadable();
+            if (!remote_address.empty())
+                connection.remote_address = remote_address[0];
             connection.last_received_data_time = std::chrono::steady_clock::now();
             selector.add(connection.socket);
         }
@@ -229,10 +232,7 @@ void Server::update(float delta)
         if (connection.request_pending)
         {
             string reply = http_handlers[connection.request.path](connection.request);
-            connection.startHttpReply(200);
-            if (reply.size() > 0)
-                connection.httpChunk(reply);
-            connection.httpChunk("");
+            connection.sendHttpReply(200, reply);
 
             connection.request_pending = false;
         }
@@ -282,7 +282,7 @@ bool Server::Connection::processIncommingData()
     {
     case State::HTTPRequest:{
         int headers_end = buffer.find("\r\n\r\n");
-        if (headers_end)
+        if (headers_end >= 0)
         {
             std::vector<string> header_data = buffer.substr(0, headers_end).split("\r\n");
             
@@ -291,6 +291,7 @@ bool Server::Connection::processIncommingData()
                 return false;
             auto path_query = parts[1].partition("?");
             request.method = parts[0];
+            request.remote_address = remote_address;
             request.path = path_query.first;
             request.query.clear();
             for(auto& param : path_query.second.split("&"))
@@ -300,6 +301,7 @@ bool Server::Connection::processIncommingData()
                     request.query[uriDecode(key_value.first)] = uriDecode(key_value.second);
             }
             request.post_data = "";
+            request.post_query.clear();
             request.headers.clear();
             for(unsigned int n=1; n<header_data.size(); n++)
             {
@@ -313,6 +315,15 @@ bool Server::Connection::processIncommingData()
                 if (int(buffer.size()) < headers_end + 4 + post_length)
                     break; //Not enough data yet, continue receiving.
                 request.post_data = buffer.substr(headers_end + 4, headers_end + 4 + post_length);
+                if (request.headers["content-type"].startswith("application/x-www-form-urlencoded"))
+                {
+                    for(auto& param : request.post_data.split("&"))
+                    {
+                        auto key_value = param.partition("=");
+                        if (!key_value.first.empty())
+                            request.post_query[uriDecode(key_value.first)] = uriDecode(key_value.second.replace("+", " "));
+                    }
+                }
             }
             
             buffer = buffer.substr(headers_end + 4 + post_length);
@@ -533,6 +544,20 @@ void Server::Connection::startHttpReply(int reply_code, const string& mimetype)
     socket.send(reply.c_str(), reply.size());
 }
 
+void Server::Connection::sendHttpReply(int reply_code, const string& data)
+{
+    //The same chunked reply as startHttpReply and httpChunk give, but in one send,
+    //as small separate sends wait for the ACK of the previous one with Nagle's algorithm.
+    string reply = string("HTTP/1.1 ") + string(reply_code) + " OK\r\n";
+    reply += "Connection: Keep-Alive\r\n";
+    reply += "Transfer-Encoding: chunked\r\n";
+    reply += "\r\n";
+    if (data.size() > 0)
+        reply += string::hex(static_cast<int>(data.size())) + "\r\n" + data + "\r\n";
+    reply += "0\r\n\r\n";
+    socket.send(reply.data(), reply.size());
+}
+
 void Server::Connection::httpChunk(const string& data)
 {
     string chunk_len_string = string::hex(static_cast<int>(data.size())) + "\r\n";
@@ -36,7 +36,9 @@ public:
         string path;
         std::unordered_map<string, string> query;
         string post_data;
+        std::unordered_map<string, string> post_query; //The post data as key/values, when it is form encoded.
         std::unordered_map<string, string> headers;
+        string remote_address;
     };
 
     Server(int port_nr=80);
@@ -82,6 +84,7 @@ private:
 
         sp::io::network::TcpSocket socket;
         std::chrono::steady_clock::time_point last_received_data_time;
+        string remote_address;
         string buffer;
         Server& server;
         
@@ -96,6 +99,7 @@ private:
         bool handleTimeout();
         void handleRequest(const Request& request);
         void startHttpReply(int reply_code, const string& mimetype="");
+        void sendHttpReply(int reply_code, const string& data);
         void httpChunk(const string& data);
         void sendWebsocketTextPacket(const string& data);
         
@@ -144,12 +144,12 @@ bool Websocket::connect(const string& hostname, int port, const string& path, Sc
 #else
     if (scheme == Scheme::Https)
     {
-        if (!socket->connectSSL(io::network::Address(hostname), port))
+        if (!socket->connectSSL(hostname, port))
             return false;
     }
     else
     {
-        if (!socket->connect(io::network::Address(hostname), port))
+        if (!socket->connect(hostname, port))
             return false;
     }
 
@@ -0,0 +1,105 @@
+#include <io/network/addressResolver.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+using Clock = std::chrono::steady_clock;
+
+struct CacheEntry
+{
+    std::shared_future<Address> result;
+    Clock::time_point start_time;
+};
+
+static constexpr size_t max_cache_size = 32;
+static constexpr float failed_cache_time = 5.0f;
+
+static std::mutex cache_mutex;
+static std::unordered_map<string, CacheEntry> cache;
+static float cache_time = 60.0f;
+
+static bool isReady(const std::shared_future<Address>& result)
+{
+    return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+//Lookups that are still running never expire, so every caller keeps sharing them until they finish.
+static bool isExpired(const CacheEntry& entry, Clock::time_point now)
+{
+    if (!isReady(entry.result))
+        return false;
+    float age = std::chrono::duration<float>(now - entry.start_time).count();
+    if (entry.result.get().getHumanReadable().empty())
+        return age > failed_cache_time;
+    return age > cache_time;
+}
+
+AddressResolver::AddressResolver(const string& hostname)
+: hostname(hostname)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto now = Clock::now();
+    auto it = cache.find(hostname);
+    if (it != cache.end() && !isExpired(it->second, now))
+    {
+        result = it->second.result;
+        return;
+    }
+
+#ifdef EMSCRIPTEN
+    //There is no name resolving here, so there is nothing to wait for.
+    std::promise<Address> promise;
+    promise.set_value(Address(hostname));
+    result = promise.get_future().share();
+#else
+    //The thread is detached, so a hanging lookup never blocks whoever drops the last reference to it.
+    std::packaged_task<Address()> task([hostname]() { return Address(hostname); });
+    result = task.get_future().share();
+    std::thread(std::move(task)).detach();
+#endif
+
+    if (cache.size() >= max_cache_size && cache.find(hostname) == cache.end())
+    {
+        for(auto e = cache.begin(); e != cache.end(); )
+        {
+            if (isExpired(e->second, now))
+                e = cache.erase(e);
+            else
+                ++e;
+        }
+    }
+    if (cache.size() < max_cache_size || cache.find(hostname) != cache.end())
+        cache[hostname] = {result, now};
+}
+
+bool AddressResolver::isDone() const
+{
+    return isReady(result);
+}
+
+const Address& AddressResolver::getAddress() const
+{
+    return result.get();
+}
+
+void AddressResolver::setCacheTime(float seconds)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_time = seconds;
+}
+
+void AddressResolver::clearCache()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.clear();
+}
+
+}//namespace network
+}//namespace io
+}//namespace sp
@@ -0,0 +1,45 @@
+#ifndef SP2_IO_NETWORK_ADDRESS_RESOLVER_H
+#define SP2_IO_NETWORK_ADDRESS_RESOLVER_H
+
+#include <io/network/address.h>
+#include <nonCopyable.h>
+#include <future>
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+
+/**
+    Resolves a hostname on a background thread, so a slow name server does not stall the caller.
+    Results are kept in a small cache for a while, and lookups of a hostname that is already being resolved share that lookup.
+
+    Usage:
+        AddressResolver resolver("example.com");
+        while(!resolver.isDone()) { ...keep rendering frames... }
+        socket.connect(resolver.getAddress(), port);
+ */
+class AddressResolver : sp::NonCopyable
+{
+public:
+    AddressResolver(const string& hostname);
+
+    const string& getHostname() const { return hostname; }
+    bool isDone() const;
+    //Returns the resolved address, which is empty when resolving failed. Waits for the lookup when it is not done yet.
+    const Address& getAddress() const;
+
+    //How long resolved addresses are kept, in seconds. Failed lookups are only kept for a few seconds.
+    static void setCacheTime(float seconds);
+    static void clearCache();
+private:
+    string hostname;
+    std::shared_future<Address> result;
+};
+
+}//namespace network
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_NETWORK_ADDRESS_RESOLVER_H
@@ -0,0 +1,128 @@
+#include <io/network/localListener.h>
+#include <io/network/localSocket.h>
+#include <logging.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+static constexpr intptr_t INVALID_SOCKET = -1;
+
+//Only remove what is a socket, a wrong path should not delete somebody's file.
+static bool removeStaleSocket(const std::string& path)
+{
+    struct stat info;
+    if (::lstat(path.c_str(), &info) < 0)
+        return true;
+    if (!S_ISSOCK(info.st_mode))
+        return false;
+    ::unlink(path.c_str());
+    return true;
+}
+#endif
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+
+LocalListener::LocalListener()
+{
+}
+
+LocalListener::~LocalListener()
+{
+    close();
+}
+
+bool LocalListener::listen(const std::string& path)
+{
+#ifdef _WIN32
+    return false;
+#else
+    if (isListening())
+        close();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    if (!removeStaleSocket(path))
+    {
+        LOG(Warning, "Not listening on local socket, path exists and is not a socket:", path);
+        return false;
+    }
+    handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle == INVALID_SOCKET)
+        return false;
+    if (::bind(handle, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        close();
+        return false;
+    }
+    this->path = path;
+    if (::listen(handle, SOMAXCONN) < 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void LocalListener::close()
+{
+#ifndef _WIN32
+    if (isListening())
+    {
+        ::close(handle);
+        handle = INVALID_SOCKET;
+    }
+    if (!path.empty())
+        removeStaleSocket(path);
+    path.clear();
+#endif
+}
+
+bool LocalListener::isListening()
+{
+#ifdef _WIN32
+    return false;
+#else
+    return handle != INVALID_SOCKET;
+#endif
+}
+
+bool LocalListener::accept(LocalSocket& socket)
+{
+#ifdef _WIN32
+    return false;
+#else
+    if (!isListening())
+        return false;
+
+    auto result = ::accept(handle, nullptr, nullptr);
+    if (result == INVALID_SOCKET)
+    {
+        if (!isLastErrorNonBlocking())
+            close();
+        return false;
+    }
+    if (socket.getState() != StreamSocket::State::Closed)
+        socket.close();
+    socket.handle = result;
+    socket.setBlocking(socket.blocking);
+    return true;
+#endif
+}
+
+}//namespace network
+}//namespace io
+}//namespace sp
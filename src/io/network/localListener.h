@@ -0,0 +1,36 @@
+#ifndef SP2_IO_NETWORK_LOCAL_LISTENER_H
+#define SP2_IO_NETWORK_LOCAL_LISTENER_H
+
+#include <io/network/socketBase.h>
+#include <string>
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+
+class LocalSocket;
+class LocalListener : public SocketBase
+{
+public:
+    LocalListener();
+    ~LocalListener();
+
+    //Listen on a unix domain socket at the given path. A stale socket file left behind at that path is replaced.
+    bool listen(const std::string& path);
+    void close();
+
+    bool isListening();
+
+    bool accept(LocalSocket& socket);
+
+private:
+    std::string path;
+};
+
+}//namespace network
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_NETWORK_LOCAL_LISTENER_H
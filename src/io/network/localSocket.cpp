@@ -0,0 +1,126 @@
+#include <io/network/localSocket.h>
+#include <logging.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+#if defined(__APPLE__)
+static constexpr int flags = 0;
+#else
+static constexpr int flags = MSG_NOSIGNAL;
+#endif
+static constexpr intptr_t INVALID_SOCKET = -1;
+#endif
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+
+LocalSocket::LocalSocket()
+{
+}
+
+LocalSocket::~LocalSocket()
+{
+    close();
+}
+
+bool LocalSocket::connect(const std::string& path)
+{
+#ifdef _WIN32
+    LOG(Warning, "Local sockets are not supported on this platform");
+    return false;
+#else
+    if (handle != INVALID_SOCKET)
+        close();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        LOG(Warning, "Local socket path too long:", path);
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle == INVALID_SOCKET)
+        return false;
+    //Connecting to a local socket completes or fails right away, so this is done blocking.
+    if (::connect(handle, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        close();
+        return false;
+    }
+    setBlocking(blocking);
+    return true;
+#endif
+}
+
+void LocalSocket::close()
+{
+#ifndef _WIN32
+    if (handle != INVALID_SOCKET)
+    {
+        ::close(handle);
+        handle = INVALID_SOCKET;
+        clearQueue();
+    }
+#endif
+}
+
+StreamSocket::State LocalSocket::getState()
+{
+#ifndef _WIN32
+    if (handle != INVALID_SOCKET)
+        return StreamSocket::State::Connected;
+#endif
+    return StreamSocket::State::Closed;
+}
+
+size_t LocalSocket::_send(const void* data, size_t size)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    auto result = ::send(handle, data, size, flags);
+    if (result < 0)
+    {
+        if (!isLastErrorNonBlocking())
+            close();
+        return 0;
+    }
+    return result;
+#endif
+}
+
+size_t LocalSocket::_receive(void* data, size_t size)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    auto result = ::recv(handle, data, size, flags);
+    if (result < 0)
+    {
+        result = 0;
+        if (!isLastErrorNonBlocking())
+            close();
+    }
+    else if (result == 0 && size > 0)
+    {
+        //The other side closed the connection.
+        close();
+    }
+    return result;
+#endif
+}
+
+}//namespace network
+}//namespace io
+}//namespace sp
@@ -0,0 +1,38 @@
+#ifndef SP2_IO_NETWORK_LOCAL_SOCKET_H
+#define SP2_IO_NETWORK_LOCAL_SOCKET_H
+
+#include <io/network/socketBase.h>
+#include <io/network/streamSocket.h>
+#include <string>
+
+
+namespace sp {
+namespace io {
+namespace network {
+
+
+//Stream socket to another process on the same machine, trough a unix domain socket bound to a path.
+//Carries the same packet stream as a TcpSocket, without going trough the TCP/IP stack. Not available on Windows.
+class LocalSocket : public SocketBase, public StreamSocket
+{
+public:
+    LocalSocket();
+    ~LocalSocket();
+
+    bool connect(const std::string& path);
+    virtual void close() override;
+
+    virtual State getState() override;
+
+protected:
+    virtual size_t _send(const void* data, size_t size) override;
+    virtual size_t _receive(void* data, size_t size) override;
+
+    friend class LocalListener;
+};
+
+}//namespace network
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_NETWORK_LOCAL_SOCKET_H
@@ -30,6 +30,7 @@ namespace network {
 class Selector::SelectorData
 {
 public:
+    std::vector<SocketBase*> sockets;
     std::vector<struct pollfd> fds;
 };
 
@@ -38,47 +39,37 @@ Selector::Selector()
 {
 }
 
-Selector::Selector(const Selector& other)
-: data(new SelectorData(*other.data))
-{
-}
-
 Selector::~Selector()
 {
     delete data;
 }
 
-Selector& Selector::operator =(const Selector& other)
-{
-    *data = *other.data;
-    return *this;
-}
-
 void Selector::add(SocketBase& socket)
 {
-    if (socket.handle != INVALID_SOCKET)
-    {
-        struct pollfd fds;
-        fds.fd = socket.handle;
-        fds.events = POLLIN;
-        fds.revents = 0;
-        data->fds.push_back(fds);
-    }
+    if (std::find(data->sockets.begin(), data->sockets.end(), &socket) == data->sockets.end())
+        data->sockets.push_back(&socket);
 }
 
 void Selector::remove(SocketBase& socket)
 {
-    if (socket.handle != INVALID_SOCKET)
-    {
-        data->fds.erase(std::remove_if(data->fds.begin(), data->fds.end(), [&socket](const struct pollfd& pfd)
-        {
-            return pfd.fd == socket.handle;
-        }), data->fds.end());
-    }
+    data->sockets.erase(std::remove(data->sockets.begin(), data->sockets.end(), &socket), data->sockets.end());
 }
 
 void Selector::wait(int timeout_ms)
 {
+    //The handle and the events to wait for are taken from the current state of each socket,
+    //so a socket that finished connecting waits for data, and one that moved to an other address is followed.
+    data->fds.clear();
+    for(auto socket : data->sockets)
+    {
+        if (socket->handle == INVALID_SOCKET)
+            continue;
+        struct pollfd fds;
+        fds.fd = socket->handle;
+        fds.events = (socket->connecting || socket->want_write) ? POLLOUT : POLLIN;
+        fds.revents = 0;
+        data->fds.push_back(fds);
+    }
 #ifdef _WIN32
     WSAPoll(data->fds.data(), static_cast<ULONG>(data->fds.size()), timeout_ms);
 #else
@@ -91,7 +82,7 @@ bool Selector::isReady(SocketBase& socket)
     for(const auto& pfd : data->fds)
     {
         if (pfd.fd == socket.handle)
-            return pfd.revents & POLLIN;
+            return pfd.revents & (pfd.events | POLLERR | POLLHUP);
     }
     return false;
 }
@@ -2,21 +2,23 @@
 #define SP2_IO_NETWORK_SELECTOR_H
 
 #include <io/network/socketBase.h>
+#include "nonCopyable.h"
 
 namespace sp {
 namespace io {
 namespace network {
 
 
-class Selector
+//The Selector keeps a pointer to each added socket, so a socket has to be removed before it is destroyed.
+//For the same reason it cannot be copied.
+class Selector : sp::NonCopyable
 {
 public:
     Selector();
-    Selector(const Selector& other);
     ~Selector();
 
-    Selector& operator =(const Selector& other);
-    
+    //Sockets are waited on in their state at the time of wait(): a socket that is still connecting is ready once the connect
+    //finished or failed, one with an SSL handshake that wants to write is ready once it can write, else it waits for data.
     void add(SocketBase& socket);
     void remove(SocketBase& socket);
     void wait(int timeout_ms);
@@ -25,6 +25,8 @@ protected:
     intptr_t handle = -1;
 #endif
     bool blocking = true;
+    bool connecting = false;    //A non-blocking connect is in progress, the Selector then waits for it to finish.
+    bool want_write = false;    //The SSL handshake waits until it can write, so the Selector waits for that instead of for data.
     
     static void initSocketLib();
     friend class Address;
@@ -1,5 +1,8 @@
 #include <io/network/streamSocket.h>
 #include <logging.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
 
 
 namespace sp {
@@ -15,28 +18,24 @@ void StreamSocket::send(const void* data, size_t size)
 {
     if (getState() != State::Connected)
         return;
-    if (sendSendQueue())
-    {
-        queue(data, size);
-        return;
-    }
-
-    for(size_t done = 0; done < size; )
-    {
-        size_t result = _send(static_cast<const char*>(data) + done, static_cast<int>(size - done));
-        if (result == 0)
-        {
-            if (getState() == State::Connected)
-                send_queue += std::string(static_cast<const char*>(data) + done, size - done);
-            return;
-        }
-        done += result;
-    }
+    //Everything goes trough the queue, so we know which bytes belong to a partially send packet.
+    queue(data, size);
+    sendSendQueue();
 }
 
 void StreamSocket::queue(const void* data, size_t size)
 {
-    send_queue += std::string(static_cast<const char*>(data), size);
+    queueRaw(data, size);
+    if (!compressor)
+        send_queue_packet_ends.push_back(send_queue.size());
+}
+
+void StreamSocket::queueRaw(const void* data, size_t size)
+{
+    if (compressor)
+        compress_pending.insert(compress_pending.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    else
+        send_queue.append(static_cast<const char*>(data), size);
 }
 
 size_t StreamSocket::receive(void* data, size_t size)
@@ -46,21 +45,80 @@ size_t StreamSocket::receive(void* data, size_t size)
     if (getState() != State::Connected)
         return 0;
     
-    return _receive(data, size);
+    //Data that was read ahead by a packet receive comes first.
+    if (receive_stream_start == receive_stream_end)
+    {
+        if (!decompressor)
+            return _receive(data, size);
+        if (!fillReceiveStream())
+            return 0;
+    }
+    size = std::min(size, receive_stream_end - receive_stream_start);
+    memcpy(data, &receive_stream[receive_stream_start], size);
+    receive_stream_start += size;
+    return size;
+}
+
+size_t StreamSocket::sendDirect(const void* data, size_t size)
+{
+    if (getState() != State::Connected)
+        return 0;
+    return _send(data, size);
 }
 
 void StreamSocket::send(const io::DataBuffer& buffer)
 {
-    io::DataBuffer packet_size(uint32_t(buffer.getDataSize()));
-    send(packet_size.getData(), packet_size.getDataSize());
-    send(buffer.getData(), buffer.getDataSize());
+    if (getState() != State::Connected)
+        return;
+    //Put the size and the data in the queue together, so the packet goes out with a single write.
+    queue(buffer);
+    sendSendQueue();
+}
+
+void StreamSocket::queue(const io::DataBuffer& buffer, bool keep_on_drop)
+{
+    std::string kept;
+    queuePacketData(buffer, keep_on_drop ? &kept : nullptr);
+    endPacket(std::move(kept));
+}
+
+void StreamSocket::queue(const io::DataBuffer& first, const io::DataBuffer& second, bool keep_on_drop)
+{
+    std::string kept;
+    queuePacketData(first, keep_on_drop ? &kept : nullptr);
+    queuePacketData(second, keep_on_drop ? &kept : nullptr);
+    endPacket(std::move(kept));
+}
+
+void StreamSocket::queuePacketData(const io::DataBuffer& buffer, std::string* kept)
+{
+    //The size header is encoded like a DataBuffer encodes an uint32_t, but without allocating one for each packet.
+    uint8_t packet_size[5];
+    size_t header_size = io::DataBuffer::encodeVLQu(uint32_t(buffer.getDataSize()), packet_size);
+    queueRaw(packet_size, header_size);
+    queueRaw(buffer.getData(), buffer.getDataSize());
+    if (kept)
+    {
+        kept->append(reinterpret_cast<const char*>(packet_size), header_size);
+        kept->append(reinterpret_cast<const char*>(buffer.getData()), buffer.getDataSize());
+    }
 }
 
-void StreamSocket::queue(const io::DataBuffer& buffer)
+void StreamSocket::endPacket(std::string&& kept)
 {
-    io::DataBuffer packet_size(uint32_t(buffer.getDataSize()));
-    queue(packet_size.getData(), packet_size.getDataSize());
-    queue(buffer.getData(), buffer.getDataSize());
+    if (!compressor)
+        send_queue_packet_ends.push_back(send_queue.size());
+    if (!kept.empty())
+        kept_packets.push_back({compressor ? compress_pending_end : send_queue.size(), std::move(kept)});
+}
+
+void StreamSocket::requeue(const std::vector<std::string>& packets)
+{
+    for(auto& packet : packets)
+    {
+        queueRaw(packet.data(), packet.size());
+        endPacket(std::string(packet));
+    }
 }
 
 bool StreamSocket::receive(io::DataBuffer& buffer)
@@ -68,64 +126,273 @@ bool StreamSocket::receive(io::DataBuffer& buffer)
     if (getState() != State::Connected)
         return 0;
     
-    if (!receive_packet_size_done)
+    //Read in chunks and split the packets from that, instead of doing a read call for each byte of the size header.
+    while(true)
     {
-        uint8_t size_buffer[1];
-        do {
-            auto result = _receive(reinterpret_cast<char*>(size_buffer), 1);
-            if (result == 0)
+        if (!receive_packet_size_done)
+        {
+            if (receive_stream_start == receive_stream_end && !fillReceiveStream())
                 return false;
-            receive_packet_size = (receive_packet_size << 7) | (size_buffer[0] & 0x7F);
-            if (!(size_buffer[0] & 0x80))
-                receive_packet_size_done = true;
-        } while(!receive_packet_size_done);
-
-        receive_buffer.resize(receive_packet_size);
-        receive_packet_size = 0;
-        received_size = 0;
-    }
+            while(receive_stream_start < receive_stream_end && !receive_packet_size_done)
+            {
+                uint8_t b = receive_stream[receive_stream_start++];
+                receive_packet_size = (receive_packet_size << 7) | (b & 0x7F);
+                if (!(b & 0x80))
+                    receive_packet_size_done = true;
+            }
+            if (!receive_packet_size_done)
+                continue;
+            receive_buffer.resize(receive_packet_size);
+            receive_packet_size = 0;
+            received_size = 0;
+        }
 
-    while(true)
-    {
-        auto result = _receive(reinterpret_cast<char*>(&receive_buffer[received_size]), static_cast<int>(receive_buffer.size() - received_size));
-        received_size += result;
+        size_t needed = receive_buffer.size() - received_size;
+        if (needed > 0)
+        {
+            if (receive_stream_start < receive_stream_end)
+            {
+                size_t size = std::min(needed, receive_stream_end - receive_stream_start);
+                memcpy(&receive_buffer[received_size], &receive_stream[receive_stream_start], size);
+                receive_stream_start += size;
+                received_size += size;
+            }
+            else if (needed >= receive_stream_chunk_size && !decompressor)
+            {
+                //Large packet, read straight into the packet buffer.
+                auto result = _receive(&receive_buffer[received_size], needed);
+                if (result < 1)
+                    return false;
+                received_size += result;
+            }
+            else if (!fillReceiveStream())
+            {
+                return false;
+            }
+        }
         if (received_size == receive_buffer.size())
         {
-            buffer = std::move(receive_buffer);
+            //Swap instead of move, so the storage of the previous packet is reused for the next one.
+            buffer.swap(receive_buffer);
             received_size = 0;
             receive_packet_size_done = false;
             return true;
         }
+    }
+}
+
+bool StreamSocket::fillReceiveStream()
+{
+    receive_stream_start = 0;
+    receive_stream_end = 0;
+    if (decompressor)
+        return decompressReceiveStream();
+    if (receive_stream.size() < receive_stream_chunk_size)
+        receive_stream.resize(receive_stream_chunk_size);
+    receive_stream_end = _receive(receive_stream.data(), receive_stream.size());
+    return receive_stream_end > 0;
+}
+
+bool StreamSocket::decompressReceiveStream()
+{
+    //Compressed data comes in chunks, each the size of the chunk followed by the compressed data, see flushCompression().
+    while(true)
+    {
+        size_t available = compressed_stream.size() - compressed_stream_start;
+        const uint8_t* chunk = compressed_stream.data() + compressed_stream_start;
+        uint32_t chunk_size = 0;
+        size_t header_size = 0;
+        bool header_done = false;
+        while(!header_done && header_size < available && header_size < 5)
+        {
+            uint8_t b = chunk[header_size++];
+            chunk_size = (chunk_size << 7) | (b & 0x7F);
+            header_done = !(b & 0x80);
+        }
+        if (!header_done && header_size == 5)
+        {
+            LOG(WARNING) << "Received a corrupt compressed chunk, closing the connection";
+            close();
+            return false;
+        }
+        if (header_done && available - header_size >= chunk_size)
+        {
+            compressed_stream_start += header_size + chunk_size;
+            if (!decompressor->decompress(chunk + header_size, chunk_size, receive_stream))
+            {
+                LOG(WARNING) << "Received a corrupt compressed chunk, closing the connection";
+                close();
+                return false;
+            }
+            receive_stream_end = receive_stream.size();
+            if (receive_stream_end > 0)
+                return true;
+            continue;
+        }
+
+        //Need more data for the chunk.
+        compressed_stream.erase(compressed_stream.begin(), compressed_stream.begin() + compressed_stream_start);
+        compressed_stream_start = 0;
+        size_t offset = compressed_stream.size();
+        compressed_stream.resize(offset + receive_stream_chunk_size);
+        size_t result = _receive(compressed_stream.data() + offset, receive_stream_chunk_size);
+        compressed_stream.resize(offset + result);
         if (result < 1)
-            break;
+            return false;
     }
-    
-    return false;
 }
 
 bool StreamSocket::sendSendQueue()
 {
-    if (send_queue.size() < 1)
+    flushCompression();
+    if (getSendQueueSize() < 1)
         return false;
     
     size_t result;
     do
     {
-        result = _send(static_cast<const char*>(send_queue.data()), static_cast<int>(send_queue.size()));
-        if (result > 0)
-            send_queue = send_queue.substr(result);
-    } while(result > 0 && send_queue.size() > 0);
-    
-    return send_queue.size() > 0;
+        result = _send(send_queue.data() + send_queue_offset, send_queue.size() - send_queue_offset);
+        send_queue_offset += result;
+    } while(result > 0 && send_queue_offset < send_queue.size());
+
+    while(!send_queue_packet_ends.empty() && send_queue_packet_ends.front() <= send_queue_offset)
+    {
+        send_queue_packet_start = send_queue_packet_ends.front();
+        send_queue_packet_ends.pop_front();
+    }
+    while(!kept_packets.empty() && kept_packets.front().end <= send_queue_offset)
+        kept_packets.pop_front();
+    compactSendQueue();
+
+    return getSendQueueSize() > 0;
+}
+
+std::vector<std::string> StreamSocket::dropUnsentQueue()
+{
+    compress_pending.clear();
+    size_t keep = send_queue_offset;
+    if (send_queue_packet_start < send_queue_offset && !send_queue_packet_ends.empty())
+        keep = send_queue_packet_ends.front();
+    //Packets are kept in queue order, so the dropped ones are at the back.
+    auto first_dropped = kept_packets.end();
+    while(first_dropped != kept_packets.begin() && std::prev(first_dropped)->end > keep)
+        --first_dropped;
+    std::vector<std::string> dropped;
+    for(auto it = first_dropped; it != kept_packets.end(); ++it)
+        dropped.push_back(std::move(it->data));
+    kept_packets.erase(first_dropped, kept_packets.end());
+    //The dropped chunks are part of the compression history, which the other side will never see.
+    if (compressor && keep < send_queue.size())
+        compressor->reset();
+    send_queue.resize(keep);
+    while(!send_queue_packet_ends.empty() && send_queue_packet_ends.back() > keep)
+        send_queue_packet_ends.pop_back();
+    compactSendQueue();
+    return dropped;
+}
+
+void StreamSocket::compactSendQueue()
+{
+    //Only move the remaining data to the front once the send part is big, instead of on every partial send.
+    if (send_queue_offset < send_queue.size() && (send_queue_offset < 64 * 1024 || send_queue_offset < send_queue.size() / 2))
+        return;
+    send_queue.erase(0, send_queue_offset);
+    for(auto& end : send_queue_packet_ends)
+        end -= send_queue_offset;
+    for(auto& packet : kept_packets)
+        if (packet.end != compress_pending_end)
+            packet.end -= send_queue_offset;
+    send_queue_packet_start -= std::min(send_queue_packet_start, send_queue_offset);
+    send_queue_offset = 0;
+}
+
+void StreamSocket::flushCompression()
+{
+    if (!compressor || compress_pending.empty())
+        return;
+    compress_buffer.clear();
+    compressor->compress(compress_pending.data(), compress_pending.size(), compress_buffer);
+    compress_pending.clear();
+    uint8_t chunk_size[5];
+    send_queue.append(reinterpret_cast<const char*>(chunk_size), io::DataBuffer::encodeVLQu(uint32_t(compress_buffer.size()), chunk_size));
+    send_queue.append(reinterpret_cast<const char*>(compress_buffer.data()), compress_buffer.size());
+    send_queue_packet_ends.push_back(send_queue.size());
+    for(auto it = kept_packets.rbegin(); it != kept_packets.rend() && it->end == compress_pending_end; ++it)
+        it->end = send_queue.size();
+}
+
+void StreamSocket::setSendCompression(int level)
+{
+    if (level < 1)
+    {
+        flushCompression();
+        compressor = nullptr;
+    }
+    else if (compressor)
+    {
+        compressor->setLevel(level);
+    }
+    else
+    {
+        compressor = std::make_unique<StreamCompressor>(level);
+    }
+}
+
+void StreamSocket::setReceiveCompression(bool enabled)
+{
+    if (enabled && !decompressor)
+    {
+        decompressor = std::make_unique<StreamDecompressor>();
+        //Data that was already read ahead is compressed.
+        compressed_stream.assign(receive_stream.begin() + receive_stream_start, receive_stream.begin() + receive_stream_end);
+        compressed_stream_start = 0;
+        receive_stream_start = 0;
+        receive_stream_end = 0;
+    }
+    else if (!enabled && decompressor)
+    {
+        //Data that was read but not decompressed yet is not compressed after all.
+        receive_stream.resize(receive_stream_end);
+        receive_stream.insert(receive_stream.end(), compressed_stream.begin() + compressed_stream_start, compressed_stream.end());
+        receive_stream_end = receive_stream.size();
+        compressed_stream.clear();
+        compressed_stream_start = 0;
+        decompressor = nullptr;
+    }
+}
+
+StreamCompression::Stats StreamSocket::getSendCompressionStats() const
+{
+    if (compressor)
+        return compressor->getStats();
+    return {};
+}
+
+StreamCompression::Stats StreamSocket::getReceiveCompressionStats() const
+{
+    if (decompressor)
+        return decompressor->getStats();
+    return {};
 }
 
 void StreamSocket::clearQueue()
 {
     send_queue.clear();
+    send_queue_offset = 0;
+    send_queue_packet_start = 0;
+    send_queue_packet_ends.clear();
+    kept_packets.clear();
     receive_packet_size = 0;
     receive_packet_size_done = false;
     receive_buffer.clear();
     received_size = 0;
+    receive_stream_start = 0;
+    receive_stream_end = 0;
+    compressor = nullptr;
+    compress_pending.clear();
+    decompressor = nullptr;
+    compressed_stream.clear();
+    compressed_stream_start = 0;
 }
 
 }//namespace network
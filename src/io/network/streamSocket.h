@@ -2,7 +2,12 @@
 #define SP2_IO_NETWORK_STREAM_SOCKET_H
 
 #include <io/dataBuffer.h>
+#include <io/streamCompression.h>
 #include <nonCopyable.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 
 
 namespace sp {
@@ -28,11 +33,33 @@ public:
     size_t receive(void* data, size_t size);
 
     void send(const io::DataBuffer& buffer);
-    void queue(const io::DataBuffer& buffer);
+    //Packets queued with keep_on_drop are handed back by dropUnsentQueue() instead of being lost, for data that cannot be recreated.
+    void queue(const io::DataBuffer& buffer, bool keep_on_drop = false);
+    //Queue two packets that are only dropped together, like a list of targets and the packet it applies to.
+    void queue(const io::DataBuffer& first, const io::DataBuffer& second, bool keep_on_drop = false);
     bool receive(io::DataBuffer& buffer);
 
+    //Send without going trough the queue, returns the amount of bytes that could be send right away.
+    //Only use this on a socket that has nothing queued and no send compression, else the data gets mixed up.
+    size_t sendDirect(const void* data, size_t size);
+
     //Returns true if there is still data in the queue after sending
     bool sendSendQueue();
+    //Amount of bytes waiting in the send queue.
+    size_t getSendQueueSize() const { return send_queue.size() - send_queue_offset + compress_pending.size(); }
+    //Throw away all queued packets that did not start sending yet. A partially send packet is kept, so the stream stays intact.
+    //Returns the dropped packets that were queued with keep_on_drop, in their queued form. Pass them to requeue() after queueing what replaces the dropped data.
+    std::vector<std::string> dropUnsentQueue();
+    void requeue(const std::vector<std::string>& packets);
+
+    //Compress everything send from now on, with a level from 1 to StreamCompression::max_level, or 0 to stop.
+    //All data queued between two sendSendQueue() calls is compressed together, with the history of what was send before it.
+    //The other side has to start decompressing at exactly the same byte, so the protocol on top has to agree on when to switch.
+    void setSendCompression(int level);
+    //Decompress everything received after the last returned data.
+    void setReceiveCompression(bool enabled);
+    StreamCompression::Stats getSendCompressionStats() const;
+    StreamCompression::Stats getReceiveCompressionStats() const;
 
 protected:
     void clearQueue();
@@ -40,11 +67,41 @@ protected:
     virtual size_t _send(const void* data, size_t size) = 0;
     virtual size_t _receive(void* data, size_t size) = 0;
 private:
+    void queueRaw(const void* data, size_t size);
+    void queuePacketData(const io::DataBuffer& buffer, std::string* kept);
+    void endPacket(std::string&& kept);
+    void compactSendQueue();
+    void flushCompression();
+    bool fillReceiveStream();
+    bool decompressReceiveStream();
+
+    static constexpr size_t receive_stream_chunk_size = 16 * 1024;
+
     std::string send_queue;
+    size_t send_queue_offset{0};    //Bytes at the front of send_queue that are already send.
+    size_t send_queue_packet_start{0};  //Position in send_queue where the packet that is currently being send started.
+    std::deque<size_t> send_queue_packet_ends;  //End position in send_queue of each queued packet.
+    struct KeptPacket
+    {
+        size_t end;         //End position in send_queue, or compress_pending_end while the packet is not compressed yet.
+        std::string data;
+    };
+    static constexpr size_t compress_pending_end = ~size_t(0);
+    std::deque<KeptPacket> kept_packets;    //Copies of the unsent packets that were queued with keep_on_drop.
     uint32_t receive_packet_size{0};
     bool receive_packet_size_done{false};
     std::vector<uint8_t> receive_buffer;
     size_t received_size{0};
+    std::vector<uint8_t> receive_stream;    //Data read from the socket that is not handed out yet.
+    size_t receive_stream_start{0};
+    size_t receive_stream_end{0};
+
+    std::unique_ptr<StreamCompressor> compressor;
+    std::vector<uint8_t> compress_pending;  //Queued data that is not compressed yet.
+    std::vector<uint8_t> compress_buffer;
+    std::unique_ptr<StreamDecompressor> decompressor;
+    std::vector<uint8_t> compressed_stream; //Data read from the socket that is not decompressed yet.
+    size_t compressed_stream_start{0};
 };
 
 }//namespace network
@@ -77,7 +77,7 @@ bool TcpListener::listen(int port)
         }
     }
 
-    if (::listen(handle, 8) < 0)
+    if (::listen(handle, SOMAXCONN) < 0)
     {
         close();
         return false;
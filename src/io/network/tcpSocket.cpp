@@ -1,5 +1,7 @@
 #include <io/network/tcpSocket.h>
 #include <logging.h>
+#include <algorithm>
+#include <iterator>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -25,6 +27,7 @@ static inline int recv(SOCKET s, void* buf, size_t len, int flags)
 #include <arpa/inet.h>
 #include <string.h>
 #include <poll.h>
+#include <netdb.h>
 #if defined(__APPLE__)
 static constexpr int flags = 0;
 #else
@@ -53,6 +56,7 @@ extern "C" {
     static SSL* (*SSL_new)(SSL_CTX*);
     static int (*SSL_set_fd)(SSL *ssl, int fd);
     static int (*SSL_connect)(SSL *ssl);
+    static int (*SSL_get_error)(const SSL *ssl, int ret);
     static long (*SSL_get_verify_result)(const SSL *ssl);
     static int (*SSL_read)(SSL *ssl, void *buf, int num);
     static int (*SSL_write)(SSL *ssl, const void *buf, int num);
@@ -67,6 +71,9 @@ extern "C" {
 # define SSL_OP_NO_TLSv1_2                               0x08000000L
 # define SSL_OP_NO_TLSv1_1                               0x10000000L
 
+# define SSL_ERROR_WANT_READ                             2
+# define SSL_ERROR_WANT_WRITE                            3
+
 #ifndef __ANDROID__
 #include "dynamicLibrary.h"
 
@@ -104,6 +111,7 @@ static void initializeLibSSL()
     SSL_new = libssl->getFunction<SSL* (*)(SSL_CTX*)>("SSL_new");
     SSL_set_fd = libssl->getFunction<int (*)(SSL *ssl, int fd)>("SSL_set_fd");
     SSL_connect = libssl->getFunction<int (*)(SSL *ssl)>("SSL_connect");
+    SSL_get_error = libssl->getFunction<int (*)(const SSL *ssl, int ret)>("SSL_get_error");
     SSL_get_verify_result = libssl->getFunction<long (*)(const SSL *ssl)>("SSL_get_verify_result");
     SSL_read = libssl->getFunction<int (*)(SSL *ssl, void *buf, int num)>("SSL_read");
     SSL_write = libssl->getFunction<int (*)(SSL *ssl, const void *buf, int num)>("SSL_write");
@@ -158,11 +166,33 @@ TcpSocket::~TcpSocket()
 
 bool TcpSocket::connect(const Address& host, int port)
 {
-    if (handle != INVALID_SOCKET)
-        close();
-    
-    for(const auto& addr_info : host.addr_info)
+    close();
+    connect_address = host;
+    connect_index = 0;
+    connect_port = port;
+    connect_ssl = false;
+    return connectNext();
+}
+
+bool TcpSocket::connect(const string& hostname, int port)
+{
+    close();
+    resolver = std::make_unique<AddressResolver>(hostname);
+    connect_port = port;
+    connect_ssl = false;
+    if (!blocking && !resolver->isDone())
+        return true;
+    return finishResolve();
+}
+
+bool TcpSocket::connectNext()
+{
+    auto it = connect_address.addr_info.begin();
+    std::advance(it, std::min(connect_index, connect_address.addr_info.size()));
+    for(; it != connect_address.addr_info.end(); ++it)
     {
+        const auto& addr_info = *it;
+        connect_index++;
         handle = ::socket(addr_info.family, SOCK_STREAM, 0);
         if (handle == INVALID_SOCKET)
             return false;
@@ -172,7 +202,7 @@ bool TcpSocket::connect(const Address& host, int port)
             struct sockaddr_in server_addr;
             memset(&server_addr, 0, sizeof(server_addr));
             memcpy(&server_addr, addr_info.addr.data(), addr_info.addr.size());
-            server_addr.sin_port = htons(port);
+            server_addr.sin_port = htons(connect_port);
             if (::connect(handle, reinterpret_cast<const sockaddr*>(&server_addr), sizeof(server_addr)) == 0)
                 return true;
             if (isLastErrorNonBlocking())
@@ -186,7 +216,7 @@ bool TcpSocket::connect(const Address& host, int port)
             struct sockaddr_in6 server_addr;
             memset(&server_addr, 0, sizeof(server_addr));
             memcpy(&server_addr, addr_info.addr.data(), addr_info.addr.size());
-            server_addr.sin6_port = htons(port);
+            server_addr.sin6_port = htons(connect_port);
             if (::connect(handle, reinterpret_cast<const sockaddr*>(&server_addr), sizeof(server_addr)) == 0)
                 return true;
             if (isLastErrorNonBlocking())
@@ -200,10 +230,41 @@ bool TcpSocket::connect(const Address& host, int port)
     return false;
 }
 
+bool TcpSocket::finishResolve()
+{
+    std::unique_ptr<AddressResolver> done = std::move(resolver);
+    connect_address = done->getAddress();
+    connect_index = 0;
+    if (connect_address.addr_info.empty())
+    {
+        LOG(Warning, "Failed to resolve hostname: ", done->getHostname());
+        return false;
+    }
+    if (!connectNext())
+        return false;
+    return !connect_ssl || startSSL();
+}
+
 bool TcpSocket::connectSSL(const Address& host, int port)
 {
     if (!connect(host, port))
         return false;
+    connect_ssl = true;
+    return startSSL();
+}
+
+bool TcpSocket::connectSSL(const string& hostname, int port)
+{
+    if (!connect(hostname, port))
+        return false;
+    connect_ssl = true;
+    if (resolver)
+        return true;
+    return startSSL();
+}
+
+bool TcpSocket::startSSL()
+{
     initializeLibSSL();
     if (!SSL_new)
     {
@@ -214,12 +275,38 @@ bool TcpSocket::connectSSL(const Address& host, int port)
     
     ssl_handle = SSL_new(ssl_context);
     SSL_set_fd(static_cast<SSL*>(ssl_handle), static_cast<int>(handle));
-    if (!SSL_connect(static_cast<SSL*>(ssl_handle)))
+    ssl_handshaking = true;
+    if (!blocking)
+        return true;
+    if (!continueSSLHandshake())
+        return false;
+    if (ssl_handshaking)
+    {
+        //A blocking handshake only stops halfway when the socket timeout expired.
+        LOG(Warning, "Failed to connect SSL socket due to a timeout during SSL negotiation.");
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TcpSocket::continueSSLHandshake()
+{
+    int result = SSL_connect(static_cast<SSL*>(ssl_handle));
+    if (result != 1)
     {
+        int error = SSL_get_error(static_cast<SSL*>(ssl_handle), result);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        {
+            want_write = error == SSL_ERROR_WANT_WRITE;
+            return true;
+        }
         LOG(Warning, "Failed to connect SSL socket due to SSL negotiation failure.");
         close();
         return false;
     }
+    ssl_handshaking = false;
+    want_write = false;
     if (SSL_get_verify_result(static_cast<SSL*>(ssl_handle)) != 0)
     {
         LOG(Warning, "Failed to connect SSL socket due to certificate verfication failure.");
@@ -245,6 +332,7 @@ void TcpSocket::setDelay(bool delay)
 
 void TcpSocket::close()
 {
+    resolver = nullptr;
     if (handle != INVALID_SOCKET)
     {
 #ifdef _WIN32
@@ -254,6 +342,8 @@ void TcpSocket::close()
 #endif
         handle = INVALID_SOCKET;
         connecting = false;
+        ssl_handshaking = false;
+        want_write = false;
         clearQueue();
         if (ssl_handle)
             SSL_free(static_cast<SSL*>(ssl_handle));
@@ -263,6 +353,13 @@ void TcpSocket::close()
 
 StreamSocket::State TcpSocket::getState()
 {
+    if (resolver)
+    {
+        if (!resolver->isDone())
+            return StreamSocket::State::Connecting;
+        if (!finishResolve())
+            return StreamSocket::State::Closed;
+    }
     if (handle == INVALID_SOCKET)
         return StreamSocket::State::Closed;
     if (connecting) {
@@ -280,17 +377,46 @@ StreamSocket::State TcpSocket::getState()
             socklen_t server_addr_len = sizeof(server_addr);
             if (getpeername(handle, reinterpret_cast<sockaddr*>(&server_addr), &server_addr_len))
             {
+                //This address did not work out, move on to the next one of the host, if there is one.
                 close();
-                return StreamSocket::State::Closed;
+                if (!connectNext() || (connect_ssl && !startSSL()))
+                    return StreamSocket::State::Closed;
+                return getState();
             }
             connecting = false;
-            return StreamSocket::State::Connected;
         }
-        return StreamSocket::State::Connecting;
+        else
+        {
+            return StreamSocket::State::Connecting;
+        }
+    }
+    if (ssl_handshaking)
+    {
+        //Every call advances the handshake as far as the data that arrived allows, so this never blocks.
+        if (!continueSSLHandshake())
+            return StreamSocket::State::Closed;
+        if (ssl_handshaking)
+            return StreamSocket::State::Connecting;
     }
     return StreamSocket::State::Connected;
 }
 
+Address TcpSocket::getRemoteAddress() const
+{
+    std::list<Address::AddrInfo> addr_info;
+    if (handle == INVALID_SOCKET)
+        return Address(std::move(addr_info));
+    struct sockaddr_storage remote_addr;
+    socklen_t remote_addr_len = sizeof(remote_addr);
+    if (getpeername(handle, reinterpret_cast<sockaddr*>(&remote_addr), &remote_addr_len))
+        return Address(std::move(addr_info));
+    char buffer[128];
+    if (::getnameinfo(reinterpret_cast<sockaddr*>(&remote_addr), remote_addr_len, buffer, sizeof(buffer), nullptr, 0, NI_NUMERICHOST))
+        return Address(std::move(addr_info));
+    addr_info.emplace_back(remote_addr.ss_family, buffer, &remote_addr, remote_addr_len);
+    return Address(std::move(addr_info));
+}
+
 size_t TcpSocket::_send(const void* data, size_t size)
 {
     int result;
@@ -2,6 +2,7 @@
 #define SP2_IO_NETWORK_TCP_SOCKET_H
 
 #include <io/network/address.h>
+#include <io/network/addressResolver.h>
 #include <io/network/socketBase.h>
 #include <io/network/streamSocket.h>
 #include <io/dataBuffer.h>
@@ -18,20 +19,39 @@ public:
     TcpSocket();
     ~TcpSocket();
 
+    //Tries each address of the host in turn. On a non-blocking socket that continues while getState() reports Connecting.
     bool connect(const Address& host, int port);
+    //Resolve the hostname trough the AddressResolver first. A non-blocking socket does not wait for it, but reports Connecting meanwhile.
+    bool connect(const string& hostname, int port);
+    //On a non-blocking socket the SSL handshake is not done here, but continues while getState() reports Connecting.
     bool connectSSL(const Address& host, int port);
+    bool connectSSL(const string& hostname, int port);
     void setDelay(bool delay); //Enable of disable the NO_DELAY/Nagle algorithm, allowing for less latency at the cost of more packets.
     virtual void close() override;
 
     virtual State getState() override;
+    bool isResolving() const { return resolver != nullptr; }
+    //The address of the other side of the connection, empty when not connected.
+    Address getRemoteAddress() const;
 
 protected:
     virtual size_t _send(const void* data, size_t size) override;
     virtual size_t _receive(void* data, size_t size) override;
 
 private:
+    bool connectNext();
+    bool finishResolve();
+    bool startSSL();
+    bool continueSSLHandshake();
+
     void* ssl_handle;
-    bool connecting = false;
+    bool ssl_handshaking = false;
+
+    std::unique_ptr<AddressResolver> resolver;
+    Address connect_address;
+    size_t connect_index = 0;   //Next address of connect_address to try when the current attempt fails.
+    int connect_port = 0;
+    bool connect_ssl = false;
 
     friend class TcpListener;
 };
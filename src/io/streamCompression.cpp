@@ -0,0 +1,309 @@
+#include <io/streamCompression.h>
+#include <io/dataBuffer.h>
+#include <timer.h>
+#include <string.h>
+#include <algorithm>
+
+
+namespace sp {
+namespace io {
+
+static inline uint32_t read32(const uint8_t* ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+//Lengths that do not fit in the 4 bits of the token continue in extra bytes of 255, ended by a smaller byte.
+static inline uint8_t* writeLength(uint8_t* out, size_t length)
+{
+    for(; length >= 255; length -= 255)
+        *out++ = 255;
+    *out++ = uint8_t(length);
+    return out;
+}
+
+static inline bool readLength(const uint8_t*& in, const uint8_t* in_end, size_t& length)
+{
+    uint8_t b;
+    do
+    {
+        if (in >= in_end)
+            return false;
+        b = *in++;
+        length += b;
+    } while(b == 255);
+    return true;
+}
+
+StreamCompression::Stats& StreamCompression::Stats::operator+=(const Stats& other)
+{
+    chunks += other.chunks;
+    raw_bytes += other.raw_bytes;
+    compressed_bytes += other.compressed_bytes;
+    time += other.time;
+    return *this;
+}
+
+void StreamCompression::trimHistory()
+{
+    if (history.size() < window_size * 2)
+        return;
+    size_t drop = history.size() - window_size;
+    history.erase(history.begin(), history.begin() + drop);
+    history_start += drop;
+}
+
+StreamCompressor::StreamCompressor(int level)
+{
+    hash_table.resize(size_t(1) << hash_bits, 0);
+    setLevel(level);
+}
+
+void StreamCompressor::setLevel(int level)
+{
+    this->level = std::max(1, std::min(max_level, level));
+    if (this->level > 1)
+    {
+        max_chain = std::min(256, 2 << this->level);
+        chain.resize(window_size, 0);
+    }else{
+        max_chain = 1;
+        chain.clear();
+    }
+}
+
+void StreamCompressor::reset()
+{
+    //Keep counting stream positions, so the old hash entries point before the history and are ignored.
+    history_start += history.size() + window_size;
+    history.clear();
+    reset_pending = true;
+}
+
+void StreamCompressor::compress(const void* data, size_t size, std::vector<uint8_t>& output)
+{
+    sp::SystemStopwatch clock;
+    trimHistory();
+    size_t start = history.size();
+    history.insert(history.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+
+    uint8_t flags = reset_pending ? flag_reset : 0;
+    reset_pending = false;
+    size_t offset = output.size();
+    //Worst case: the flags, the size and every byte as a literal with its length bytes.
+    output.resize(offset + 1 + 5 + size + size / 255 + 16);
+    uint8_t* out = output.data() + offset;
+    size_t header_size = 1 + DataBuffer::encodeVLQu(uint32_t(size), out + 1);
+    size_t block_size = compressBlock(start, out + header_size);
+    if (header_size + block_size < 1 + size)
+    {
+        out[0] = flags | flag_compressed;
+        output.resize(offset + header_size + block_size);
+    }else{
+        //Did not compress, send it as is. It still goes into the history, so later chunks can refer to it.
+        out[0] = flags;
+        if (size > 0)
+            memcpy(out + 1, data, size);
+        output.resize(offset + 1 + size);
+    }
+    stats.chunks++;
+    stats.raw_bytes += size;
+    stats.compressed_bytes += output.size() - offset;
+    stats.time += clock.get();
+}
+
+void StreamCompressor::insertHash(size_t index)
+{
+    uint32_t h = (read32(&history[index]) * 2654435761U) >> (32 - hash_bits);
+    uint32_t position = uint32_t(history_start + index + 1);
+    if (!chain.empty())
+        chain[position & (window_size - 1)] = hash_table[h];
+    hash_table[h] = position;
+}
+
+size_t StreamCompressor::compressBlock(size_t start, uint8_t* output)
+{
+    const uint8_t* base = history.data();
+    size_t end = history.size();
+    size_t anchor = start;
+    size_t index = start;
+    uint8_t* out = output;
+    int misses = 0;
+
+    while(index + min_match <= end)
+    {
+        uint32_t h = (read32(base + index) * 2654435761U) >> (32 - hash_bits);
+        uint32_t position = uint32_t(history_start + index + 1);
+        uint32_t candidate = hash_table[h];
+        if (!chain.empty())
+            chain[position & (window_size - 1)] = candidate;
+        hash_table[h] = position;
+
+        size_t best_length = 0;
+        size_t best_distance = 0;
+        uint32_t previous_distance = 0;
+        for(int n=0; n<max_chain && candidate != 0; n++)
+        {
+            uint32_t distance = position - candidate;
+            //Chain entries get overwritten as the window moves on, so stop as soon as they stop going back in the stream.
+            if (distance <= previous_distance || distance >= window_size || distance > index)
+                break;
+            previous_distance = distance;
+            const uint8_t* match = base + index - distance;
+            if (read32(match) == read32(base + index))
+            {
+                size_t length = min_match;
+                size_t max_length = end - index;
+                while(length < max_length && match[length] == base[index + length])
+                    length++;
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == max_length)
+                        break;
+                }
+            }
+            if (chain.empty())
+                break;
+            candidate = chain[candidate & (window_size - 1)];
+        }
+
+        if (best_length < min_match)
+        {
+            //Skip ahead faster trough data that does not compress.
+            index += 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+
+        size_t literal_length = index - anchor;
+        size_t match_length = best_length - min_match;
+        uint8_t* token = out++;
+        *token = uint8_t((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_length, 15));
+        if (literal_length >= 15)
+            out = writeLength(out, literal_length - 15);
+        memcpy(out, base + anchor, literal_length);
+        out += literal_length;
+        *out++ = uint8_t(best_distance);
+        *out++ = uint8_t(best_distance >> 8);
+        if (match_length >= 15)
+            out = writeLength(out, match_length - 15);
+
+        if (!chain.empty())
+        {
+            for(size_t n=index + 1; n<index + best_length && n + min_match <= end; n++)
+                insertHash(n);
+        }
+        index += best_length;
+        anchor = index;
+    }
+
+    //The block always ends with a token with only literals.
+    size_t literal_length = end - anchor;
+    *out++ = uint8_t(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15)
+        out = writeLength(out, literal_length - 15);
+    if (literal_length > 0)
+        memcpy(out, base + anchor, literal_length);
+    out += literal_length;
+    return out - output;
+}
+
+bool StreamDecompressor::decompress(const void* data, size_t size, std::vector<uint8_t>& output)
+{
+    sp::SystemStopwatch clock;
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    const uint8_t* in_end = in + size;
+    if (size < 1)
+        return false;
+    uint8_t flags = *in++;
+    if (flags & flag_reset)
+    {
+        history_start += history.size();
+        history.clear();
+    }
+    trimHistory();
+    size_t start = history.size();
+    if (flags & flag_compressed)
+    {
+        uint32_t raw_size = 0;
+        int shift_count = 0;
+        uint8_t b;
+        do
+        {
+            if (in >= in_end || shift_count++ == 5)
+                return false;
+            b = *in++;
+            raw_size = (raw_size << 7) | (b & 0x7F);
+        } while(b & 0x80);
+        //No input byte can produce more then 255 output bytes, so do not trust a size that claims otherwise.
+        if (raw_size > size_t(in_end - in) * 255 + 16)
+            return false;
+        if (!decompressBlock(in, in_end, raw_size))
+        {
+            history.resize(start);
+            return false;
+        }
+    }else{
+        history.insert(history.end(), in, in_end);
+    }
+    output.assign(history.begin() + start, history.end());
+
+    stats.chunks++;
+    stats.raw_bytes += output.size();
+    stats.compressed_bytes += size;
+    stats.time += clock.get();
+    return true;
+}
+
+bool StreamDecompressor::decompressBlock(const uint8_t* in, const uint8_t* in_end, size_t raw_size)
+{
+    size_t start = history.size();
+    size_t end = start + raw_size;
+    history.resize(end);
+    uint8_t* base = history.data();
+    size_t index = start;
+    while(true)
+    {
+        if (in >= in_end)
+            return false;
+        uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !readLength(in, in_end, literal_length))
+            return false;
+        if (literal_length > size_t(in_end - in) || literal_length > end - index)
+            return false;
+        memcpy(base + index, in, literal_length);
+        in += literal_length;
+        index += literal_length;
+        if (in == in_end)
+            return index == end;
+
+        if (in_end - in < 2)
+            return false;
+        size_t distance = in[0] | (in[1] << 8);
+        in += 2;
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !readLength(in, in_end, match_length))
+            return false;
+        match_length += min_match;
+        if (distance == 0 || distance > index || match_length > end - index)
+            return false;
+        //Matches can overlap with the bytes they produce, so copy byte by byte when they are that close.
+        const uint8_t* match = base + index - distance;
+        if (distance >= match_length)
+        {
+            memcpy(base + index, match, match_length);
+        }else{
+            for(size_t n=0; n<match_length; n++)
+                base[index + n] = match[n];
+        }
+        index += match_length;
+    }
+}
+
+}//namespace io
+}//namespace sp
@@ -0,0 +1,92 @@
+#ifndef SP2_IO_STREAM_COMPRESSION_H
+#define SP2_IO_STREAM_COMPRESSION_H
+
+#include <nonCopyable.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+namespace sp {
+namespace io {
+
+/**
+    LZ77 compression of a stream in chunks, with a history window that is shared across chunks.
+    Replication packets are small and alike, so most of their bytes can be found in the packets before them,
+    which compressing each chunk by itself would never see.
+
+    Every compressed chunk starts with a flags byte, followed by either the data as is, or its size and the compressed data
+    in the LZ4 block layout. Chunks have to be decompressed in the order they were compressed, with nothing left out.
+ */
+class StreamCompression
+{
+public:
+    struct Stats
+    {
+        size_t chunks = 0;
+        size_t raw_bytes = 0;
+        size_t compressed_bytes = 0;
+        float time = 0.0f;  //Time spend (de)compressing, in seconds.
+
+        float getRatio() const { return raw_bytes > 0 ? float(compressed_bytes) / float(raw_bytes) : 1.0f; }
+        Stats& operator+=(const Stats& other);
+    };
+
+    static constexpr int max_level = 9;
+protected:
+    static constexpr size_t window_size = 64 * 1024;
+    static constexpr size_t min_match = 4;
+    static constexpr uint8_t flag_compressed = 0x01;
+    static constexpr uint8_t flag_reset = 0x02;
+
+    //Forget the history before the last window_size bytes, but not on every chunk, as that moves the whole window.
+    void trimHistory();
+
+    std::vector<uint8_t> history;
+    size_t history_start = 0;   //Stream position of history[0].
+    Stats stats;
+};
+
+class StreamCompressor : public StreamCompression, sp::NonCopyable
+{
+public:
+    //Level 1 is the fastest, higher levels search more of the history for longer matches, up to max_level.
+    StreamCompressor(int level = 1);
+
+    void setLevel(int level);
+    int getLevel() const { return level; }
+
+    //Compress a chunk and append the result to output.
+    void compress(const void* data, size_t size, std::vector<uint8_t>& output);
+    //Forget the history, for when compressed chunks got lost. The next chunk tells the decompressor to reset as well.
+    void reset();
+
+    const Stats& getStats() const { return stats; }
+private:
+    size_t compressBlock(size_t start, uint8_t* output);
+    void insertHash(size_t index);
+
+    static constexpr int hash_bits = 12;
+
+    int level;
+    int max_chain;
+    bool reset_pending = false;
+    std::vector<uint32_t> hash_table;   //Stream position + 1 of the last occurrence of each hash, 0 for none.
+    std::vector<uint32_t> chain;        //Previous position with the same hash, for each position in the window. Only used above level 1.
+};
+
+class StreamDecompressor : public StreamCompression, sp::NonCopyable
+{
+public:
+    //Decompress a chunk into output, replacing its contents. Returns false on corrupt data.
+    bool decompress(const void* data, size_t size, std::vector<uint8_t>& output);
+
+    const Stats& getStats() const { return stats; }
+private:
+    bool decompressBlock(const uint8_t* input, const uint8_t* input_end, size_t raw_size);
+};
+
+}//namespace io
+}//namespace sp
+
+#endif//SP2_IO_STREAM_COMPRESSION_H
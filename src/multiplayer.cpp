@@ -4,10 +4,12 @@
 #include "engine.h"
 #include "multiplayer_internal.h"
 
-static PVector<Collisionable> collisionable_significant;
+#include <deque>
+
 class CollisionableReplicationData
 {
 public:
+    std::shared_ptr<PVector<Collisionable>> significant;  //The significant collisionables of the server this object is on.
     glm::vec2 position{};
     glm::vec2 velocity{};
     float rotation;
@@ -20,19 +22,77 @@ public:
     }
 };
 
+class MultiplayerObject::ClientPrediction
+{
+public:
+    static constexpr size_t max_history = 256;
+
+    struct Command
+    {
+        uint32_t sequence;
+        float time;
+        std::vector<uint8_t> data;
+    };
+
+    Collisionable* collisionable;
+    unsigned int member_index;
+    float correction_time;
+    uint32_t next_sequence = 1;
+    std::deque<Command> history;    //Commands that the server did not acknowledge yet.
+    sp::SystemStopwatch clock;
+    float latency = 0.0f;   //Estimated one way latency, from the time it takes for commands to be acknowledged.
+    glm::vec2 position_error{};
+    float rotation_error = 0.0f;
+};
+
 
 MultiplayerClassListItem* multiplayerClassListStart;
 
+const std::vector<MultiplayerClassListItem*>& MultiplayerClassListItem::getClassTable()
+{
+    static std::vector<MultiplayerClassListItem*> table;
+    if (table.empty())
+    {
+        for(MultiplayerClassListItem* i = multiplayerClassListStart; i; i = i->next)
+            table.push_back(i);
+        SDL_assert(table.size() < noClassId);
+    }
+    return table;
+}
+
+uint16_t MultiplayerClassListItem::getClassId(const string& name)
+{
+    static std::unordered_map<string, uint16_t> ids;
+    if (ids.empty())
+    {
+        const auto& table = getClassTable();
+        for(unsigned int n=0; n<table.size(); n++)
+            ids[table[n]->name] = uint16_t(n);
+    }
+    auto it = ids.find(name);
+    if (it == ids.end())
+        return noClassId;
+    return it->second;
+}
+
 MultiplayerObject::MultiplayerObject(string multiplayerClassIdentifier)
-: multiplayerClassIdentifier(multiplayerClassIdentifier)
+: multiplayerClassIdentifier(multiplayerClassIdentifier), multiplayerClassId(MultiplayerClassListItem::noClassId)
 {
     multiplayerObjectId = noId;
     replicated = false;
 
-    if (game_server)
+    //All objects of the same class share the replication schema that the first object of that class built up.
+    static std::unordered_map<string, std::shared_ptr<ReplicationSchema>> class_schemas;
+    auto& schema = class_schemas[multiplayerClassIdentifier];
+    if (!schema)
+        schema = std::make_shared<ReplicationSchema>();
+    replication_schema = schema;
+
+    server = GameServer::getObjectScopeServer();
+    if (server)
     {
         on_server = true;
-        game_server->registerObject(this);
+        server->registerObject(this);
     }else{
         on_server = false;
     }
@@ -40,9 +100,55 @@ MultiplayerObject::MultiplayerObject(string multiplayerClassIdentifier)
 
 MultiplayerObject::~MultiplayerObject()
 {
-    for(unsigned int n=0; n<memberReplicationInfo.size(); n++)
-        if (memberReplicationInfo[n].cleanupFunction)
-            memberReplicationInfo[n].cleanupFunction(&memberReplicationInfo[n].prev_data);
+    for(unsigned int n=0; n<replication_prev_data.size(); n++)
+        if ((*replication_schema)[n].cleanupFunction)
+            (*replication_schema)[n].cleanupFunction(&replication_prev_data[n]);
+}
+
+P<GameServer> MultiplayerObject::getMultiplayerServer()
+{
+    return server;
+}
+
+void MultiplayerObject::addMemberReplication(const MemberReplicationInfo& info, uint64_t prev_data)
+{
+    size_t index = replication_prev_data.size();
+    if (index < replication_schema->size())
+    {
+        //Objects of the same class normally register the same members in the same order, so this only verifies the shared entry.
+        const MemberReplicationInfo& shared = (*replication_schema)[index];
+        if (shared.offset != info.offset || shared.raw_size != info.raw_size || shared.update_delay != info.update_delay
+            || shared.isChangedFunction != info.isChangedFunction || shared.sendFunction != info.sendFunction || shared.sendReplicatedFunction != info.sendReplicatedFunction
+            || shared.receiveFunction != info.receiveFunction || shared.cleanupFunction != info.cleanupFunction)
+        {
+            detachReplicationSchema(index);
+            replication_schema->push_back(info);
+        }
+    }else{
+        //Other objects sharing this schema only use their own prefix of it, so we can safely extend it.
+        replication_schema->push_back(info);
+    }
+    replication_prev_data.push_back(prev_data);
+    replication_update_timeout.push_back(0.0f);
+}
+
+void MultiplayerObject::detachReplicationSchema(size_t keep_count)
+{
+    //This object deviates from the rest of its class, give it a private copy of the schema.
+    replication_schema = std::make_shared<ReplicationSchema>(replication_schema->begin(), replication_schema->begin() + keep_count);
+}
+
+void MultiplayerObject::updateMemberReplicationUpdateDelay(void* data, float update_delay)
+{
+    for(unsigned int n=0; n<replication_prev_data.size(); n++)
+    {
+        if (getMemberReplicationPtr(n) == data && (*replication_schema)[n].update_delay != update_delay)
+        {
+            if (replication_schema.use_count() > 1)
+                detachReplicationSchema(replication_prev_data.size());
+            (*replication_schema)[n].update_delay = update_delay;
+        }
+    }
 }
 
 template <> bool multiplayerReplicationFunctions<string>::isChanged(void* data, void* prev_data_ptr)
@@ -75,7 +181,7 @@ static bool collisionable_isChanged(void* data, void* prev_data_ptr)
     float significance = 0.f;
     float significant_range = 1.f;
 
-    foreach(Collisionable, sig, collisionable_significant)
+    foreach(Collisionable, sig, *rep_data->significant)
     {
         float dist = glm::length(sig->getPosition() - position);
         float s = 0.f;
@@ -158,47 +264,178 @@ static void collisionable_cleanupFunction(void* prev_data_ptr)
 void MultiplayerObject::registerCollisionableReplication(float object_significant_range)
 {
     SDL_assert(!replicated);
-    SDL_assert(memberReplicationInfo.size() < 0xFFFF);
+    SDL_assert(replication_prev_data.size() < 0xFFFF);
 
     MemberReplicationInfo info;
     Collisionable* collisionable = dynamic_cast<Collisionable*>(this);
     SDL_assert(collisionable);
     collisionable->multiplayer_replication_object_significant_range = object_significant_range;
+    CollisionableReplicationData* rep_data = new CollisionableReplicationData();
+    //Significance only matters on the server, each server only looks at its own objects.
+    if (server)
+        rep_data->significant = server->significant_collisionables;
+    else
+        rep_data->significant = std::make_shared<PVector<Collisionable>>();
     if (object_significant_range > 0)
-        collisionable_significant.push_back(collisionable);
-    info.ptr = collisionable;
+        rep_data->significant->push_back(collisionable);
+    info.offset = reinterpret_cast<char*>(collisionable) - reinterpret_cast<char*>(this);
 #ifdef DEBUG
     info.name = "Collisionable_data";
 #endif
-    info.prev_data = reinterpret_cast<std::uint64_t>(new CollisionableReplicationData());
+    info.raw_size = 0;
     info.update_delay = 0.f;
-    info.update_timeout = 0.f;
     info.isChangedFunction = &collisionable_isChanged;
     info.sendFunction = &collisionable_sendFunction;
+    info.sendReplicatedFunction = NULL;
     info.receiveFunction = &collisionable_receiveFunction;
     info.cleanupFunction = &collisionable_cleanupFunction;
-    memberReplicationInfo.push_back(info);
+    addMemberReplication(info, reinterpret_cast<std::uint64_t>(rep_data));
 }
 
-void MultiplayerObject::sendClientCommand(sp::io::DataBuffer& packet)
+void MultiplayerObject::sendClientCommand(sp::io::DataBuffer& packet, bool flush_now)
 {
-    if (game_server)
+    if (on_server)
     {
         onReceiveClientCommand(0, packet);
     }else if (game_client)
     {
-        sp::io::DataBuffer p;
-        p << CMD_CLIENT_COMMAND << multiplayerObjectId;
-        game_client->sendPacket(p);
-        game_client->sendPacket(packet);
+        if (client_prediction)
+        {
+            //Predicted commands carry a sequence number, which the server acknowledges once it processed them.
+            ClientPrediction::Command command;
+            command.sequence = client_prediction->next_sequence++;
+            command.time = client_prediction->clock.get();
+            const uint8_t* data = static_cast<const uint8_t*>(packet.getData());
+            command.data.assign(data, data + packet.getDataSize());
+
+            sp::io::DataBuffer predicted;
+            predicted.appendRaw(command.data.data(), command.data.size());
+            onPredictClientCommand(predicted);
+
+            sp::io::DataBuffer sequenced;
+            sequenced << command.sequence;
+            sequenced.appendRaw(command.data.data(), command.data.size());
+            game_client->queueClientCommand(multiplayerObjectId, sequenced);
+
+            if (client_prediction->history.size() >= ClientPrediction::max_history)
+                client_prediction->history.pop_front();
+            client_prediction->history.push_back(std::move(command));
+        }else{
+            game_client->queueClientCommand(multiplayerObjectId, packet);
+        }
+        if (flush_now)
+            game_client->flushClientCommands();
     }
 }
 
 void MultiplayerObject::broadcastServerCommand(sp::io::DataBuffer& packet)
 {
-    if (game_server)
+    if (server)
     {
         onReceiveServerCommand(packet);
-        game_server->broadcastServerCommandFromObject(multiplayerObjectId, packet);
+        server->broadcastServerCommandFromObject(multiplayerObjectId, packet);
+    }
+}
+
+void MultiplayerObject::enableClientPrediction(float correction_time)
+{
+    SDL_assert(!replicated);
+    Collisionable* collisionable = dynamic_cast<Collisionable*>(this);
+    SDL_assert(collisionable);
+    for(unsigned int n=0; n<replication_prev_data.size(); n++)
+    {
+        if ((*replication_schema)[n].isChangedFunction == &collisionable_isChanged)
+        {
+            client_prediction = std::make_unique<ClientPrediction>();
+            client_prediction->collisionable = collisionable;
+            client_prediction->member_index = n;
+            client_prediction->correction_time = correction_time;
+            return;
+        }
+    }
+    LOG(ERROR) << "Client prediction enabled on " << multiplayerClassIdentifier << " without collisionable replication";
+}
+
+void MultiplayerObject::receivePredictedMemberReplication(unsigned int index, sp::io::DataBuffer& packet)
+{
+    const MemberReplicationInfo& info = (*replication_schema)[index];
+    ClientPrediction& prediction = *client_prediction;
+    //Only the client that sends commands for this object predicts it, everyone else shows the server state as is.
+    if (index != prediction.member_index || (prediction.history.empty() && prediction.latency <= 0.0f))
+    {
+        info.receiveFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+        return;
+    }
+
+    Collisionable* c = prediction.collisionable;
+    auto shown_position = c->getPosition();
+    float shown_rotation = c->getRotation();
+    info.receiveFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+
+    //The received state is about one latency old, move it forward to now while applying the commands the server had not seen yet.
+    float now = prediction.clock.get();
+    float time = now - prediction.latency;
+    auto step = [c](float delta)
+    {
+        c->setPosition(c->getPosition() + c->getVelocity() * delta);
+        c->setRotation(c->getRotation() + c->getAngularVelocity() * delta);
+    };
+    for(auto& command : prediction.history)
+    {
+        if (command.time > time)
+        {
+            step(command.time - time);
+            time = command.time;
+        }
+        sp::io::DataBuffer replay;
+        replay.appendRaw(command.data.data(), command.data.size());
+        onPredictClientCommand(replay);
+    }
+    if (now > time)
+        step(now - time);
+
+    //Keep showing where we were, and let updateClientPrediction move to the corrected state.
+    prediction.position_error = shown_position - c->getPosition();
+    prediction.rotation_error = shown_rotation - c->getRotation();
+    while(prediction.rotation_error > 180.0f) prediction.rotation_error -= 360.0f;
+    while(prediction.rotation_error < -180.0f) prediction.rotation_error += 360.0f;
+    c->setPosition(c->getPosition() + prediction.position_error);
+    c->setRotation(c->getRotation() + prediction.rotation_error);
+}
+
+void MultiplayerObject::acknowledgeClientPrediction(uint32_t sequence)
+{
+    ClientPrediction& prediction = *client_prediction;
+    while(!prediction.history.empty() && int32_t(prediction.history.front().sequence - sequence) <= 0)
+    {
+        if (prediction.history.front().sequence == sequence)
+        {
+            float latency = (prediction.clock.get() - prediction.history.front().time) * 0.5f;
+            if (prediction.latency <= 0.0f)
+                prediction.latency = latency;
+            else
+                prediction.latency = prediction.latency * 0.9f + latency * 0.1f;
+        }
+        prediction.history.pop_front();
+    }
+}
+
+void MultiplayerObject::updateClientPrediction(float delta)
+{
+    ClientPrediction& prediction = *client_prediction;
+    if (prediction.position_error == glm::vec2{} && prediction.rotation_error == 0.0f)
+        return;
+    float remaining = prediction.correction_time > 0.0f ? std::exp(-delta / prediction.correction_time) : 0.0f;
+    auto position_error = prediction.position_error * remaining;
+    float rotation_error = prediction.rotation_error * remaining;
+    if (glm::length(position_error) < 0.01f && std::abs(rotation_error) < 0.01f)
+    {
+        position_error = glm::vec2{};
+        rotation_error = 0.0f;
     }
+    Collisionable* c = prediction.collisionable;
+    c->setPosition(c->getPosition() - (prediction.position_error - position_error));
+    c->setRotation(c->getRotation() - (prediction.rotation_error - rotation_error));
+    prediction.position_error = position_error;
+    prediction.rotation_error = rotation_error;
 }
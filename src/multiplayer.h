@@ -3,10 +3,12 @@
 
 #include <io/dataBuffer.h>
 #include <stdint.h>
+#include <memory>
 #include "Updatable.h"
 #include "stringImproved.h"
 
 class MultiplayerObject;
+class GameServer;
 
 
 #define REGISTER_MULTIPLAYER_ENUM(type) \
@@ -58,54 +60,172 @@ template <typename T> struct multiplayerReplicationFunctions
         packet >> *ptr;
     }
 
+    //Vectors are replicated as a list of operations on the previously replicated contents, so only the changed elements are send.
+    //A create packet sends a single full operation.
+    //Counts and indexes are VLQ encoded uint32 values, which is the same encoding as the uint16 values of older versions for any vector that fitted in those.
+    struct VectorReplicationData
+    {
+        std::vector<T> prev_data;
+        sp::io::DataBuffer operations;
+        uint32_t operation_count = 0;
+    };
     static bool isChangedVector(void* data, void* prev_data_ptr)
     {
         std::vector<T>* ptr = (std::vector<T>*)data;
-        std::vector<T>* prev_data = *(std::vector<T>**)prev_data_ptr;
-        bool changed = false;
-        if (prev_data->size() != ptr->size())
+        VectorReplicationData* rep_data = *(VectorReplicationData**)prev_data_ptr;
+        std::vector<T>& prev_data = rep_data->prev_data;
+        sp::io::DataBuffer& operations = rep_data->operations;
+        operations.clear();
+        rep_data->operation_count = 0;
+
+        size_t common_size = std::min(prev_data.size(), ptr->size());
+        unsigned int changed_count = 0;
+        for(unsigned int n=0; n<common_size; n++)
+            if (prev_data[n] != (*ptr)[n])
+                changed_count++;
+        if (changed_count == 0 && prev_data.size() == ptr->size())
+            return false;
+
+        if (changed_count * 2 > ptr->size())
         {
-            changed = true;
+            //Most of the vector changed, sending it completely is cheaper than sending each index.
+            operations << uint8_t(VectorFull);
+            writeVectorElements(*ptr, 0, ptr->size(), operations);
+            rep_data->operation_count = 1;
         }else{
-            for(unsigned int n=0; n<ptr->size(); n++)
+            if (ptr->size() < prev_data.size())
             {
-                if ((*prev_data)[n] != (*ptr)[n])
+                operations << uint8_t(VectorTruncate) << uint32_t(ptr->size());
+                rep_data->operation_count++;
+            }
+            for(unsigned int n=0; n<common_size && changed_count > 0; n++)
+            {
+                if (prev_data[n] != (*ptr)[n])
                 {
-                    changed = true;
-                    break;
+                    operations << uint8_t(VectorSet) << uint32_t(n) << (*ptr)[n];
+                    rep_data->operation_count++;
+                    changed_count--;
                 }
             }
+            if (ptr->size() > prev_data.size())
+            {
+                operations << uint8_t(VectorAppend);
+                writeVectorElements(*ptr, prev_data.size(), ptr->size(), operations);
+                rep_data->operation_count++;
+            }
         }
-        if (changed)
-        {
-            prev_data->resize(ptr->size());
-            for(unsigned int n=0; n<ptr->size(); n++)
-               (*prev_data)[n] = (*ptr)[n];
-            return true;
-        }
-        return false;
+        prev_data = *ptr;
+        return true;
     }
     static void sendDataVector(void* data, sp::io::DataBuffer& packet)
     {
         std::vector<T>* ptr = (std::vector<T>*)data;
-        uint16_t count = ptr->size();
-        packet << count;
-        for(unsigned int n=0; n<count; n++)
-            packet << (*ptr)[n];
+        packet << uint32_t(1) << uint8_t(VectorFull);
+        writeVectorElements(*ptr, 0, ptr->size(), packet);
+    }
+    static void sendReplicatedVector(void* prev_data_ptr, sp::io::DataBuffer& packet, bool full)
+    {
+        VectorReplicationData* rep_data = *(VectorReplicationData**)prev_data_ptr;
+        if (full)
+        {
+            packet << uint32_t(1) << uint8_t(VectorFull);
+            writeVectorElements(rep_data->prev_data, 0, rep_data->prev_data.size(), packet);
+        }else{
+            packet << rep_data->operation_count;
+            packet.write(rep_data->operations);
+        }
     }
     static void receiveDataVector(void* data, sp::io::DataBuffer& packet)
     {
         std::vector<T>* ptr = (std::vector<T>*)data;
-        uint16_t count;
-        packet >> count;
-        ptr->resize(count);
-        for(unsigned int n=0; n<count; n++)
-            packet >> (*ptr)[n];
+        uint32_t operation_count = 0;
+        packet >> operation_count;
+        for(uint32_t op=0; op<operation_count; op++)
+        {
+            uint8_t type = 0;
+            uint32_t count = 0;
+            packet >> type;
+            switch(type)
+            {
+            case VectorFull:
+                packet >> count;
+                if (!checkVectorCount(count, packet))
+                    return;
+                ptr->resize(count);
+                readVectorElements(*ptr, 0, count, packet);
+                break;
+            case VectorSet:
+                {
+                    uint32_t index = 0;
+                    T value{};
+                    packet >> index >> value;
+                    if (index < ptr->size())
+                        (*ptr)[index] = value;
+                }
+                break;
+            case VectorAppend:
+                {
+                    packet >> count;
+                    if (!checkVectorCount(count, packet))
+                        return;
+                    size_t offset = ptr->size();
+                    ptr->resize(offset + count);
+                    readVectorElements(*ptr, offset, count, packet);
+                }
+                break;
+            case VectorTruncate:
+                packet >> count;
+                if (count < ptr->size())
+                    ptr->resize(count);
+                break;
+            default:
+                LOG(DEBUG) << "Odd vector operation from server replication: " << int(type);
+                return;
+            }
+        }
     }
     static void cleanupVector(void* prev_data_ptr)
     {
-        std::vector<T>* prev_data = *(std::vector<T>**)prev_data_ptr;
-        delete prev_data;
+        VectorReplicationData* rep_data = *(VectorReplicationData**)prev_data_ptr;
+        delete rep_data;
+    }
+private:
+    enum VectorOperation : uint8_t
+    {
+        VectorFull,
+        VectorSet,
+        VectorAppend,
+        VectorTruncate
+    };
+    static void writeVectorElements(const std::vector<T>& v, size_t start, size_t end, sp::io::DataBuffer& packet)
+    {
+        packet << uint32_t(end - start);
+        if constexpr (sp::io::DataBuffer::hasArraySupport<T>())
+        {
+            packet.writeArray(v.data() + start, end - start);
+        }else{
+            for(size_t n=start; n<end; n++)
+                packet << v[n];
+        }
+    }
+    //Every element takes at least a byte, so a count larger then what is left in the packet is corrupt data, do not allocate for it.
+    static bool checkVectorCount(uint32_t count, sp::io::DataBuffer& packet)
+    {
+        if (count <= packet.available())
+            return true;
+        LOG(WARNING) << "Vector replication with " << count << " elements in a packet with " << packet.available() << " bytes left, ignoring it";
+        return false;
+    }
+    static void readVectorElements(std::vector<T>& v, size_t start, size_t count, sp::io::DataBuffer& packet)
+    {
+        if constexpr (sp::io::DataBuffer::hasArraySupport<T>())
+        {
+            if (count > 0)
+                packet.readArray(v.data() + start, count);
+        }else{
+            for(size_t n=0; n<count; n++)
+                packet >> v[start + n];
+        }
     }
 };
 
@@ -132,30 +252,45 @@ class MultiplayerObject : public virtual PObject
     int32_t multiplayerObjectId;
     bool replicated;
     bool on_server;
+    P<GameServer> server;   //The server this object is registered with, null on clients.
     string multiplayerClassIdentifier;
+    uint16_t multiplayerClassId;
 
+    //Replication layout of a member, shared between all objects of the same multiplayer class.
+    //The member is located by its offset from the MultiplayerObject, so the same entry is valid for every instance.
     struct MemberReplicationInfo
     {
 #ifdef DEBUG
         const char* name;
 #endif
-        void* ptr;
-        uint64_t prev_data;
+        ptrdiff_t offset;
+        uint8_t raw_size;   //Size of plain values (numbers, enums) which are compared bytewise against prev_data, 0 if isChangedFunction is used.
         float update_delay;
-        float update_timeout;
 
         bool(*isChangedFunction)(void* data, void* prev_data_ptr);
         void(*sendFunction)(void* data, sp::io::DataBuffer& packet);
+        //Optional, for members that are send as changes against the last replicated value. Sends the changes found by the last isChangedFunction call,
+        //or with full set the complete last replicated value. Create packets need the latter, so the changes that follow apply on top of it.
+        void(*sendReplicatedFunction)(void* prev_data_ptr, sp::io::DataBuffer& packet, bool full);
         void(*receiveFunction)(void* data, sp::io::DataBuffer& packet);
         void(*cleanupFunction)(void* prev_data_ptr);
     };
-    std::vector<MemberReplicationInfo> memberReplicationInfo;
+    typedef std::vector<MemberReplicationInfo> ReplicationSchema;
+    std::shared_ptr<ReplicationSchema> replication_schema;
+    //Per instance replication state, one entry per registered member. Only the first replication_prev_data.size() schema entries apply to this object.
+    std::vector<uint64_t> replication_prev_data;
+    std::vector<float> replication_update_timeout;
+
+    class ClientPrediction;
+    std::unique_ptr<ClientPrediction> client_prediction;
 public:
     MultiplayerObject(string multiplayerClassIdentifier);
     virtual ~MultiplayerObject();
 
     bool isServer() { return on_server; }
     bool isClient() { return !on_server; }
+    //The server that replicates this object. Use it with a GameServer::ObjectScope to create related objects on the same server.
+    P<GameServer> getMultiplayerServer();
 
 #ifdef DEBUG
 #define STRINGIFY(n) #n
@@ -168,12 +303,12 @@ public:
     template <typename T> void registerMemberReplication_(F_PARAM T* member, float update_delay = 0.0f)
     {
         SDL_assert(!replicated);
-        SDL_assert(memberReplicationInfo.size() < 0xFFFF);
+        SDL_assert(replication_prev_data.size() < 0xFFFF);
         MemberReplicationInfo info;
 #ifdef DEBUG
         info.name = name;
 #endif
-        info.ptr = member;
+        info.offset = reinterpret_cast<char*>(member) - reinterpret_cast<char*>(this);
         static_assert(
                 std::is_same<T, string>::value ||
                 (
@@ -183,38 +318,35 @@ public:
                 ),
                 "T must be a string or must be a default constructible, trivially destructible and with a size of at most 64bit"
         );
-        init_prev_data<T>(info);
+        info.raw_size = (std::is_arithmetic<T>::value || std::is_enum<T>::value) ? sizeof(T) : 0;
         info.update_delay = update_delay;
-        info.update_timeout = 0.0f;
         info.isChangedFunction = &multiplayerReplicationFunctions<T>::isChanged;
         info.sendFunction = &multiplayerReplicationFunctions<T>::sendData;
+        info.sendReplicatedFunction = NULL;
         info.receiveFunction = &multiplayerReplicationFunctions<T>::receiveData;
         info.cleanupFunction = NULL;
-        memberReplicationInfo.push_back(info);
-#ifdef DEBUG
-        if (multiplayerReplicationFunctions<T>::isChanged(member, &info.prev_data))
-        {
-        }
-#endif
+        uint64_t prev_data = 0;
+        init_prev_data<T>(prev_data);
+        addMemberReplication(info, prev_data);
     }
 
     template <typename T> void registerMemberReplication_(F_PARAM std::vector<T>* member, float update_delay = 0.0f)
     {
         SDL_assert(!replicated);
-        SDL_assert(memberReplicationInfo.size() < 0xFFFF);
+        SDL_assert(replication_prev_data.size() < 0xFFFF);
         MemberReplicationInfo info;
 #ifdef DEBUG
         info.name = name;
 #endif
-        info.ptr = member;
-        info.prev_data = reinterpret_cast<std::uint64_t>(new std::vector<T>);
+        info.offset = reinterpret_cast<char*>(member) - reinterpret_cast<char*>(this);
+        info.raw_size = 0;
         info.update_delay = update_delay;
-        info.update_timeout = 0.0f;
         info.isChangedFunction = &multiplayerReplicationFunctions<T>::isChangedVector;
         info.sendFunction = &multiplayerReplicationFunctions<T>::sendDataVector;
+        info.sendReplicatedFunction = &multiplayerReplicationFunctions<T>::sendReplicatedVector;
         info.receiveFunction = &multiplayerReplicationFunctions<T>::receiveDataVector;
         info.cleanupFunction = &multiplayerReplicationFunctions<T>::cleanupVector;
-        memberReplicationInfo.push_back(info);
+        addMemberReplication(info, reinterpret_cast<std::uint64_t>(new typename multiplayerReplicationFunctions<T>::VectorReplicationData()));
     }
 
     void registerMemberReplication_(F_PARAM glm::vec3* member, float update_delay = 0.0f)
@@ -224,45 +356,111 @@ public:
         registerMemberReplication(&member->z, update_delay);
     }
 
-    void updateMemberReplicationUpdateDelay(void* data, float update_delay)
-    {
-        for(unsigned int n=0; n<memberReplicationInfo.size(); n++)
-            if (memberReplicationInfo[n].ptr == data)
-                memberReplicationInfo[n].update_delay = update_delay;
-    }
+    void updateMemberReplicationUpdateDelay(void* data, float update_delay);
 
     void forceMemberReplicationUpdate(void* data)
     {
-        for(unsigned int n=0; n<memberReplicationInfo.size(); n++)
-            if (memberReplicationInfo[n].ptr == data)
-                memberReplicationInfo[n].update_timeout = 0.0f;
+        for(unsigned int n=0; n<replication_update_timeout.size(); n++)
+            if (getMemberReplicationPtr(n) == data)
+                replication_update_timeout[n] = 0.0f;
     }
 
     void registerCollisionableReplication(float object_significant_range = -1);
+    //Opt-in client side prediction for a Collisionable that is controlled by a client. Call from the constructor after registerCollisionableReplication,
+    //so it is enabled on the server and the clients alike. Commands send with sendClientCommand are applied on the client right away trough
+    //onPredictClientCommand. Position updates from the server are corrected for the commands the server did not process yet by replaying those,
+    //and the remaining difference with what was shown is smoothed out over correction_time seconds.
+    void enableClientPrediction(float correction_time = 0.1f);
 
     int32_t getMultiplayerId() { return multiplayerObjectId; }
     const string& getMultiplayerClassIdentifier() { return multiplayerClassIdentifier; }
-    void sendClientCommand(sp::io::DataBuffer& packet);//Send a command from the client to the server.
+    void sendClientCommand(sp::io::DataBuffer& packet, bool flush_now = false);//Send a command from the client to the server. Commands are batched till the next client update, unless flush_now is set.
     void broadcastServerCommand(sp::io::DataBuffer& packet);//Send a command from the server to all clients.
 
     virtual void onReceiveClientCommand(int32_t client_id, sp::io::DataBuffer& packet) {} //Got data from a client, handle it.
     virtual void onReceiveServerCommand(sp::io::DataBuffer& packet) {} //Got data from a server, handle it.
+    virtual void onPredictClientCommand(sp::io::DataBuffer& packet) {} //Apply the expected result of a command on the client, with client prediction enabled. Should match onReceiveClientCommand.
 private:
     friend class GameServer;
     friend class GameClient;
+    friend class GameServerProxy;
+    friend class MultiplayerLockstep;
+
+    void addMemberReplication(const MemberReplicationInfo& info, uint64_t prev_data);
+    void receivePredictedMemberReplication(unsigned int index, sp::io::DataBuffer& packet);
+    void acknowledgeClientPrediction(uint32_t sequence);
+    void updateClientPrediction(float delta);
+    void detachReplicationSchema(size_t keep_count);
+
+    unsigned int getMemberReplicationCount() const { return static_cast<unsigned int>(replication_prev_data.size()); }
+    void* getMemberReplicationPtr(unsigned int index) { return reinterpret_cast<char*>(this) + (*replication_schema)[index].offset; }
+
+    bool isMemberReplicationChanged(unsigned int index)
+    {
+        const MemberReplicationInfo& info = (*replication_schema)[index];
+        void* ptr = reinterpret_cast<char*>(this) + info.offset;
+        if (info.raw_size)
+        {
+            uint64_t value = 0;
+            memcpy(&value, ptr, info.raw_size);
+            if (value == replication_prev_data[index])
+                return false;
+            replication_prev_data[index] = value;
+            return true;
+        }
+        return info.isChangedFunction(ptr, &replication_prev_data[index]);
+    }
+
+    //Send the full value of the member, as needed for create packets.
+    void sendMemberReplication(unsigned int index, sp::io::DataBuffer& packet)
+    {
+        const MemberReplicationInfo& info = (*replication_schema)[index];
+        if (info.sendReplicatedFunction)
+            info.sendReplicatedFunction(&replication_prev_data[index], packet, true);
+        else
+            info.sendFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+    }
+
+    //Send the member after isMemberReplicationChanged returned true, this can be a delta against what was send before.
+    void sendMemberReplicationUpdate(unsigned int index, sp::io::DataBuffer& packet)
+    {
+        const MemberReplicationInfo& info = (*replication_schema)[index];
+        if (info.sendReplicatedFunction)
+            info.sendReplicatedFunction(&replication_prev_data[index], packet, false);
+        else
+            info.sendFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+    }
+
+    void receiveMemberReplication(unsigned int index, sp::io::DataBuffer& packet)
+    {
+        if (client_prediction)
+        {
+            receivePredictedMemberReplication(index, packet);
+            return;
+        }
+        const MemberReplicationInfo& info = (*replication_schema)[index];
+        info.receiveFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+    }
+
+    //Store a received value as-is, without client prediction, for mirrors that only hold replicated state.
+    void receiveMirroredMemberReplication(unsigned int index, sp::io::DataBuffer& packet)
+    {
+        const MemberReplicationInfo& info = (*replication_schema)[index];
+        info.receiveFunction(reinterpret_cast<char*>(this) + info.offset, packet);
+    }
 
     template <typename T>
     static inline
     typename std::enable_if<!std::is_same<T, string>::value>::type
-    init_prev_data(MemberReplicationInfo& info) {
-        new (&info.prev_data) T{};
+    init_prev_data(uint64_t& prev_data) {
+        new (&prev_data) T{};
     }
 
     template <typename T>
     static inline
     typename std::enable_if<std::is_same<T, string>::value>::type
-    init_prev_data(MemberReplicationInfo& info) {
-        info.prev_data = 0;
+    init_prev_data(uint64_t& prev_data) {
+        prev_data = 0;
     }
 };
 
@@ -274,6 +472,8 @@ extern MultiplayerClassListItem* multiplayerClassListStart;
 class MultiplayerClassListItem
 {
 public:
+    constexpr static uint16_t noClassId = 0xFFFF;
+
     string name;
     CreateMultiplayerObjectFunction func;
     MultiplayerClassListItem* next;
@@ -285,6 +485,11 @@ public:
         this->next = multiplayerClassListStart;
         multiplayerClassListStart = this;
     }
+
+    //All registered classes, indexed by the numeric class id which is used on the network instead of the class name.
+    //Only valid after static initialization is done, as that is when all classes are registered.
+    static const std::vector<MultiplayerClassListItem*>& getClassTable();
+    static uint16_t getClassId(const string& name);
 };
 
 template<class T> MultiplayerObject* createMultiplayerObject()
@@ -27,6 +27,25 @@ GameClient::GameClient(int version_number, sp::io::network::Address server, int
     socket = std::move(sock);
 }
 
+GameClient::GameClient(int version_number, const string& hostname, int port_nr)
+: version_number(version_number), port_nr(port_nr)
+{
+    SDL_assert(!game_server);
+    SDL_assert(!game_client);
+
+    client_id = -1;
+    game_client = this;
+    status = Connecting;
+
+    no_data_timeout.start(no_data_disconnect_time);
+    //The socket resolves the hostname in the background and tries each of its addresses, it reports Connecting meanwhile.
+    LOG(INFO) << "GameClient: Connecting to " << hostname;
+    auto sock = std::make_unique<sp::io::network::TcpSocket>();
+    sock->setBlocking(false);
+    sock->connect(hostname, port_nr);
+    socket = std::move(sock);
+}
+
 #ifdef STEAMSDK
 GameClient::GameClient(int version_number, uint64_t steam_id)
 {
@@ -44,18 +63,35 @@ GameClient::GameClient(int version_number, uint64_t steam_id)
 }
 #endif
 
+GameClient::GameClient(int version_number, std::unique_ptr<sp::io::network::StreamSocket> socket)
+: version_number(version_number), port_nr(0), socket(std::move(socket))
+{
+    SDL_assert(!game_server);
+    SDL_assert(!game_client);
+
+    client_id = -1;
+    game_client = this;
+    status = Connecting;
+
+    no_data_timeout.start(no_data_disconnect_time);
+}
+
 GameClient::~GameClient()
 {
 }
 
+bool GameClient::isResolvingServer() const
+{
+    auto tcp_socket = dynamic_cast<sp::io::network::TcpSocket*>(socket.get());
+    return tcp_socket && tcp_socket->isResolving();
+}
+
 P<MultiplayerObject> GameClient::getObjectById(int32_t id)
 {
-    if (objectMap.find(id) != objectMap.end())
-        return objectMap[id];
-    return NULL;
+    return objects.get(id);
 }
 
-void GameClient::update(float /*delta*/)
+void GameClient::update(float delta)
 {
     if (status == Disconnected)
         return;
@@ -71,6 +107,8 @@ void GameClient::update(float /*delta*/)
         case sp::io::network::StreamSocket::State::Connecting:
             break;
         case sp::io::network::StreamSocket::State::Connected:
+            if (auto tcp_socket = dynamic_cast<sp::io::network::TcpSocket*>(socket.get()))
+                server = tcp_socket->getRemoteAddress();
             LOG(INFO) << "GameClient: Connected, waiting for authentication";
             status = Authenticating;
             break;
@@ -78,17 +116,6 @@ void GameClient::update(float /*delta*/)
         return;
     }
 
-    std::vector<int32_t> delList;
-    for(std::unordered_map<int32_t, P<MultiplayerObject> >::iterator i=objectMap.begin(); i != objectMap.end(); i++)
-    {
-        int id = i->first;
-        P<MultiplayerObject> obj = i->second;
-        if (!obj)
-            delList.push_back(id);
-    }
-    for(unsigned int n=0; n<delList.size(); n++)
-        objectMap.erase(delList[n]);
-
     sp::io::DataBuffer reply;
     sp::io::DataBuffer packet;
     while(socket->receive(packet))
@@ -108,7 +135,9 @@ void GameClient::update(float /*delta*/)
                 {
                     int32_t server_version;
                     bool require_password;
-                    packet >> server_version >> require_password;
+                    bool server_compression = false;
+                    packet >> server_version >> require_password >> server_compression;
+                    compression = server_compression && accept_compression;
 
                     if (server_version != 0 && server_version != version_number)
                     {
@@ -120,7 +149,7 @@ void GameClient::update(float /*delta*/)
                     if (!require_password)
                     {
                         reply.clear();
-                        reply << CMD_CLIENT_SEND_AUTH << int32_t(version_number) << string("");
+                        reply << CMD_CLIENT_SEND_AUTH << int32_t(version_number) << string("") << compression;
                         socket->send(reply);
                     }else{
                         status = WaitingForPassword;
@@ -129,6 +158,9 @@ void GameClient::update(float /*delta*/)
                 break;
             case CMD_SET_CLIENT_ID:
                 packet >> client_id;
+                //Everything the server sends after this is compressed.
+                if (compression)
+                    socket->setReceiveCompression(true);
                 status = Connected;
                 disconnect_reason = DisconnectReason::None;
                 break;
@@ -145,42 +177,86 @@ void GameClient::update(float /*delta*/)
         case Connected:
             switch(command)
             {
+            case CMD_SET_CLASS_TABLE:
+                {
+                    uint16_t count;
+                    packet >> count;
+                    class_table.clear();
+                    class_table.resize(count, nullptr);
+                    for(unsigned int n=0; n<count; n++)
+                    {
+                        string name;
+                        packet >> name;
+                        for(MultiplayerClassListItem* i = multiplayerClassListStart; i; i = i->next)
+                            if (i->name == name)
+                                class_table[n] = i;
+                        if (!class_table[n])
+                            LOG(WARNING) << "Server knows multiplayer class " << name << " which we do not know";
+                    }
+                }
+                break;
             case CMD_CREATE:
                 {
                     int32_t id;
-                    string name;
-                    packet >> id >> name;
-                    if (objectMap.find(id) == objectMap.end() || !objectMap[id])
+                    uint16_t class_id;
+                    packet >> id >> class_id;
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (!obj && !objects.canSet(id))
                     {
-                        for(MultiplayerClassListItem* i = multiplayerClassListStart; i; i = i->next)
+                        LOG(WARNING) << "Ignoring create for object id " << id << ", far beyond the known objects";
+                    }
+                    else if (!obj && class_id < class_table.size() && class_table[class_id])
+                    {
+                        MultiplayerClassListItem* item = class_table[class_id];
+                        LOG(INFO) << "Created " << item->name << " from server replication";
+                        obj = item->func();
+                        obj->multiplayerObjectId = id;
+                        objects.set(id, obj);
+                        if (obj->client_prediction)
+                            predicted_objects.push_back(obj);
+                    }
+                    //An object we already know gets a create again after a resync, then we just take over the values.
+                    if (obj)
+                    {
+                        while(packet.available())
                         {
-                            if (i->name == name)
-                            {
-                                LOG(INFO) << "Created " << name << " from server replication";
-                                MultiplayerObject* obj = i->func();
-                                obj->multiplayerObjectId = id;
-                                objectMap[id] = obj;
-
-                                while(packet.available())
-                                {
-                                    int16_t idx;
-                                    packet >> idx;
-                                    if (idx >= 0 && idx < int16_t(obj->memberReplicationInfo.size()))
-                                        (obj->memberReplicationInfo[idx].receiveFunction)(obj->memberReplicationInfo[idx].ptr, packet);
-                                    else
-                                        LOG(DEBUG) << "Odd index from server replication: " << idx;
-                                }
-                            }
+                            int16_t idx;
+                            packet >> idx;
+                            if (idx >= 0 && idx < int32_t(obj->getMemberReplicationCount()))
+                                obj->receiveMemberReplication(idx, packet);
+                            else
+                                LOG(DEBUG) << "Odd index from server replication: " << idx;
                         }
                     }
                 }
                 break;
+            case CMD_RESYNC:
+                {
+                    uint32_t count;
+                    packet >> count;
+                    std::unordered_set<int32_t> alive;
+                    for(uint32_t n=0; n<count && packet.available(); n++)
+                    {
+                        int32_t id;
+                        packet >> id;
+                        alive.insert(id);
+                    }
+                    //The delete packets for these objects might have been dropped by the server.
+                    objects.forEach([&alive](int32_t id, P<MultiplayerObject>& obj)
+                    {
+                        if (obj && alive.find(id) == alive.end())
+                            obj->destroy();
+                    });
+                    LOG(INFO) << "Resync from server, " << count << " objects";
+                }
+                break;
             case CMD_DELETE:
                 {
                     int32_t id;
                     packet >> id;
-                    if (objectMap.find(id) != objectMap.end() && objectMap[id])
-                        objectMap[id]->destroy();
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj)
+                        obj->destroy();
                 }
                 break;
             case CMD_UPDATE_VALUE:
@@ -188,18 +264,29 @@ void GameClient::update(float /*delta*/)
                     int32_t id;
                     int16_t idx;
                     packet >> id;
-                    if (objectMap.find(id) != objectMap.end() && objectMap[id])
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj)
                     {
-                        P<MultiplayerObject> obj = objectMap[id];
                         while(packet.available())
                         {
                             packet >> idx;
-                            if (idx < int32_t(obj->memberReplicationInfo.size()))
-                                (obj->memberReplicationInfo[idx].receiveFunction)(obj->memberReplicationInfo[idx].ptr, packet);
+                            if (idx >= 0 && idx < int32_t(obj->getMemberReplicationCount()))
+                                obj->receiveMemberReplication(idx, packet);
                         }
                     }
                 }
                 break;
+            case CMD_PREDICTION_ACK:
+                while(packet.available())
+                {
+                    int32_t id;
+                    uint32_t sequence;
+                    packet >> id >> sequence;
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj && obj->client_prediction)
+                        obj->acknowledgeClientPrediction(sequence);
+                }
+                break;
             case CMD_SET_GAME_SPEED:
                 {
                     float gamespeed;
@@ -211,11 +298,9 @@ void GameClient::update(float /*delta*/)
                 {
                     int32_t id;
                     packet >> id;
-                    if (objectMap.find(id) != objectMap.end() && objectMap[id])
-                    {
-                        P<MultiplayerObject> obj = objectMap[id];
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj)
                         obj->onReceiveServerCommand(packet);
-                    }
                 }
                 break;
             case CMD_AUDIO_COMM_START:
@@ -228,11 +313,14 @@ void GameClient::update(float /*delta*/)
             case CMD_AUDIO_COMM_DATA:
                 {
                     int32_t id = 0;
-                    packet >> id;
-                    const unsigned char* ptr = reinterpret_cast<const unsigned char*>(packet.getData());
-                    ptr += sizeof(command_t) + sizeof(int32_t);
-                    int32_t size = static_cast<int>(packet.getDataSize()) - sizeof(command_t) - sizeof(int32_t);
-                    audio_stream_manager.receivedPacketFromNetwork(id, ptr, size);
+                    uint16_t sequence = 0;
+                    uint8_t flags = 0;
+                    packet >> id >> sequence >> flags;
+                    //The rest of the packet is the encoded audio.
+                    const unsigned char* ptr = static_cast<const unsigned char*>(packet.getReadData());
+                    int size = static_cast<int>(packet.available());
+                    if (size > 0)
+                        audio_stream_manager.receivedPacketFromNetwork(id, sequence, flags, ptr, size);
                 }
                 break;
             case CMD_AUDIO_COMM_STOP:
@@ -256,6 +344,11 @@ void GameClient::update(float /*delta*/)
         }
     }
 
+    flushClientCommands();
+
+    foreach(MultiplayerObject, obj, predicted_objects)
+        obj->updateClientPrediction(delta);
+
     if (socket->getState() == sp::io::network::StreamSocket::State::Closed || no_data_timeout.isExpired())
     {
         if (disconnect_reason == DisconnectReason::None)
@@ -270,6 +363,22 @@ void GameClient::sendPacket(sp::io::DataBuffer& packet)
     socket->send(packet);
 }
 
+void GameClient::queueClientCommand(int32_t object_id, const sp::io::DataBuffer& packet)
+{
+    if (client_command_batch.getDataSize() == 0)
+        client_command_batch << CMD_CLIENT_COMMAND;
+    client_command_batch << object_id << uint32_t(packet.getDataSize());
+    client_command_batch.write(packet);
+}
+
+void GameClient::flushClientCommands()
+{
+    if (client_command_batch.getDataSize() == 0)
+        return;
+    socket->send(client_command_batch);
+    client_command_batch.clear();
+}
+
 void GameClient::sendPassword(string password)
 {
     if (status != WaitingForPassword)
@@ -277,7 +386,7 @@ void GameClient::sendPassword(string password)
 
     disconnect_reason = DisconnectReason::BadCredentials;
     sp::io::DataBuffer reply;
-    reply << CMD_CLIENT_SEND_AUTH << int32_t(version_number) << password;
+    reply << CMD_CLIENT_SEND_AUTH << int32_t(version_number) << password << compression;
     socket->send(reply);
     
     status = Authenticating;
@@ -13,6 +13,7 @@
 
 class GameClient;
 class MultiplayerObject;
+class MultiplayerClassListItem;
 
 extern P<GameClient> game_client;
 
@@ -45,18 +46,27 @@ private:
     int port_nr;
 
     std::unique_ptr<sp::io::network::StreamSocket> socket;
-    std::unordered_map<int32_t, P<MultiplayerObject> > objectMap;
+    MultiplayerObjectTable<MultiplayerObject> objects;
+    PVector<MultiplayerObject> predicted_objects;
+    std::vector<MultiplayerClassListItem*> class_table; //Server class id to our local class, send by the server on connect.
     int32_t client_id;
     Status status;
     sp::SystemTimer no_data_timeout;
     NetworkAudioStreamManager audio_stream_manager;
 
     DisconnectReason disconnect_reason{ DisconnectReason::Unknown };
+    sp::io::DataBuffer client_command_batch;
+    bool accept_compression = true;
+    bool compression = false;   //The server offered compression and we accepted, so it starts after the client id.
 public:
     GameClient(int version_number, sp::io::network::Address server, int port_nr = defaultServerPort);
+    //Resolve the hostname in the background first through TcpSocket::connect, the status stays Connecting meanwhile, so the frames keep going.
+    GameClient(int version_number, const string& hostname, int port_nr = defaultServerPort);
 #ifdef STEAMSDK
     GameClient(int version_number, uint64_t steam_id);
 #endif
+    //Use an already created connection, for example a MultiplayerReplaySocket.
+    GameClient(int version_number, std::unique_ptr<sp::io::network::StreamSocket> socket);
     virtual ~GameClient();
 
     P<MultiplayerObject> getObjectById(int32_t id);
@@ -65,10 +75,25 @@ public:
     int32_t getClientId() { return client_id; }
     Status getStatus() { return status; }
     DisconnectReason getDisconnectReason() const { return disconnect_reason; }
+    //While connecting: true as long as the server hostname is not resolved yet.
+    bool isResolvingServer() const;
+    //The address we are connected to, for a hostname only known once connected.
+    const sp::io::network::Address& getServerAddress() const { return server; }
 
     void sendPacket(sp::io::DataBuffer& packet);
+    void queueClientCommand(int32_t object_id, const sp::io::DataBuffer& packet);
+    void flushClientCommands();
 
     void sendPassword(string password);
+
+    //Voice level of another client while it talks to us, from 0.0 to 1.0, see NetworkAudioStream::getLevel.
+    float getVoiceLevel(int32_t client_id) { return audio_stream_manager.getLevel(client_id); }
+    //Jitter buffer statistics of the voice of another client.
+    NetworkAudioStream::Stats getVoiceStats(int32_t client_id) { return audio_stream_manager.getStats(client_id); }
+
+    //Accept compression of the server traffic when the server offers it. Only has effect before connecting.
+    void setAcceptCompression(bool accept) { accept_compression = accept; }
+    sp::io::StreamCompression::Stats getCompressionStats() { return socket->getReceiveCompressionStats(); }
 };
 
 #endif//MULTIPLAYER_CLIENT_H
@@ -0,0 +1,205 @@
+#include "multiplayer_lockstep.h"
+#include "logging.h"
+
+
+MultiplayerLockstep::MultiplayerLockstep(string multiplayer_class_identifier)
+: MultiplayerObject(multiplayer_class_identifier)
+{
+}
+
+void MultiplayerLockstep::start(uint32_t seed, float tick_interval, uint32_t checksum_interval)
+{
+    SDL_assert(isServer());
+    if (running || start_pending)
+        return;
+    this->seed = seed;
+    this->tick_interval = tick_interval;
+    this->checksum_interval = checksum_interval;
+    //The start is broadcast from update, once the clients know this object.
+    start_pending = true;
+}
+
+void MultiplayerLockstep::sendInput(sp::io::DataBuffer& input)
+{
+    sp::io::DataBuffer packet;
+    packet << uint8_t(Command::Input);
+    packet.appendRaw(input.getData(), input.getDataSize());
+    sendClientCommand(packet);
+}
+
+uint32_t MultiplayerLockstep::random()
+{
+    //xorshift64*, only depends on the seed and the amount of numbers taken, so it is the same on every peer.
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return uint32_t((random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+float MultiplayerLockstep::random(float fmin, float fmax)
+{
+    return fmin + float(random() >> 8) / float(1 << 24) * (fmax - fmin);
+}
+
+uint32_t MultiplayerLockstep::checksum(uint32_t checksum, const void* data, size_t size)
+{
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    for(size_t n=0; n<size; n++)
+    {
+        checksum ^= ptr[n];
+        checksum *= 16777619u;
+    }
+    return checksum;
+}
+
+void MultiplayerLockstep::update(float delta)
+{
+    if (!isServer())
+    {
+        while(!received_ticks.empty())
+        {
+            runTick(received_ticks.front());
+            received_ticks.pop_front();
+        }
+        return;
+    }
+
+    if (start_pending && replicated)
+    {
+        start_pending = false;
+        sp::io::DataBuffer packet;
+        packet << uint8_t(Command::Start) << seed << tick_interval << checksum_interval;
+        broadcastServerCommand(packet);
+    }
+    if (!running)
+        return;
+
+    tick_delay += delta;
+    for(int n=0; n<max_ticks_per_update && tick_delay >= tick_interval; n++)
+    {
+        tick_delay -= tick_interval;
+        sp::io::DataBuffer packet;
+        packet << uint8_t(Command::Tick) << uint32_t(tick + 1) << uint16_t(pending_inputs.size());
+        for(auto& input : pending_inputs)
+        {
+            packet << input.client_id << uint32_t(input.data.getDataSize());
+            packet.appendRaw(input.data.getData(), input.data.getDataSize());
+        }
+        pending_inputs.clear();
+        //Also runs the tick on the server itself.
+        broadcastServerCommand(packet);
+    }
+    //When we cannot keep up, slow down the simulation instead of building up a backlog.
+    if (tick_delay > tick_interval)
+        tick_delay = tick_interval;
+}
+
+void MultiplayerLockstep::onReceiveClientCommand(int32_t client_id, sp::io::DataBuffer& packet)
+{
+    uint8_t command = 0;
+    packet >> command;
+    switch(Command(command))
+    {
+    case Command::Input:
+        {
+            Input input;
+            input.client_id = client_id;
+            input.data.appendRaw(packet.getReadData(), packet.available());
+            pending_inputs.push_back(std::move(input));
+        }
+        break;
+    case Command::Checksum:
+        {
+            uint32_t client_tick = 0;
+            uint32_t client_checksum = 0;
+            packet >> client_tick >> client_checksum;
+            auto it = checksums.find(client_tick);
+            if (it != checksums.end() && it->second != client_checksum)
+            {
+                LOG(WARNING) << "Lockstep desync of client " << client_id << " at tick " << client_tick;
+                onLockstepDesync(client_id, client_tick);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void MultiplayerLockstep::onReceiveServerCommand(sp::io::DataBuffer& packet)
+{
+    uint8_t command = 0;
+    packet >> command;
+    switch(Command(command))
+    {
+    case Command::Start:
+        packet >> seed >> tick_interval >> checksum_interval;
+        //Spread the seed over all bits, so similar seeds give unrelated sequences. The state may never be zero.
+        random_state = (uint64_t(seed) + 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL;
+        if (random_state == 0)
+            random_state = 1;
+        tick = 0;
+        running = true;
+        break;
+    case Command::Tick:
+        if (isServer())
+        {
+            runTick(packet);
+        }else{
+            sp::io::DataBuffer copy;
+            copy.appendRaw(packet.getReadData(), packet.available());
+            received_ticks.push_back(std::move(copy));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void MultiplayerLockstep::runTick(sp::io::DataBuffer& packet)
+{
+    uint32_t new_tick = 0;
+    uint16_t count = 0;
+    packet >> new_tick >> count;
+    if (!running)
+    {
+        if (new_tick == 1)
+            LOG(WARNING) << "Lockstep tick received before the start";
+        return;
+    }
+    if (new_tick != tick + 1)
+    {
+        LOG(ERROR) << "Lockstep tick " << new_tick << " received after tick " << tick << ", simulation stopped";
+        running = false;
+        return;
+    }
+
+    tick_inputs.clear();
+    for(unsigned int n=0; n<count; n++)
+    {
+        Input input;
+        uint32_t size = 0;
+        packet >> input.client_id >> size;
+        if (size > packet.available())
+            break;
+        input.data.appendRaw(packet.getReadData(), size);
+        packet.skip(size);
+        tick_inputs.push_back(std::move(input));
+    }
+    tick = new_tick;
+    onLockstepTick(tick, tick_interval, tick_inputs);
+
+    if (checksum_interval > 0 && tick % checksum_interval == 0)
+    {
+        uint32_t state_checksum = getLockstepChecksum();
+        if (isServer())
+        {
+            checksums[tick] = state_checksum;
+            checksums.erase(tick - checksum_interval * checksum_history_size);
+        }else{
+            sp::io::DataBuffer reply;
+            reply << uint8_t(Command::Checksum) << tick << state_checksum;
+            sendClientCommand(reply);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef MULTIPLAYER_LOCKSTEP_H
+#define MULTIPLAYER_LOCKSTEP_H
+
+#include "multiplayer.h"
+#include "Updatable.h"
+
+#include <stdint.h>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/**
+    Deterministic lockstep simulation, as alternative to replicating objects.
+
+    Every peer runs the same simulation in fixed steps. Only the inputs are exchanged: the server collects the inputs of all
+    clients and broadcasts them per tick, after which the server and all clients run that tick with exactly the same inputs.
+    The network traffic depends on the amount of players and their inputs, not on the amount of simulated objects.
+    The objects in the simulation are plain local objects, not MultiplayerObjects.
+
+    The simulation has to be fully deterministic: it may only depend on the inputs, the tick delta and the random numbers from
+    this object. Clients send a checksum of their state every few ticks, the server compares it with its own to detect desyncs.
+
+    Subclass this, register it with REGISTER_MULTIPLAYER_CLASS and create it on the server. Call start() when all players
+    are connected, clients that connect after the start cannot join the simulation.
+ */
+class MultiplayerLockstep : public MultiplayerObject, public Updatable
+{
+public:
+    struct Input
+    {
+        int32_t client_id;
+        sp::io::DataBuffer data;
+    };
+
+    MultiplayerLockstep(string multiplayer_class_identifier);
+
+    //Server only. Start the simulation, all peers seed their random generator with the given seed.
+    void start(uint32_t seed, float tick_interval = 0.1f, uint32_t checksum_interval = 10);
+    bool isRunning() { return running; }
+    uint32_t getTick() { return tick; }
+    float getTickInterval() { return tick_interval; }
+
+    //Send input to the simulation. It is applied on all peers in the first tick that the server runs after receiving it.
+    void sendInput(sp::io::DataBuffer& input);
+
+    //Deterministic random numbers, only to be used from onLockstepTick.
+    uint32_t random();
+    float random(float fmin, float fmax);
+    //Helper to build checksums, FNV-1a hash of the data on top of the given checksum.
+    static uint32_t checksum(uint32_t checksum, const void* data, size_t size);
+
+    virtual void update(float delta) override;
+    virtual void onReceiveClientCommand(int32_t client_id, sp::io::DataBuffer& packet) override;
+    virtual void onReceiveServerCommand(sp::io::DataBuffer& packet) override;
+
+protected:
+    //Run a single step of the simulation.
+    virtual void onLockstepTick(uint32_t tick, float delta, std::vector<Input>& inputs) = 0;
+    //Checksum of the complete simulation state after the last tick.
+    virtual uint32_t getLockstepChecksum() { return 0; }
+    //Server only, called when a client reports a different checksum for a tick than the server calculated.
+    virtual void onLockstepDesync(int32_t client_id, uint32_t tick) {}
+
+private:
+    enum class Command : uint8_t
+    {
+        Start,      //uint32_t seed, float tick_interval, uint32_t checksum_interval
+        Tick,       //uint32_t tick, uint16_t count, count times: int32_t client_id, uint32_t size, size bytes of input
+        Input,      //Client to server, the input data
+        Checksum,   //Client to server, uint32_t tick, uint32_t checksum
+    };
+    static constexpr int max_ticks_per_update = 10;
+    static constexpr size_t checksum_history_size = 1024;
+
+    void runTick(sp::io::DataBuffer& packet);
+
+    bool start_pending = false;
+    bool running = false;
+    uint32_t seed = 0;
+    float tick_interval = 0.1f;
+    uint32_t checksum_interval = 10;
+    uint32_t tick = 0;
+    uint64_t random_state = 0;
+    float tick_delay = 0.0f;
+    std::vector<Input> pending_inputs;  //Server, inputs for the next tick.
+    std::deque<sp::io::DataBuffer> received_ticks;  //Client, ticks that still need to run.
+    std::unordered_map<uint32_t, uint32_t> checksums;   //Server, own checksum per recent tick.
+    std::vector<Input> tick_inputs;
+};
+
+#endif//MULTIPLAYER_LOCKSTEP_H
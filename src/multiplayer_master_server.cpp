@@ -0,0 +1,289 @@
+#include "multiplayer_master_server.h"
+#include "multiplayer_server.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <ctime>
+#include <unordered_set>
+
+
+MasterServer::MasterServer(int port_nr)
+{
+    //Start the list versions at the time, so the versions a client got from an earlier run are too old to be mistaken for recent ones.
+    list_version = uint32_t(time(nullptr));
+    http_server = new sp::io::http::Server(port_nr);
+    http_server->addURLHandler("/register.php", [this](const sp::io::http::Server::Request& request) { return handleRegister(request); });
+    http_server->addURLHandler("/list.php", [this](const sp::io::http::Server::Request& request) { return handleList(request); });
+
+    if (!udp_socket.bind(port_nr))
+        LOG(Warning, "Failed to listen for master server queries on UDP port: ", port_nr);
+    udp_socket.setBlocking(false);
+    LOG(Info, "Master server running on port: ", port_nr);
+}
+
+MasterServer::~MasterServer()
+{
+    if (http_server)
+        http_server->destroy();
+}
+
+void MasterServer::update(float delta)
+{
+    expireServers();
+    updateConnectChecks();
+    handleUdpQueries();
+}
+
+string MasterServer::handleRegister(const sp::io::http::Server::Request& request)
+{
+    auto port_it = request.post_query.find("port");
+    auto name_it = request.post_query.find("name");
+    auto version_it = request.post_query.find("version");
+    if (port_it == request.post_query.end())
+        return "'port' not set";
+    if (name_it == request.post_query.end())
+        return "'name' not set";
+    if (version_it == request.post_query.end())
+        return "'version' not set";
+
+    string ip = request.remote_address;
+    //The listener accepts IPv4 connections on an IPv6 socket, those show up as mapped addresses.
+    if (ip.startswith("::ffff:") && ip.find(".") > -1)
+        ip = ip.substr(7);
+    if (ip.empty())
+        return "No address";
+    int port = port_it->second.toInt();
+    int version = version_it->second.toInt();
+    //Names end up in a line based list, so they can not contain line breaks.
+    string name = name_it->second.replace("\r", " ").replace("\n", " ");
+
+    string key = ip + ":" + string(port);
+    auto it = servers.find(key);
+    bool is_new = it == servers.end();
+    Entry& entry = servers[key];
+    if (is_new)
+    {
+        entry.ip = ip;
+        entry.port = port;
+        entry.version = version;
+        entry.name = name;
+    }
+    else if (entry.version != version)
+    {
+        //Like a new server, check again if it can be reached.
+        setListed(entry, key, false);
+        entry.check_failed = false;
+        entry.version = version;
+        entry.name = name;
+    }
+    else if (entry.name != name)
+    {
+        entry.name = name;
+        if (entry.listed)
+            addChange(key);
+    }
+    entry.expire_time = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(server_timeout));
+    expire_queue.emplace(entry.expire_time, key);
+
+    if (entry.listed)
+        return "OK";
+    bool failed = entry.check_failed;
+    if (!entry.check_pending)
+        startConnectCheck(key);
+    if (failed)
+        return "CONNECT FAILED: " + key;
+    return "OK";
+}
+
+string MasterServer::handleList(const sp::io::http::Server::Request& request)
+{
+    auto since_it = request.query.find("since");
+    if (since_it == request.query.end())
+    {
+        if (list_response_version != list_version)
+        {
+            list_response.clear();
+            for(auto& it : servers)
+                if (it.second.listed)
+                    list_response += formatEntry(it.second) + "\n";
+            list_response_version = list_version;
+        }
+        return list_response;
+    }
+
+    uint32_t since = since_it->second.toInt();
+    string result = "#" + string(int(list_version));
+    if (since == list_version)
+        return result + "\n";
+    //The log only goes back so far, send everything when the asked version is before that, or from an other run.
+    if (since > list_version || change_log.empty() || since + 1 < change_log.front().version)
+    {
+        result += " full\n";
+        for(auto& it : servers)
+            if (it.second.listed)
+                result += "+" + formatEntry(it.second) + "\n";
+        return result;
+    }
+    result += "\n";
+    //A server can change more then once, only its state now matters.
+    std::unordered_set<string> changed;
+    auto start = std::lower_bound(change_log.begin(), change_log.end(), since + 1, [](const Change& change, uint32_t version) { return change.version < version; });
+    for(auto it = start; it != change_log.end(); ++it)
+        changed.insert(it->key);
+    for(auto& key : changed)
+    {
+        auto server = servers.find(key);
+        if (server != servers.end() && server->second.listed)
+            result += "+" + formatEntry(server->second) + "\n";
+        else
+            result += "-" + key + "\n";
+    }
+    return result;
+}
+
+void MasterServer::handleUdpQueries()
+{
+    sp::io::network::Address address;
+    int port;
+    sp::io::DataBuffer packet;
+    while(udp_socket.receive(packet, address, port))
+    {
+        if (packet.getDataSize() < udp_min_query_size)
+            continue;
+        int32_t verification = 0;
+        string query;
+        int32_t version = 0;
+        uint32_t index = 0;
+        packet >> verification >> query >> version >> index;
+        if (verification != multiplayerVerficationNumber || query != "MasterServerQuery")
+            continue;
+
+        if (udp_items_version != list_version)
+        {
+            udp_items.clear();
+            for(auto& it : servers)
+            {
+                if (!it.second.listed)
+                    continue;
+                const Entry& entry = it.second;
+                udp_items.push_back({entry.version, {}});
+                udp_items.back().data << entry.ip << int32_t(entry.port) << int32_t(entry.version) << entry.name.substr(0, udp_max_name_length);
+            }
+            udp_items_version = list_version;
+        }
+
+        //Leave room for the header, the item size limit makes sure at least one server always fits.
+        size_t reply_limit = std::min(size_t(packet.getDataSize()), udp_max_reply_size) - 32;
+        sp::io::DataBuffer body;
+        uint32_t total = 0;
+        uint32_t count = 0;
+        for(auto& item : udp_items)
+        {
+            if (version != 0 && item.version != version && item.version != 0)
+                continue;
+            if (total++ < index)
+                continue;
+            if (count == total - 1 - index && body.getDataSize() + item.data.getDataSize() <= reply_limit)
+            {
+                body.appendRaw(item.data.getData(), item.data.getDataSize());
+                count++;
+            }
+        }
+        if (index > total)
+            index = total;
+        sp::io::DataBuffer reply;
+        reply << int32_t(multiplayerVerficationNumber) << list_version << total << index << count;
+        reply.appendRaw(body.getData(), body.getDataSize());
+        udp_socket.send(reply, address, port);
+    }
+}
+
+void MasterServer::startConnectCheck(const string& key)
+{
+    Entry& entry = servers[key];
+    entry.check_pending = true;
+    if (connect_checks.size() >= max_connect_checks)
+    {
+        connect_check_queue.push_back(key);
+        return;
+    }
+    connect_checks.emplace_back();
+    ConnectCheck& check = connect_checks.back();
+    check.key = key;
+    check.timeout = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(connect_check_timeout));
+    check.socket = std::make_unique<sp::io::network::TcpSocket>();
+    check.socket->setBlocking(false);
+    check.socket->connect(sp::io::network::Address(entry.ip), entry.port);
+}
+
+void MasterServer::updateConnectChecks()
+{
+    auto now = Clock::now();
+    for(auto it = connect_checks.begin(); it != connect_checks.end(); )
+    {
+        auto state = it->socket->getState();
+        if (state == sp::io::network::StreamSocket::State::Connecting && now < it->timeout)
+        {
+            ++it;
+            continue;
+        }
+        auto server = servers.find(it->key);
+        if (server != servers.end())
+        {
+            server->second.check_pending = false;
+            server->second.check_failed = state != sp::io::network::StreamSocket::State::Connected;
+            if (server->second.check_failed)
+                LOG(Info, "Master server failed to connect to: ", it->key);
+            setListed(server->second, it->key, !server->second.check_failed);
+        }
+        it = connect_checks.erase(it);
+    }
+    while(connect_checks.size() < max_connect_checks && !connect_check_queue.empty())
+    {
+        string key = connect_check_queue.front();
+        connect_check_queue.pop_front();
+        if (servers.find(key) != servers.end())
+            startConnectCheck(key);
+    }
+}
+
+void MasterServer::expireServers()
+{
+    auto now = Clock::now();
+    while(!expire_queue.empty() && expire_queue.top().first <= now)
+    {
+        auto it = servers.find(expire_queue.top().second);
+        //Only the last registration of a server decides when it expires, the earlier ones are left in the queue.
+        if (it != servers.end() && it->second.expire_time <= now)
+        {
+            setListed(it->second, it->first, false);
+            servers.erase(it);
+        }
+        expire_queue.pop();
+    }
+}
+
+void MasterServer::setListed(Entry& entry, const string& key, bool listed)
+{
+    if (entry.listed == listed)
+        return;
+    entry.listed = listed;
+    if (listed)
+        listed_count++;
+    else
+        listed_count--;
+    addChange(key);
+}
+
+void MasterServer::addChange(const string& key)
+{
+    list_version++;
+    change_log.push_back({list_version, key});
+    if (change_log.size() > max_change_log)
+        change_log.pop_front();
+}
+
+string MasterServer::formatEntry(const Entry& entry)
+{
+    return entry.ip + ":" + string(entry.port) + ":" + string(entry.version) + ":" + entry.name;
+}
@@ -0,0 +1,131 @@
+#ifndef MULTIPLAYER_MASTER_SERVER_H
+#define MULTIPLAYER_MASTER_SERVER_H
+
+#include "io/http/server.h"
+#include "io/network/tcpSocket.h"
+#include "io/network/udpSocket.h"
+#include "io/dataBuffer.h"
+#include "Updatable.h"
+#include "stringImproved.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+    Master server, where game servers register themselves and clients find them. A replacement for the PHP version in
+    the masterserver directory, that answers the same requests:
+        POST /register.php  with port, name and version, replies "OK", or "CONNECT FAILED: ip:port" when the game server could not be reached.
+        GET /list.php       replies a line of "ip:port:version:name" for each server.
+    On top of that:
+        GET /list.php?since=<list version>
+            Only the changes since that list version. The first line is "#<list version>", followed by "+ip:port:version:name"
+            for new and changed servers and "-ip:port" for removed ones. When the changes are no longer known, the first line
+            is "#<list version> full" and all servers follow.
+        UDP queries on the same port number, see MasterServer::udp_* below.
+
+    Everything is kept in memory. Servers are removed when they have not registered for the server timeout, 5 minutes by default.
+    A new server is checked by connecting back to it. That happens in the background, so the first registration is
+    answered with "OK", the server is only listed after the check succeeded, and a failed check is reported on the
+    next registration.
+ */
+class MasterServer : public Updatable
+{
+public:
+    static constexpr float default_server_timeout = 5 * 60.0f;
+    static constexpr float connect_check_timeout = 5.0f;
+    static constexpr size_t max_connect_checks = 256;   //Connect checks running at the same time, the rest waits for a free slot.
+    static constexpr size_t max_change_log = 4096;
+
+    //UDP query: int32 multiplayerVerficationNumber, string "MasterServerQuery", int32 game version (0 for all), uint32 first server index,
+    //  padded to at least udp_min_query_size bytes. A reply is never larger then the query it answers, so a forged sender address
+    //  can not be flooded with more data then the queries send. Pad up to udp_max_reply_size to get more servers per reply.
+    //Reply: int32 multiplayerVerficationNumber, uint32 list version, uint32 server count, uint32 first server index, uint32 servers in this reply,
+    //  followed by string ip, int32 port, int32 version and string name for each server. Ask for the next index until all servers are received.
+    //  Names are cut to udp_max_name_length bytes, so every server fits in a reply to the smallest query.
+    static constexpr size_t udp_min_query_size = 256;
+    static constexpr size_t udp_max_reply_size = 1200;
+    static constexpr int udp_max_name_length = 128;
+
+    MasterServer(int port_nr = 80);
+    virtual ~MasterServer();
+
+    virtual void update(float delta) override;
+
+    //Only affects registrations after this call, a shorter timeout is mostly useful for tests.
+    void setServerTimeout(float seconds) { server_timeout = seconds; }
+    size_t getServerCount() const { return listed_count; }
+    uint32_t getListVersion() const { return list_version; }
+private:
+    using Clock = std::chrono::steady_clock;
+
+    class Entry
+    {
+    public:
+        string ip;
+        int port;
+        int version;
+        string name;
+        Clock::time_point expire_time;
+        bool listed = false;        //The connect check succeeded.
+        bool check_failed = false;
+        bool check_pending = false;
+    };
+    class ConnectCheck
+    {
+    public:
+        string key;
+        std::unique_ptr<sp::io::network::TcpSocket> socket;
+        Clock::time_point timeout;
+    };
+    class Change
+    {
+    public:
+        uint32_t version;
+        string key;
+    };
+    class UdpItem
+    {
+    public:
+        int version;
+        sp::io::DataBuffer data;
+    };
+
+    string handleRegister(const sp::io::http::Server::Request& request);
+    string handleList(const sp::io::http::Server::Request& request);
+    void handleUdpQueries();
+    void updateConnectChecks();
+    void expireServers();
+
+    void startConnectCheck(const string& key);
+    void setListed(Entry& entry, const string& key, bool listed);
+    void addChange(const string& key);
+    static string formatEntry(const Entry& entry);
+
+    float server_timeout = default_server_timeout;
+    P<sp::io::http::Server> http_server;
+    sp::io::network::UdpSocket udp_socket;
+
+    std::unordered_map<string, Entry> servers;  //Keyed on "ip:port".
+    //Every registration adds its expire time, the earliest is on top.
+    std::priority_queue<std::pair<Clock::time_point, string>, std::vector<std::pair<Clock::time_point, string>>, std::greater<std::pair<Clock::time_point, string>>> expire_queue;
+    std::list<ConnectCheck> connect_checks;
+    std::deque<string> connect_check_queue;
+
+    size_t listed_count = 0;
+    uint32_t list_version;
+    std::deque<Change> change_log;
+
+    //Answers are build once per list version.
+    string list_response;
+    uint32_t list_response_version = 0;
+    std::vector<UdpItem> udp_items;    //All listed servers, queries for a single game version filter these.
+    uint32_t udp_items_version = 0;
+};
+
+#endif//MULTIPLAYER_MASTER_SERVER_H
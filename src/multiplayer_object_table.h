@@ -0,0 +1,134 @@
+#ifndef MULTIPLAYER_OBJECT_TABLE_H
+#define MULTIPLAYER_OBJECT_TABLE_H
+
+#include <SDL_assert.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include "P.h"
+
+/**
+    Table of replicated objects, indexed by multiplayer object id.
+
+    An object id consists of a slot index and a generation counter: id = (index << generation_bits) | generation
+    The index selects a slot in a flat vector, so lookups are O(1) and iteration walks the objects in id order.
+    Freed slots are reused in FIFO order, and each reuse bumps the generation, so a stale id of a deleted object
+    never resolves to the new object that took its slot. A slot that used up all its generations is retired instead of
+    reused, as wrapping around would make an old id valid again. That costs one empty slot per 255 objects created in it.
+    The generation is kept in the low bits so the ids stay small when the VLQ encoded id is send over the network.
+
+    The server uses add() and remove() to manage the ids. The client only uses set() with the ids it received from the server,
+    slots of deleted objects are simply overwritten when the server reuses them. As the server hands out indexes in order,
+    set() refuses an index more then max_index_gap past the end of the table, so a corrupt id can not make it allocate a huge table.
+ */
+template<class T> class MultiplayerObjectTable
+{
+public:
+    constexpr static int generation_bits = 8;
+    constexpr static uint32_t generation_mask = (1 << generation_bits) - 1;
+    constexpr static uint32_t max_index = (uint32_t(1) << (31 - generation_bits)) - 1;
+    constexpr static uint32_t max_index_gap = 65536;
+
+    int32_t add(P<T> obj)
+    {
+        uint32_t index;
+        if (!free_list.empty())
+        {
+            index = free_list.front();
+            free_list.pop_front();
+        }else{
+            SDL_assert(slots.size() < max_index);
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        Slot& slot = slots[index];
+        slot.generation = nextGeneration(slot.generation);
+        slot.used = true;
+        slot.obj = obj;
+        return makeId(index, slot.generation);
+    }
+
+    //True when set() would take this id. Check it before creating the object for an id received from the network.
+    bool canSet(int32_t id) const
+    {
+        uint32_t index = indexOf(id);
+        return index <= max_index && index < slots.size() + max_index_gap;
+    }
+
+    //Put an object at a specific id, replacing whatever was in that slot. Used on the client, where the server decides on the ids.
+    //Returns false, and does nothing, for an id canSet() refuses.
+    bool set(int32_t id, P<T> obj)
+    {
+        if (!canSet(id))
+            return false;
+        uint32_t index = indexOf(id);
+        if (index >= slots.size())
+            slots.resize(index + 1);
+        Slot& slot = slots[index];
+        slot.generation = generationOf(id);
+        slot.used = true;
+        slot.obj = obj;
+        return true;
+    }
+
+    P<T> get(int32_t id)
+    {
+        uint32_t index = indexOf(id);
+        if (index >= slots.size())
+            return nullptr;
+        Slot& slot = slots[index];
+        if (!slot.used || slot.generation != generationOf(id))
+            return nullptr;
+        return slot.obj;
+    }
+
+    void remove(int32_t id)
+    {
+        uint32_t index = indexOf(id);
+        if (index >= slots.size())
+            return;
+        Slot& slot = slots[index];
+        if (!slot.used || slot.generation != generationOf(id))
+            return;
+        slot.used = false;
+        slot.obj = nullptr;
+        if (slot.generation != generation_mask)
+            free_list.push_back(index);
+    }
+
+    void clear()
+    {
+        slots.clear();
+        free_list.clear();
+    }
+
+    //Call func(id, P<T>& obj) for each used slot, in id order.
+    //The slot of a destroyed object is still visited (with obj acting as NULL) until it is removed, and it is safe to remove() from within func.
+    template<typename F> void forEach(F func)
+    {
+        for(uint32_t index=0; index<slots.size(); index++)
+        {
+            if (slots[index].used)
+                func(makeId(index, slots[index].generation), slots[index].obj);
+        }
+    }
+private:
+    struct Slot
+    {
+        P<T> obj;
+        uint8_t generation = 0;
+        bool used = false;
+    };
+    static_assert(generation_bits <= 8, "Slot generation is stored in 8 bits");
+
+    static uint32_t indexOf(int32_t id) { return uint32_t(id) >> generation_bits; }
+    static uint8_t generationOf(int32_t id) { return uint8_t(uint32_t(id) & generation_mask); }
+    static int32_t makeId(uint32_t index, uint8_t generation) { return int32_t((index << generation_bits) | generation); }
+    //Generation 0 is never handed out, so the first object gets id 1 and no valid id is ever 0. Slots are retired before their generation wraps.
+    static uint8_t nextGeneration(uint8_t generation) { return uint8_t(generation + 1); }
+
+    std::vector<Slot> slots;
+    std::deque<uint32_t> free_list;
+};
+
+#endif//MULTIPLAYER_OBJECT_TABLE_H
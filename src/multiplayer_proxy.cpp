@@ -1,18 +1,34 @@
 #include "multiplayer_proxy.h"
 #include "multiplayer_internal.h"
+#include "multiplayer.h"
 #include "engine.h"
+#include "Updatable.h"
 
+#include <algorithm>
 
-GameServerProxy::GameServerProxy(sp::io::network::Address hostname, int hostPort, string password, int listenPort, string proxyName)
-: password(password), proxyName(proxyName)
+static constexpr int max_accepts_per_update = 64;
+
+
+static std::unique_ptr<sp::io::network::StreamSocket> connectToServer(sp::io::network::Address hostname, int hostPort)
 {
     LOG(INFO) << "Starting proxy server";
-    mainSocket = std::make_unique<sp::io::network::TcpSocket>();
-    if (!mainSocket->connect(hostname, static_cast<uint16_t>(hostPort)))
+    auto socket = std::make_unique<sp::io::network::TcpSocket>();
+    if (!socket->connect(hostname, static_cast<uint16_t>(hostPort)))
         LOG(INFO) << "Failed to connect to server";
     else
         LOG(INFO) << "Connected to server";
-    mainSocket->setBlocking(false);
+    socket->setBlocking(false);
+    return socket;
+}
+
+GameServerProxy::GameServerProxy(sp::io::network::Address hostname, int hostPort, string password, int listenPort, string proxyName)
+: GameServerProxy(connectToServer(hostname, hostPort), password, listenPort, proxyName)
+{
+}
+
+GameServerProxy::GameServerProxy(std::unique_ptr<sp::io::network::StreamSocket> socket, string password, int listenPort, string proxyName)
+: password(password), proxyName(proxyName), mainSocket(std::move(socket))
+{
     listenSocket.listen(static_cast<uint16_t>(listenPort));
     listenSocket.setBlocking(false);
 
@@ -34,6 +50,7 @@ GameServerProxy::GameServerProxy(sp::io::network::Address hostname, int hostPort
     }
 
     no_data_timeout.start(noDataDisconnectTime);
+    relayThread = std::thread(&GameServerProxy::runRelayThread, this);
 }
 
 GameServerProxy::GameServerProxy(string password, int listenPort, string proxyName)
@@ -57,15 +74,34 @@ GameServerProxy::GameServerProxy(string password, int listenPort, string proxyNa
     }
 
     no_data_timeout.start(noDataDisconnectTime);
+    relayThread = std::thread(&GameServerProxy::runRelayThread, this);
 }
 
 GameServerProxy::~GameServerProxy()
 {
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        relayRunning = false;
+    }
+    relayWakeup.notify_one();
+    if (relayThread.joinable())
+        relayThread.join();
 }
 
 void GameServerProxy::destroy()
 {
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        relayTargets.clear();
+    }
     clientList.clear();
+    objects.forEach([](int32_t id, P<MultiplayerObject>& obj)
+    {
+        if (obj)
+            obj->destroy();
+    });
+    objects.clear();
+    opaqueObjects.clear();
 
     broadcast_listen_socket.close();
 }
@@ -85,15 +121,20 @@ void GameServerProxy::update(float delta)
             case CMD_REQUEST_AUTH:
                 {
                     bool requirePassword;
-                    packet >> serverVersion >> requirePassword;
+                    bool serverCompression = false;
+                    packet >> serverVersion >> requirePassword >> serverCompression;
+                    compression = serverCompression && acceptCompression;
 
                     sp::io::DataBuffer reply;
-                    reply << CMD_CLIENT_SEND_AUTH << int32_t(serverVersion) << string(password);
+                    reply << CMD_CLIENT_SEND_AUTH << int32_t(serverVersion) << string(password) << compression;
                     mainSocket->send(reply);
                 }
                 break;
             case CMD_SET_CLIENT_ID:
                 packet >> clientId;
+                //Everything the server sends after this is compressed.
+                if (compression)
+                    mainSocket->setReceiveCompression(true);
                 break;
             case CMD_ALIVE:
                 {
@@ -103,15 +144,145 @@ void GameServerProxy::update(float delta)
                 }
                 sendAll(packet);
                 break;
+            case CMD_SET_CLASS_TABLE:
+                {
+                    uint16_t count;
+                    packet >> count;
+                    classNames.resize(count);
+                    classTable.assign(count, nullptr);
+                    for(unsigned int n=0; n<count; n++)
+                    {
+                        packet >> classNames[n];
+                        for(MultiplayerClassListItem* i = multiplayerClassListStart; i; i = i->next)
+                            if (i->name == classNames[n])
+                                classTable[n] = i;
+                        if (!classTable[n])
+                            LOG(WARNING) << "Server knows multiplayer class " << classNames[n] << " which we do not know, its objects are replayed from the received packets";
+                    }
+                }
+                sendAll(packet);
+                break;
+            case CMD_SET_GAME_SPEED:
+                packet >> gameSpeed;
+                sendAll(packet);
+                break;
             case CMD_CREATE:
+                {
+                    int32_t id;
+                    uint16_t class_id;
+                    packet >> id >> class_id;
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (!obj && !objects.canSet(id))
+                    {
+                        LOG(WARNING) << "Not mirroring object id " << id << ", far beyond the known objects";
+                    }
+                    else if (!obj && class_id < classTable.size() && classTable[class_id])
+                    {
+                        {
+                            //The mirror only holds replicated state: create it without a server or physics body, and keep game logic from running on it.
+                            GameServer::ObjectScope scope(nullptr);
+                            obj = classTable[class_id]->func();
+                        }
+                        if (Updatable* updatable = dynamic_cast<Updatable*>(*obj))
+                            updatableList.remove(updatable);
+                        obj->multiplayerObjectId = id;
+                        obj->multiplayerClassId = class_id;
+                        objects.set(id, obj);
+                    }
+                    if (obj)
+                    {
+                        while(packet.available())
+                        {
+                            int16_t idx;
+                            packet >> idx;
+                            if (idx < 0 || idx >= int32_t(obj->getMemberReplicationCount()))
+                                break;
+                            obj->receiveMirroredMemberReplication(idx, packet);
+                        }
+                        sendAll(packet);
+                    }
+                    else if (objects.canSet(id))
+                    {
+                        //A create carries the full state, so it replaces anything kept for this id before.
+                        OpaqueObject& opaque = opaqueObjects[id];
+                        opaque.create = sendAll(packet);
+                        opaque.updates.clear();
+                    }
+                    else
+                    {
+                        sendAll(packet);
+                    }
+                }
+                break;
             case CMD_DELETE:
+                {
+                    int32_t id;
+                    packet >> id;
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj)
+                        obj->destroy();
+                    opaqueObjects.erase(id);
+                }
+                sendAll(packet);
+                break;
             case CMD_UPDATE_VALUE:
-            case CMD_SET_GAME_SPEED:
+                {
+                    int32_t id;
+                    packet >> id;
+                    P<MultiplayerObject> obj = objects.get(id);
+                    if (obj)
+                    {
+                        while(packet.available())
+                        {
+                            int16_t idx;
+                            packet >> idx;
+                            if (idx < 0 || idx >= int32_t(obj->getMemberReplicationCount()))
+                                break;
+                            obj->receiveMirroredMemberReplication(idx, packet);
+                        }
+                        sendAll(packet);
+                    }
+                    else
+                    {
+                        RelayFrame frame = sendAll(packet);
+                        auto it = opaqueObjects.find(id);
+                        if (it != opaqueObjects.end())
+                            it->second.updates.push_back(frame);
+                    }
+                }
+                break;
+            case CMD_RESYNC:
+                {
+                    uint32_t count;
+                    packet >> count;
+                    std::unordered_set<int32_t> alive;
+                    for(uint32_t n=0; n<count && packet.available(); n++)
+                    {
+                        int32_t id;
+                        packet >> id;
+                        alive.insert(id);
+                    }
+                    objects.forEach([&alive](int32_t id, P<MultiplayerObject>& obj)
+                    {
+                        if (obj && alive.find(id) == alive.end())
+                            obj->destroy();
+                    });
+                    for(auto it = opaqueObjects.begin(); it != opaqueObjects.end();)
+                    {
+                        if (alive.find(it->first) == alive.end())
+                            it = opaqueObjects.erase(it);
+                        else
+                            ++it;
+                    }
+                }
+                sendAll(packet);
+                break;
             case CMD_SERVER_COMMAND:
+            case CMD_PREDICTION_ACK:
             case CMD_AUDIO_COMM_START:
             case CMD_AUDIO_COMM_DATA:
             case CMD_AUDIO_COMM_STOP:
-                sendAll(packet);
+                sendAll(packet, true);
                 break;
             case CMD_PROXY_TO_CLIENTS:
                 {
@@ -127,6 +298,28 @@ void GameServerProxy::update(float delta)
                 {
                     int32_t tempId, proxied_clientId;
                     packet >> tempId >> proxied_clientId;
+                    auto it = chainedJoins.find(tempId);
+                    if (it != chainedJoins.end())
+                    {
+                        //Client of a proxy behind us, that proxy sends the snapshot to it from its own mirror.
+                        ClientInfo* proxy = findClient(it->second.proxyClientId);
+                        if (proxy)
+                        {
+                            proxy->proxy_ids.push_back(proxied_clientId);
+                            sp::io::DataBuffer proxied_packet;
+                            proxied_packet << CMD_SET_PROXY_CLIENT_ID << it->second.tempId << proxied_clientId;
+                            post(*proxy, proxied_packet);
+                        }
+                        else
+                        {
+                            sp::io::DataBuffer serverUpdate;
+                            serverUpdate << CMD_DEL_PROXY_CLIENT << proxied_clientId;
+                            mainSocket->send(serverUpdate);
+                        }
+                        chainedJoins.erase(it);
+                        break;
+                    }
+                    bool found = false;
                     for(auto& info : clientList)
                     {
                         if (!info.validClient && info.clientId == tempId)
@@ -137,10 +330,20 @@ void GameServerProxy::update(float delta)
                             {
                                 sp::io::DataBuffer proxied_packet;
                                 proxied_packet << CMD_SET_CLIENT_ID << info.clientId;
-                                info.socket->send(proxied_packet);
+                                post(info, proxied_packet);
                             }
+                            sendSnapshot(info);
+                            found = true;
+                            break;
                         }
                     }
+                    if (!found)
+                    {
+                        //Client left before the server gave it an id.
+                        sp::io::DataBuffer serverUpdate;
+                        serverUpdate << CMD_DEL_PROXY_CLIENT << proxied_clientId;
+                        mainSocket->send(serverUpdate);
+                    }
                 }
                 break;
             }
@@ -158,26 +361,41 @@ void GameServerProxy::update(float delta)
         handleBroadcastUDPSocket(delta);
     }
 
-    if (listenSocket.accept(*newSocket))
+    for(int accept_count=0; accept_count<max_accepts_per_update && listenSocket.accept(*newSocket); accept_count++)
     {
         ClientInfo info;
-        info.socket = std::move(newSocket);
+        newSocket->setDelay(false);
+        info.relay = std::make_shared<RelayTarget>();
+        info.relay->socket = std::move(newSocket);
+        info.clientId = nextTempId++;
         newSocket = std::make_unique<sp::io::network::TcpSocket>();
         newSocket->setBlocking(false);
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+            relayTargets.push_back(info.relay);
+        }
         {
             sp::io::DataBuffer packet;
             packet << CMD_REQUEST_AUTH << int32_t(serverVersion) << bool(password != "");
-            info.socket->send(packet);
+            post(info, packet);
         }
         clientList.emplace_back(std::move(info));
     }
 
     for(unsigned int n=0; n<clientList.size(); n++)
     {
-        sp::io::DataBuffer packet;
         auto& info = clientList[n];
-        while(info.socket && info.socket->receive(packet))
+        std::vector<sp::io::DataBuffer> packets;
+        {
+            std::lock_guard<std::mutex> lock(info.relay->mutex);
+            sp::io::DataBuffer packet;
+            while(info.relay->socket && info.relay->socket->receive(packet))
+                packets.emplace_back(std::move(packet));
+        }
+        for(auto& packet : packets)
         {
+            if (!info.relay->socket)
+                break;
             command_t command;
             packet >> command;
             switch(info.receiveState)
@@ -188,12 +406,15 @@ void GameServerProxy::update(float delta)
                 case CMD_SERVER_CONNECT_TO_PROXY:
                     if (mainSocket)
                     {
-                        info.socket->close();
-                        info.socket = NULL;
+                        closeClient(info);
                     }
                     else
                     {
-                        mainSocket = std::move(info.socket);
+                        std::lock_guard<std::mutex> lock(info.relay->mutex);
+                        mainSocket = std::move(info.relay->socket);
+                        info.relay->frames.clear();
+                        info.relay->queued_bytes = 0;
+                        info.outgoing.clear();
                         no_data_timeout.start(noDataDisconnectTime);
                     }
                     break;
@@ -210,8 +431,7 @@ void GameServerProxy::update(float delta)
                         }
                         else
                         {
-                           info.socket->close();
-                           info.socket = NULL;
+                            closeClient(info);
                         }
                     }
                     break;
@@ -226,8 +446,12 @@ void GameServerProxy::update(float delta)
                 switch(command)
                 {
                 case CMD_CLIENT_COMMAND:
-                    packet >> info.commandObjectId;
-                    info.receiveState = CRS_Command;
+                    {
+                        sp::io::DataBuffer mainPacket;
+                        mainPacket << CMD_PROXY_CLIENT_COMMAND << info.clientId;
+                        mainPacket.appendRaw(packet.getReadData(), packet.available());
+                        mainSocket->send(mainPacket);
+                    }
                     break;
                 case CMD_AUDIO_COMM_START:
                 case CMD_AUDIO_COMM_DATA:
@@ -235,7 +459,39 @@ void GameServerProxy::update(float delta)
                     {
                         int32_t client_id = 0;
                         packet >> client_id;
-                        if (client_id == info.clientId)
+                        if (client_id == info.clientId || std::find(info.proxy_ids.begin(), info.proxy_ids.end(), client_id) != info.proxy_ids.end())
+                            mainSocket->send(packet);
+                    }
+                    break;
+                //Traffic from a proxy that is connected to us, pass it on to the server.
+                case CMD_NEW_PROXY_CLIENT:
+                    {
+                        int32_t tempId = 0;
+                        packet >> tempId;
+                        int32_t ourTempId = nextTempId++;
+                        chainedJoins[ourTempId] = {info.clientId, tempId};
+                        sp::io::DataBuffer serverUpdate;
+                        serverUpdate << CMD_NEW_PROXY_CLIENT << ourTempId;
+                        mainSocket->send(serverUpdate);
+                    }
+                    break;
+                case CMD_DEL_PROXY_CLIENT:
+                    {
+                        int32_t client_id = 0;
+                        packet >> client_id;
+                        auto it = std::find(info.proxy_ids.begin(), info.proxy_ids.end(), client_id);
+                        if (it != info.proxy_ids.end())
+                        {
+                            info.proxy_ids.erase(it);
+                            mainSocket->send(packet);
+                        }
+                    }
+                    break;
+                case CMD_PROXY_CLIENT_COMMAND:
+                    {
+                        int32_t client_id = 0;
+                        packet >> client_id;
+                        if (std::find(info.proxy_ids.begin(), info.proxy_ids.end(), client_id) != info.proxy_ids.end())
                             mainSocket->send(packet);
                     }
                     break;
@@ -246,21 +502,27 @@ void GameServerProxy::update(float delta)
                     break;
                 }
                 break;
-            case CRS_Command:
-                {
-                    sp::io::DataBuffer mainPacket;
-                    mainPacket << CMD_PROXY_CLIENT_COMMAND << info.commandObjectId << info.clientId;
-                    mainSocket->send(mainPacket);
-                    mainSocket->send(packet);
-                }
-                info.receiveState = CRS_Main;
-                break;
             }
         }
-        if (info.socket == NULL || info.socket->getState() == sp::io::network::StreamSocket::State::Closed)
+        bool closed;
+        {
+            std::lock_guard<std::mutex> lock(info.relay->mutex);
+            closed = !info.relay->socket || info.relay->socket->getState() == sp::io::network::StreamSocket::State::Closed;
+        }
+        if (closed)
         {
+            {
+                std::lock_guard<std::mutex> lock(relayMutex);
+                relayTargets.erase(std::remove(relayTargets.begin(), relayTargets.end(), info.relay), relayTargets.end());
+            }
             if (info.validClient)
             {
+                for(auto id : info.proxy_ids)
+                {
+                    sp::io::DataBuffer serverUpdate;
+                    serverUpdate << CMD_DEL_PROXY_CLIENT << id;
+                    mainSocket->send(serverUpdate);
+                }
                 sp::io::DataBuffer serverUpdate;
                 serverUpdate << CMD_DEL_PROXY_CLIENT << info.clientId;
                 mainSocket->send(serverUpdate);
@@ -269,41 +531,269 @@ void GameServerProxy::update(float delta)
             n--;
         }
     }
+
+    flushRelay();
+}
+
+void GameServerProxy::setClientSendQueueLimit(size_t max_size, GameServer::SendQueueOverflowPolicy policy)
+{
+    send_queue_max_size = max_size;
+    send_queue_overflow_policy = policy;
+}
+
+GameServerProxy::ClientInfo* GameServerProxy::findClient(int32_t id)
+{
+    for(auto& info : clientList)
+        if (info.validClient && info.clientId == id)
+            return &info;
+    return nullptr;
+}
+
+void GameServerProxy::sendSnapshot(ClientInfo& info, bool resync)
+{
+    if (resync)
+    {
+        //Tell the client which objects still exist, as it might have missed the delete packets of the others.
+        sp::io::DataBuffer packet;
+        uint32_t count = 0;
+        objects.forEach([&count](int32_t id, P<MultiplayerObject>& obj) { if (obj) count++; });
+        count += uint32_t(opaqueObjects.size());
+        packet << CMD_RESYNC << count;
+        objects.forEach([&packet](int32_t id, P<MultiplayerObject>& obj) { if (obj) packet << id; });
+        for(auto& it : opaqueObjects)
+            packet << it.first;
+        post(info, packet, false);
+    }
+    {
+        sp::io::DataBuffer packet;
+        packet << CMD_SET_GAME_SPEED << gameSpeed;
+        post(info, packet, false);
+    }
+    {
+        sp::io::DataBuffer packet;
+        packet << CMD_SET_CLASS_TABLE << uint16_t(classNames.size());
+        for(auto& name : classNames)
+            packet << name;
+        post(info, packet, false);
+    }
+    objects.forEach([this, &info](int32_t id, P<MultiplayerObject>& obj)
+    {
+        if (!obj)
+            return;
+        sp::io::DataBuffer packet;
+        packet << CMD_CREATE << id << obj->multiplayerClassId;
+        for(unsigned int n=0; n<obj->getMemberReplicationCount(); n++)
+        {
+            //Sync the replicated state with the received values, so delta encoded members are send in full.
+            obj->isMemberReplicationChanged(n);
+            packet << int16_t(n);
+            obj->sendMemberReplication(n, packet);
+        }
+        post(info, packet, false);
+    });
+    for(auto& it : opaqueObjects)
+    {
+        post(info, it.second.create, false);
+        for(auto& update : it.second.updates)
+            post(info, update, false);
+    }
 }
 
-void GameServerProxy::sendAll(sp::io::DataBuffer& packet)
+GameServerProxy::RelayFrame GameServerProxy::sendAll(sp::io::DataBuffer& packet, bool keep_on_resync)
 {
+    RelayFrame frame = makeFrame(packet);
     if (targetClients.empty())
     {
         for(auto& info : clientList)
         {
-            if (info.validClient && info.socket)
-                info.socket->send(packet);
+            if (info.validClient)
+                post(info, frame, keep_on_resync);
         }
     }
     else
     {
         for(auto& info : clientList)
         {
-            if (info.validClient && info.socket && targetClients.find(info.clientId) != targetClients.end())
-                info.socket->send(packet);
+            if (!info.validClient)
+                continue;
+            sp::io::DataBuffer target_packet;
+            bool targeted = false;
+            target_packet << CMD_PROXY_TO_CLIENTS;
+            for(auto id : info.proxy_ids)
+            {
+                if (targetClients.find(id) != targetClients.end())
+                {
+                    target_packet << id;
+                    targeted = true;
+                }
+            }
+            //The target list and the frame it applies to are dropped or kept together.
+            if (targeted)
+            {
+                post(info, target_packet, keep_on_resync);
+                post(info, frame, keep_on_resync);
+            }
+            else if (targetClients.find(info.clientId) != targetClients.end())
+            {
+                post(info, frame, keep_on_resync);
+            }
         }
         targetClients.clear();
     }
+    return frame;
 }
 
-void GameServerProxy::handleBroadcastUDPSocket(float delta)
+GameServerProxy::RelayFrame GameServerProxy::makeFrame(const sp::io::DataBuffer& packet)
 {
-    sp::io::network::Address recvAddress;
-    int recvPort;
-    sp::io::DataBuffer recvPacket;
-    if (broadcast_listen_socket.receive(recvPacket, recvAddress, recvPort))
+    //Same framing as StreamSocket::queue, done once for all clients.
+    sp::io::DataBuffer packet_size(uint32_t(packet.getDataSize()));
+    auto frame = std::make_shared<std::vector<uint8_t>>();
+    frame->reserve(packet_size.getDataSize() + packet.getDataSize());
+    const uint8_t* size_data = static_cast<const uint8_t*>(packet_size.getData());
+    const uint8_t* data = static_cast<const uint8_t*>(packet.getData());
+    frame->insert(frame->end(), size_data, size_data + packet_size.getDataSize());
+    frame->insert(frame->end(), data, data + packet.getDataSize());
+    return frame;
+}
+
+void GameServerProxy::flushRelay()
+{
+    //Hand all frames of this update to the relay thread with a single lock per client and a single wakeup.
+    bool posted = false;
+    for(auto& info : clientList)
     {
-        //We do not care about what we received. Reply that we live!
-        sp::io::DataBuffer sendPacket;
-        sendPacket << int32_t(multiplayerVerficationNumber) << int32_t(serverVersion) << proxyName;
-        broadcast_listen_socket.send(sendPacket, recvAddress, recvPort);
+        if (info.outgoing.empty())
+            continue;
+        std::lock_guard<std::mutex> lock(info.relay->mutex);
+        if (info.relay->socket)
+        {
+            for(auto& frame : info.outgoing)
+            {
+                info.relay->queued_bytes += frame.data->size();
+                info.relay->frames.push_back(std::move(frame));
+            }
+            posted = true;
+            if (info.validClient && info.relay->queued_bytes > send_queue_max_size + info.resync_size)
+                handleRelayOverflow(info);
+            else if (info.relay->queued_bytes <= send_queue_max_size)
+                info.resync_size = 0;
+        }
+        info.outgoing.clear();
+    }
+    if (!posted)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        relayPending = true;
     }
+    relayWakeup.notify_one();
+}
+
+//Called with the relay mutex of the client held.
+void GameServerProxy::handleRelayOverflow(ClientInfo& info)
+{
+    RelayTarget& relay = *info.relay;
+    switch(send_queue_overflow_policy)
+    {
+    case GameServer::SendQueueOverflowPolicy::Disconnect:
+        LOG(WARNING) << "Relay queue of client " << info.clientId << " overflowed (" << relay.queued_bytes << " bytes), disconnecting";
+        closeRelay(relay);
+        break;
+    case GameServer::SendQueueOverflowPolicy::Resync:
+        LOG(WARNING) << "Relay queue of client " << info.clientId << " overflowed (" << relay.queued_bytes << " bytes), resyncing";
+        {
+            //A partially written frame has to be finished, and server commands are events the snapshot does not recreate, those still go out after it.
+            std::deque<QueuedFrame> frames;
+            frames.swap(relay.frames);
+            relay.queued_bytes = 0;
+            if (relay.frame_offset > 0)
+            {
+                relay.queued_bytes += frames.front().data->size();
+                relay.frames.push_back(std::move(frames.front()));
+                frames.pop_front();
+            }
+            info.outgoing.clear();
+            info.resync_count++;
+            sendSnapshot(info, true);
+            for(auto& frame : frames)
+                if (frame.keep_on_resync)
+                    info.outgoing.push_back(std::move(frame));
+            for(auto& frame : info.outgoing)
+            {
+                relay.queued_bytes += frame.data->size();
+                relay.frames.push_back(std::move(frame));
+            }
+            info.outgoing.clear();
+        }
+        info.resync_size = relay.queued_bytes;
+        break;
+    }
+}
+
+void GameServerProxy::closeRelay(RelayTarget& relay)
+{
+    if (relay.socket)
+        relay.socket->close();
+    relay.socket = nullptr;
+    relay.frames.clear();
+    relay.frame_offset = 0;
+    relay.queued_bytes = 0;
+}
+
+void GameServerProxy::closeClient(ClientInfo& info)
+{
+    std::lock_guard<std::mutex> lock(info.relay->mutex);
+    closeRelay(*info.relay);
+    info.outgoing.clear();
+}
+
+void GameServerProxy::runRelayThread()
+{
+    std::vector<std::shared_ptr<RelayTarget>> targets;
+    std::unique_lock<std::mutex> lock(relayMutex);
+    while(relayRunning)
+    {
+        targets = relayTargets;
+        relayPending = false;
+        lock.unlock();
+
+        bool blocked = false;
+        for(auto& target : targets)
+        {
+            std::lock_guard<std::mutex> target_lock(target->mutex);
+            while(!target->frames.empty() && target->socket)
+            {
+                const auto& frame = *target->frames.front().data;
+                target->frame_offset += target->socket->sendDirect(frame.data() + target->frame_offset, frame.size() - target->frame_offset);
+                if (target->frame_offset < frame.size())
+                {
+                    blocked = true;
+                    break;
+                }
+                target->queued_bytes -= frame.size();
+                target->frames.pop_front();
+                target->frame_offset = 0;
+            }
+        }
+        targets.clear();
+
+        lock.lock();
+        //When a socket could not take all data, retry shortly. Else sleep till new frames are posted.
+        if (relayRunning && !relayPending)
+            relayWakeup.wait_for(lock, std::chrono::milliseconds(blocked ? 5 : 100));
+    }
+}
+
+void GameServerProxy::handleBroadcastUDPSocket(float delta)
+{
+    GameServer::replyToServerProbes(broadcast_listen_socket, serverVersion, proxyName, [this]()
+    {
+        int32_t client_count = 0;
+        for(auto& client : clientList)
+            if (client.receiveState == CRS_Main)
+                client_count++;
+        return client_count;
+    }, !password.empty());
     if (boardcastServerDelay > 0.0f)
     {
         boardcastServerDelay -= delta;
@@ -2,7 +2,14 @@
 #define MULTIPLAYER_PROXY_H
 
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
 #include "multiplayer_server.h"
+#include "multiplayer_object_table.h"
+
+class MultiplayerClassListItem;
 
 class GameServerProxy : public Updatable
 {
@@ -16,36 +23,108 @@ class GameServerProxy : public Updatable
     enum EClientReceiveState
     {
         CRS_Auth,
-        CRS_Main,
-        CRS_Command
+        CRS_Main
     };
-    struct ClientInfo
+    //Packets for downstream clients are framed once and the same frame is shared by all clients it goes to.
+    typedef std::shared_ptr<const std::vector<uint8_t>> RelayFrame;
+    struct QueuedFrame
+    {
+        RelayFrame data;
+        bool keep_on_resync; //Not recreated by a snapshot, so still delivered after a resync.
+    };
+    //Connection to a downstream client. Writing is done by the relay thread, so the socket is only touched while holding the mutex.
+    struct RelayTarget
     {
+        std::mutex mutex;
         std::unique_ptr<sp::io::network::TcpSocket> socket;
+        std::deque<QueuedFrame> frames;
+        size_t frame_offset = 0;
+        size_t queued_bytes = 0;
+    };
+    struct ClientInfo
+    {
+        std::shared_ptr<RelayTarget> relay;
+        std::vector<QueuedFrame> outgoing; //Frames posted during this update, handed to the relay thread in one go by flushRelay.
+        size_t resync_size = 0; //Size of the last resync snapshot, which is allowed on top of the maximum queue size till the queue is back under it.
+        int resync_count = 0;
         int32_t clientId = 0;
-        int32_t commandObjectId = 0;
         bool validClient = false;
         EClientReceiveState receiveState = CRS_Auth;
+        std::vector<int32_t> proxy_ids; //Clients connected to a proxy that is connected to us.
+    };
+    //A client of a proxy connected to us, which is waiting on the server to assign it an id.
+    struct ChainedJoin
+    {
+        int32_t proxyClientId;
+        int32_t tempId;
     };
     std::vector<ClientInfo> clientList;
     std::unordered_set<int32_t> targetClients;
+    std::unordered_map<int32_t, ChainedJoin> chainedJoins;
+    int32_t nextTempId = 1;
+
+    //Mirror of the replicated world, used to give new clients a snapshot without involving the server.
+    //Objects of known classes are constructed in this process, without a server scope, physics or updates. Their constructors
+    // still run, so classes that create renderables, scripts or other objects in their constructor do so in the proxy as well.
+    // Only use a proxy build that links such classes when their constructors have no side effects, or leave them out of it.
+    float gameSpeed = 1.0f;
+    std::vector<string> classNames;
+    std::vector<MultiplayerClassListItem*> classTable;
+    MultiplayerObjectTable<MultiplayerObject> objects;
+    //Objects of classes the proxy does not know are kept as the packets that created and updated them, and replayed as is.
+    //Their updates pile up until the server sends a create with the full state again, which happens on a resync.
+    struct OpaqueObject
+    {
+        RelayFrame create;
+        std::vector<RelayFrame> updates;
+    };
+    std::unordered_map<int32_t, OpaqueObject> opaqueObjects;
 
     int32_t clientId = 0;
     string password;
     int32_t serverVersion = 0;
+    bool acceptCompression = true;
+    bool compression = false;   //The server offered compression and we accepted, so it starts after our client id.
     string proxyName;
     float boardcastServerDelay;
-    std::unique_ptr<sp::io::network::TcpSocket> mainSocket;
+    std::unique_ptr<sp::io::network::StreamSocket> mainSocket;
+
+    std::thread relayThread;
+    std::mutex relayMutex;
+    std::condition_variable relayWakeup;
+    std::vector<std::shared_ptr<RelayTarget>> relayTargets;
+    bool relayPending = false;
+    bool relayRunning = true;
+    size_t send_queue_max_size = 8 * 1024 * 1024;
+    GameServer::SendQueueOverflowPolicy send_queue_overflow_policy = GameServer::SendQueueOverflowPolicy::Resync;
 public:
     GameServerProxy(sp::io::network::Address hostname, int hostPort = defaultServerPort, string password = "", int listenPort = defaultServerPort, string proxyName="");
     GameServerProxy(string password = "", int listenPort = defaultServerPort, string proxyName="");
+    //Use an already connected, non-blocking socket to the server. For example a LocalSocket to a server on the same machine.
+    GameServerProxy(std::unique_ptr<sp::io::network::StreamSocket> socket, string password = "", int listenPort = defaultServerPort, string proxyName="");
     virtual ~GameServerProxy();
 
     virtual void destroy() override;
 
     virtual void update(float delta) override;
+
+    //Clients with more then max_size bytes waiting for the relay thread are handled according to the overflow policy, like on the GameServer.
+    void setClientSendQueueLimit(size_t max_size, GameServer::SendQueueOverflowPolicy policy);
+    //Accept compression of the server traffic when the server offers it, like GameClient::setAcceptCompression. Only has effect before connecting.
+    void setAcceptCompression(bool accept) { acceptCompression = accept; }
 private:
-    void sendAll(sp::io::DataBuffer& packet);
+    //Returns the frame that was posted, so it can be kept for later clients.
+    RelayFrame sendAll(sp::io::DataBuffer& packet, bool keep_on_resync=false);
+    static RelayFrame makeFrame(const sp::io::DataBuffer& packet);
+    void post(ClientInfo& info, const RelayFrame& frame, bool keep_on_resync=true) { info.outgoing.push_back({frame, keep_on_resync}); }
+    void post(ClientInfo& info, const sp::io::DataBuffer& packet, bool keep_on_resync=true) { post(info, makeFrame(packet), keep_on_resync); }
+    void flushRelay();
+    void handleRelayOverflow(ClientInfo& info);
+    static void closeRelay(RelayTarget& relay);
+    void closeClient(ClientInfo& info);
+    void runRelayThread();
+    void sendSnapshot(ClientInfo& info, bool resync=false);
+    ClientInfo* findClient(int32_t id);
 
     void handleBroadcastUDPSocket(float delta);
 };
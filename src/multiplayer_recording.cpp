@@ -0,0 +1,287 @@
+#include "multiplayer_recording.h"
+#include "multiplayer_internal.h"
+#include "logging.h"
+
+#include <algorithm>
+
+static const char recording_magic[4] = {'S', 'P', 'R', 'R'};
+
+MultiplayerRecorder::MultiplayerRecorder()
+: file(nullptr), tick(0), keyframe_interval(0.0f), next_keyframe_time(0.0f)
+{
+}
+
+MultiplayerRecorder::~MultiplayerRecorder()
+{
+    close();
+}
+
+bool MultiplayerRecorder::open(const string& filename, int32_t version_number, float keyframe_interval)
+{
+    close();
+    file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        LOG(ERROR) << "Failed to open " << filename << " for recording";
+        return false;
+    }
+    sp::io::DataBuffer header;
+    header.appendRaw(recording_magic, sizeof(recording_magic));
+    header << format_version << version_number;
+    fwrite(header.getData(), header.getDataSize(), 1, file);
+
+    clock.restart();
+    tick_data.clear();
+    tick = 0;
+    this->keyframe_interval = keyframe_interval;
+    next_keyframe_time = 0.0f;
+    return true;
+}
+
+void MultiplayerRecorder::close()
+{
+    if (file)
+        fclose(file);
+    file = nullptr;
+}
+
+void MultiplayerRecorder::addPacket(const sp::io::DataBuffer& packet)
+{
+    sp::io::DataBuffer packet_size(uint32_t(packet.getDataSize()));
+    tick_data.appendRaw(packet_size.getData(), packet_size.getDataSize());
+    tick_data.appendRaw(packet.getData(), packet.getDataSize());
+}
+
+bool MultiplayerRecorder::isKeyframeDue()
+{
+    return clock.get() >= next_keyframe_time;
+}
+
+void MultiplayerRecorder::writeKeyframe(const std::vector<sp::io::DataBuffer>& packets)
+{
+    //The keyframe describes the state after this tick, so the tick itself has to come first.
+    endTick();
+
+    sp::io::DataBuffer keyframe_data;
+    for(auto& packet : packets)
+    {
+        sp::io::DataBuffer packet_size(uint32_t(packet.getDataSize()));
+        keyframe_data.appendRaw(packet_size.getData(), packet_size.getDataSize());
+        keyframe_data.appendRaw(packet.getData(), packet.getDataSize());
+    }
+    writeFrame(Keyframe, keyframe_data);
+    next_keyframe_time = clock.get() + keyframe_interval;
+}
+
+void MultiplayerRecorder::endTick()
+{
+    if (tick_data.getDataSize() > 0)
+    {
+        writeFrame(Tick, tick_data);
+        tick_data.clear();
+    }
+    tick++;
+}
+
+void MultiplayerRecorder::writeFrame(FrameType type, const sp::io::DataBuffer& data)
+{
+    if (!file)
+        return;
+    sp::io::DataBuffer header;
+    header << uint8_t(type) << tick << clock.get() << uint32_t(data.getDataSize());
+    fwrite(header.getData(), header.getDataSize(), 1, file);
+    fwrite(data.getData(), data.getDataSize(), 1, file);
+}
+
+
+MultiplayerReplaySocket::MultiplayerReplaySocket()
+: opened(false), version_number(0), next_frame(0), time(0.0f), speed(1.0f), pending_offset(0)
+{
+}
+
+MultiplayerReplaySocket::~MultiplayerReplaySocket()
+{
+}
+
+bool MultiplayerReplaySocket::open(const string& filename)
+{
+    close();
+
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f)
+    {
+        LOG(ERROR) << "Failed to open recording " << filename;
+        return false;
+    }
+    std::vector<uint8_t> file_data;
+    uint8_t buffer[16 * 1024];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        file_data.insert(file_data.end(), buffer, buffer + n);
+    fclose(f);
+
+    if (file_data.size() < sizeof(recording_magic) || memcmp(file_data.data(), recording_magic, sizeof(recording_magic)) != 0)
+    {
+        LOG(ERROR) << filename << " is not a multiplayer recording";
+        return false;
+    }
+
+    //Index all frames, the data itself stays in the buffer.
+    sp::io::DataBuffer reader;
+    reader = std::move(file_data);
+    reader.skip(sizeof(recording_magic));
+    uint32_t file_format_version = 0;
+    reader >> file_format_version >> version_number;
+    if (file_format_version != MultiplayerRecorder::format_version)
+    {
+        LOG(ERROR) << filename << " has unsupported recording format " << file_format_version;
+        return false;
+    }
+    while(reader.available())
+    {
+        Frame frame;
+        uint8_t type = 0;
+        uint32_t size = 0;
+        reader >> type >> frame.tick >> frame.time >> size;
+        if (size > reader.available())
+        {
+            LOG(WARNING) << filename << " is truncated, playing the first " << frames.size() << " frames";
+            break;
+        }
+        frame.type = MultiplayerRecorder::FrameType(type);
+        frame.offset = reader.getDataSize() - reader.available();
+        frame.size = size;
+        frames.push_back(frame);
+        reader.skip(size);
+    }
+    const uint8_t* start = static_cast<const uint8_t*>(reader.getData());
+    data.assign(start, start + reader.getDataSize());
+
+    opened = true;
+
+    //Pretend to be a server accepting us, so a GameClient goes to the connected state.
+    sp::io::DataBuffer auth;
+    auth << CMD_REQUEST_AUTH << version_number << false;
+    appendFramed(auth);
+    sp::io::DataBuffer client_id;
+    client_id << CMD_SET_CLIENT_ID << int32_t(0);
+    appendFramed(client_id);
+
+    auto keyframe = std::find_if(frames.begin(), frames.end(), [](const Frame& f) { return f.type == MultiplayerRecorder::Keyframe; });
+    if (keyframe == frames.end())
+    {
+        LOG(WARNING) << filename << " contains no keyframe, playing from the start";
+        time = frames.empty() ? 0.0f : frames.front().time;
+        next_frame = 0;
+    }else{
+        time = keyframe->time;
+        queueFrame(*keyframe);
+        next_frame = (keyframe - frames.begin()) + 1;
+    }
+    clock.restart();
+    return true;
+}
+
+void MultiplayerReplaySocket::close()
+{
+    opened = false;
+    data.clear();
+    frames.clear();
+    next_frame = 0;
+    time = 0.0f;
+    pending.clear();
+    pending_offset = 0;
+    clearQueue();
+}
+
+sp::io::network::StreamSocket::State MultiplayerReplaySocket::getState()
+{
+    return opened ? State::Connected : State::Closed;
+}
+
+float MultiplayerReplaySocket::getDuration()
+{
+    if (frames.empty())
+        return 0.0f;
+    return frames.back().time;
+}
+
+bool MultiplayerReplaySocket::isFinished()
+{
+    return next_frame >= frames.size() && pending_offset >= pending.size();
+}
+
+void MultiplayerReplaySocket::seek(float target_time)
+{
+    //Bytes that are already pending are kept, as a packet might be partially received already.
+    size_t keyframe_index = frames.size();
+    for(size_t n=0; n<frames.size() && frames[n].time <= target_time; n++)
+        if (frames[n].type == MultiplayerRecorder::Keyframe)
+            keyframe_index = n;
+    if (keyframe_index == frames.size())
+    {
+        //Before the first keyframe, start playback from there.
+        for(size_t n=0; n<frames.size(); n++)
+        {
+            if (frames[n].type == MultiplayerRecorder::Keyframe)
+            {
+                keyframe_index = n;
+                break;
+            }
+        }
+    }
+    //Seeking forward without passing a keyframe just plays the ticks in between.
+    if (keyframe_index < frames.size() && (target_time < time || keyframe_index >= next_frame))
+    {
+        queueFrame(frames[keyframe_index]);
+        next_frame = keyframe_index + 1;
+    }
+    time = std::max(target_time, keyframe_index < frames.size() ? frames[keyframe_index].time : target_time);
+    queueDueFrames();
+}
+
+void MultiplayerReplaySocket::appendFramed(const sp::io::DataBuffer& packet)
+{
+    sp::io::DataBuffer packet_size(uint32_t(packet.getDataSize()));
+    const uint8_t* size_data = static_cast<const uint8_t*>(packet_size.getData());
+    const uint8_t* packet_data = static_cast<const uint8_t*>(packet.getData());
+    pending.insert(pending.end(), size_data, size_data + packet_size.getDataSize());
+    pending.insert(pending.end(), packet_data, packet_data + packet.getDataSize());
+}
+
+void MultiplayerReplaySocket::queueFrame(const Frame& frame)
+{
+    pending.insert(pending.end(), data.begin() + frame.offset, data.begin() + frame.offset + frame.size);
+}
+
+void MultiplayerReplaySocket::queueDueFrames()
+{
+    for(; next_frame < frames.size() && frames[next_frame].time <= time; next_frame++)
+    {
+        if (frames[next_frame].type == MultiplayerRecorder::Tick)
+            queueFrame(frames[next_frame]);
+    }
+}
+
+size_t MultiplayerReplaySocket::_send(const void* data, size_t size)
+{
+    return size;
+}
+
+size_t MultiplayerReplaySocket::_receive(void* data, size_t size)
+{
+    if (!opened)
+        return 0;
+    time += clock.restart() * speed;
+    if (pending_offset >= pending.size())
+    {
+        pending.clear();
+        pending_offset = 0;
+    }
+    queueDueFrames();
+    size = std::min(size, pending.size() - pending_offset);
+    if (size > 0)
+        memcpy(data, pending.data() + pending_offset, size);
+    pending_offset += size;
+    return size;
+}
@@ -0,0 +1,111 @@
+#ifndef MULTIPLAYER_RECORDING_H
+#define MULTIPLAYER_RECORDING_H
+
+#include "io/network/streamSocket.h"
+#include "stringImproved.h"
+#include "timer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/**
+    Recording of the replication stream that the server sends to its clients.
+
+    The file starts with a header, followed by frames:
+        header: char[4] "SPRR", uint32_t format version, int32_t game version number
+        frame:  uint8_t type, uint32_t tick, float time, uint32_t size, size bytes of packets
+    All frame fields are encoded like in a DataBuffer. The packets in a frame are framed exactly like they are on the network,
+    so a frame can be passed to a client as is.
+    A Tick frame holds all packets broadcast during a single server update. A Keyframe holds a full snapshot of the world
+    at the end of that update, which is only used for seeking and to start playback.
+ */
+class MultiplayerRecorder
+{
+public:
+    enum FrameType : uint8_t
+    {
+        Tick,
+        Keyframe,
+    };
+    static constexpr uint32_t format_version = 1;
+
+    MultiplayerRecorder();
+    ~MultiplayerRecorder();
+
+    bool open(const string& filename, int32_t version_number, float keyframe_interval);
+    void close();
+    bool isOpen() { return file != nullptr; }
+
+    void addPacket(const sp::io::DataBuffer& packet);
+    bool isKeyframeDue();
+    void writeKeyframe(const std::vector<sp::io::DataBuffer>& packets);
+    //Write out the packets of this update as a single frame.
+    void endTick();
+private:
+    void writeFrame(FrameType type, const sp::io::DataBuffer& data);
+
+    FILE* file;
+    sp::SystemStopwatch clock;
+    sp::io::DataBuffer tick_data;
+    uint32_t tick;
+    float keyframe_interval;
+    float next_keyframe_time;
+};
+
+/**
+    Plays back a recording as if it was a connection to a server.
+    Can be given to a GameClient, or read from directly with receive() by a stub client. Data send to it is ignored.
+    Playback starts at the first keyframe and follows the wall clock scaled by the playback speed.
+ */
+class MultiplayerReplaySocket : public sp::io::network::StreamSocket
+{
+public:
+    MultiplayerReplaySocket();
+    virtual ~MultiplayerReplaySocket();
+
+    bool open(const string& filename);
+    virtual void close() override;
+    virtual State getState() override;
+
+    int32_t getVersionNumber() { return version_number; }
+    float getDuration();
+    float getTime() { return time; }
+    bool isFinished();
+
+    void setSpeed(float speed) { this->speed = speed; } //1.0 is real time, 0.0 pauses playback.
+    void advance(float seconds) { time += seconds; } //Move the playback forward by hand, useful together with a speed of 0.
+    //Jump to a point in time. This restarts from the last keyframe before that time and plays the ticks after it.
+    void seek(float time);
+
+protected:
+    virtual size_t _send(const void* data, size_t size) override;
+    virtual size_t _receive(void* data, size_t size) override;
+
+private:
+    struct Frame
+    {
+        MultiplayerRecorder::FrameType type;
+        uint32_t tick;
+        float time;
+        size_t offset;
+        size_t size;
+    };
+
+    void appendFramed(const sp::io::DataBuffer& packet);
+    void queueFrame(const Frame& frame);
+    void queueDueFrames();
+
+    bool opened;
+    int32_t version_number;
+    std::vector<uint8_t> data;
+    std::vector<Frame> frames;
+    size_t next_frame;
+    float time;
+    float speed;
+    sp::SystemStopwatch clock;
+    std::vector<uint8_t> pending;   //Packet data ready to be received.
+    size_t pending_offset;
+};
+
+#endif//MULTIPLAYER_RECORDING_H
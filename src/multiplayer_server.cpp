@@ -2,10 +2,13 @@
 #include "multiplayer_client.h"
 #include "multiplayer_internal.h"
 #include "multiplayer.h"
+#include "collisionable.h"
 #include "engine.h"
 
 #include "io/http/request.h"
 
+#include <algorithm>
+
 #ifdef STEAMSDK
 #include "io/network/steamP2PSocket.h"
 #endif
@@ -13,6 +16,8 @@
 
 #define MULTIPLAYER_COLLECT_DATA_STATS 0
 
+static constexpr int max_accepts_per_update = 64;
+
 #if MULTIPLAYER_COLLECT_DATA_STATS
 sp::SystemTimer multiplayer_stats_dump;
 static std::unordered_map<string, int> multiplayer_stats;
@@ -23,20 +28,31 @@ static std::unordered_map<string, int> multiplayer_stats;
 
 
 P<GameServer> game_server;
+P<GameServer> GameServer::object_scope_server;
+bool GameServer::object_scope_active = false;
+PVector<GameServer> GameServer::servers;
 
 GameServer::GameServer(string server_name, int version_number, int listen_port)
 : server_name(server_name), listen_port(listen_port), version_number(version_number)
 {
-    SDL_assert(!game_server);
     SDL_assert(!game_client);
-    game_server = this;
+    if (!game_server)
+    {
+        game_server = this;
+        physics_world = CollisionManager::getScopeWorld();
+    }
+    else
+    {
+        physics_world = CollisionManager::createWorld();
+    }
+    servers.push_back(this);
+    significant_collisionables = std::make_shared<PVector<Collisionable>>();
     lastGameSpeed = engine->getGameSpeed();
     sendDataRate = 0.0f;
     sendDataRatePerClient = 0.0f;
     boardcastServerDelay = 0.0f;
     keep_alive_send_timer.repeat(10);;
 
-    nextObjectId = 1;
     nextclient_id = 1;
 
     if (!listen_socket.listen(static_cast<uint16_t>(listen_port)))
@@ -97,19 +113,32 @@ void GameServer::connectToProxy(sp::io::network::Address address, int port)
     }
     {
         sp::io::DataBuffer packet;
-        packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "");
+        packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "") << bool(compression_level > 0);
         info.socket->send(packet);
     }
     LOG(INFO) << "New proxy connection: " << info.client_id << " waiting for authentication";
     clientList.push_back(std::move(info));
 }
 
+bool GameServer::listenLocal(const string& path)
+{
+    if (!local_listen_socket.listen(path))
+    {
+        LOG(ERROR) << "Failed to listen on local socket: " << path;
+        return false;
+    }
+    local_listen_socket.setBlocking(false);
+    new_local_socket = std::make_unique<sp::io::network::LocalSocket>();
+    return true;
+}
+
 void GameServer::destroy()
 {
     clientList.clear();
-    objectMap.clear();
+    objects.clear();
 
     listen_socket.close();
+    local_listen_socket.close();
     broadcast_listen_socket.close();
 #ifdef STEAMSDK
     listen_steam.close();
@@ -120,9 +149,7 @@ void GameServer::destroy()
 
 P<MultiplayerObject> GameServer::getObjectById(int32_t id)
 {
-    if (objectMap.find(id) != objectMap.end())
-        return objectMap[id];
-    return NULL;
+    return objects.get(id);
 }
 
 void GameServer::update(float /*gameDelta*/)
@@ -143,83 +170,105 @@ void GameServer::update(float /*gameDelta*/)
         sendAll(packet);
     }
 
-    std::vector<int32_t> delList;
-    for(std::unordered_map<int32_t, P<MultiplayerObject> >::iterator i=objectMap.begin(); i != objectMap.end(); i++)
+    objects.forEach([this, delta](int32_t id, P<MultiplayerObject>& obj)
     {
-        int id = i->first;
-        P<MultiplayerObject> obj = i->second;
         if (obj)
         {
             if (!obj->replicated)
             {
                 obj->replicated = true;
 
-                sp::io::DataBuffer packet;
-                generateCreatePacketFor(obj, packet);
-                //Call the isChanged function for each replication info, so the prev_data is updated.
-                for(unsigned int n=0; n<obj->memberReplicationInfo.size(); n++)
-                    obj->memberReplicationInfo[n].isChangedFunction(obj->memberReplicationInfo[n].ptr, &obj->memberReplicationInfo[n].prev_data);
-                sendAll(packet);
-                ADD_MULTIPLAYER_STATS(obj->multiplayerClassIdentifier + "::CREATE", packet.getDataSize());
+                //Call the isChanged function for each replication info, so the prev_data is updated before the create packet is build from it.
+                for(unsigned int n=0; n<obj->getMemberReplicationCount(); n++)
+                    obj->isMemberReplicationChanged(n);
+                auto packet = packet_pool.borrow();
+                generateCreatePacketFor(obj, *packet);
+                sendAll(*packet);
+                ADD_MULTIPLAYER_STATS(obj->multiplayerClassIdentifier + "::CREATE", packet->getDataSize());
             }
-            sp::io::DataBuffer packet;
+            auto borrowed_packet = packet_pool.borrow();
+            sp::io::DataBuffer& packet = *borrowed_packet;
             packet << CMD_UPDATE_VALUE;
             packet << int32_t(obj->multiplayerObjectId);
 #if MULTIPLAYER_COLLECT_DATA_STATS
             int overhead = packet.getDataSize();
 #endif
             int cnt = 0;
-            for(unsigned int n=0; n<obj->memberReplicationInfo.size(); n++)
+            changed_members.clear();
+            unsigned int count = obj->getMemberReplicationCount();
+            float* update_timeout = obj->replication_update_timeout.data();
+            for(unsigned int n=0; n<count; n++)
             {
-                if (obj->memberReplicationInfo[n].update_timeout > 0.0f)
+                if (update_timeout[n] > 0.0f)
                 {
-                    obj->memberReplicationInfo[n].update_timeout -= delta;
+                    update_timeout[n] -= delta;
                 }else{
-                    if ((obj->memberReplicationInfo[n].isChangedFunction)(obj->memberReplicationInfo[n].ptr, &obj->memberReplicationInfo[n].prev_data))
+                    if (obj->isMemberReplicationChanged(n))
                     {
 #if MULTIPLAYER_COLLECT_DATA_STATS
                         int packet_size = packet.getDataSize();
 #endif
                         packet << int16_t(n);
-                        (obj->memberReplicationInfo[n].sendFunction)(obj->memberReplicationInfo[n].ptr, packet);
+                        obj->sendMemberReplicationUpdate(n, packet);
                         cnt++;
-                        ADD_MULTIPLAYER_STATS(obj->multiplayerClassIdentifier + "::" + obj->memberReplicationInfo[n].name, packet.getDataSize() - packet_size);
+                        changed_members.push_back(uint16_t(n));
+                        ADD_MULTIPLAYER_STATS(obj->multiplayerClassIdentifier + "::" + (*obj->replication_schema)[n].name, packet.getDataSize() - packet_size);
 
-                        obj->memberReplicationInfo[n].update_timeout = obj->memberReplicationInfo[n].update_delay;
+                        update_timeout[n] = (*obj->replication_schema)[n].update_delay;
                     }
                 }
             }
             if (cnt > 0)
             {
-                sendAll(packet);
+                sendUpdate(id, packet);
                 ADD_MULTIPLAYER_STATS(obj->multiplayerClassIdentifier + "::OVERHEAD", overhead);
             }
         }else{
-            delList.push_back(id);
+            auto packet = packet_pool.borrow();
+            generateDeletePacketFor(id, *packet);
+            sendAll(*packet);
+            ADD_MULTIPLAYER_STATS("???::DELETE", packet->getDataSize());
+            objects.remove(id);
         }
-    }
-    for(unsigned int n=0; n<delList.size(); n++)
+    });
+
+    if (recorder)
     {
-        sp::io::DataBuffer packet;
-        generateDeletePacketFor(delList[n], packet);
-        sendAll(packet);
-        ADD_MULTIPLAYER_STATS("???::DELETE", packet.getDataSize());
-        objectMap.erase(delList[n]);
+        if (recorder->isKeyframeDue())
+        {
+            std::vector<sp::io::DataBuffer> packets;
+            generateSnapshotPackets(packets);
+            recorder->writeKeyframe(packets);
+        }else{
+            recorder->endTick();
+        }
     }
 
     handleBroadcastUDPSocket(delta);
 
-    if (listen_socket.accept(*new_socket))
+    //Accept all pending connections, so a burst of reconnects after a restart is handled right away instead of one per update.
+    //The budget keeps a connection flood from stalling the rest of the update.
+    for(int accept_count=0; accept_count<max_accepts_per_update && listen_socket.accept(*new_socket); accept_count++)
     {
         new_socket->setBlocking(false);
         new_socket->setDelay(false);
         newClientConnection(std::move(new_socket));
         new_socket = std::make_unique<sp::io::network::TcpSocket>();
     }
+    for(int accept_count=0; accept_count<max_accepts_per_update && new_local_socket && local_listen_socket.accept(*new_local_socket); accept_count++)
+    {
+        new_local_socket->setBlocking(false);
+        newClientConnection(std::move(new_local_socket));
+        new_local_socket = std::make_unique<sp::io::network::LocalSocket>();
+    }
 #ifdef STEAMSDK
-    auto steam_socket = listen_steam.accept();
-    if (steam_socket)
+    for(int accept_count=0; accept_count<max_accepts_per_update; accept_count++)
+    {
+        auto steam_socket = listen_steam.accept();
+        if (!steam_socket)
+            break;
         newClientConnection(std::move(steam_socket));
+    }
 #endif
 
     for(unsigned int n=0; n<clientList.size(); n++)
@@ -245,7 +294,9 @@ void GameServer::update(float /*gameDelta*/)
                         {
                             int32_t client_version;
                             string client_password;
-                            packet >> client_version >> client_password;
+                            bool client_compression = false;
+                            packet >> client_version >> client_password >> client_compression;
+                            clientList[n].compression = client_compression && compression_level > 0;
 
                             if (version_number == client_version || version_number == 0 || client_version == 0)
                             {
@@ -256,7 +307,7 @@ void GameServer::update(float /*gameDelta*/)
                                 }else{
                                     //Wrong password, send a new auth request so the client knows the password was not accepted.
                                     sp::io::DataBuffer auth_request_packet;
-                                    auth_request_packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "");
+                                    auth_request_packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "") << bool(compression_level > 0);
                                     clientList[n].socket->queue(auth_request_packet);
                                 }
                             }else{
@@ -308,19 +359,17 @@ void GameServer::update(float /*gameDelta*/)
                         }
                         break;
                     case CMD_CLIENT_COMMAND:
-                        packet >> clientList[n].command_object_id;
-                        clientList[n].command_client_id = clientList[n].client_id;
-                        clientList[n].receive_state = CRS_Command;
+                        handleClientCommands(clientList[n].client_id, packet);
                         break;
                     case CMD_PROXY_CLIENT_COMMAND:
                         {
                             int32_t client_id = 0;
-                            packet >> clientList[n].command_object_id >> client_id;
-                            clientList[n].command_client_id = clientList[n].client_id;
+                            packet >> client_id;
+                            int32_t command_client_id = clientList[n].client_id;
                             for(auto id : clientList[n].proxy_ids)
                                 if (id == client_id)
-                                    clientList[n].command_client_id = client_id;
-                            clientList[n].receive_state = CRS_Command;
+                                    command_client_id = client_id;
+                            handleClientCommands(command_client_id, packet);
                         }
                         break;
                     case CMD_AUDIO_COMM_START:
@@ -341,22 +390,25 @@ void GameServer::update(float /*gameDelta*/)
                         }
                         break;
                     case CMD_AUDIO_COMM_DATA:
-                        if (packet.getDataSize() > sizeof(int32_t) + sizeof(command_t))
                         {
-                            int32_t client_id;
-                            packet >> client_id;
-
-                            const unsigned char* ptr = reinterpret_cast<const unsigned char*>(packet.getData());
-                            ptr += sizeof(int32_t) + sizeof(command_t);
+                            int32_t client_id = 0;
+                            uint16_t sequence = 0;
+                            uint8_t flags = 0;
+                            packet >> client_id >> sequence >> flags;
+                            //The rest of the packet is the encoded audio.
+                            const unsigned char* ptr = static_cast<const unsigned char*>(packet.getReadData());
+                            int size = static_cast<int>(packet.available());
+                            if (size <= 0)
+                                break;
                             if (client_id == clientList[n].client_id)
                             {
-                                gotAudioPacket(client_id, ptr, static_cast<int>(packet.getDataSize()) - sizeof(int32_t) - sizeof(command_t));
+                                gotAudioPacket(client_id, sequence, flags, ptr, size);
                             }
                             else
                             {
                                 for(auto id : clientList[n].proxy_ids)
                                     if (id == client_id)
-                                        gotAudioPacket(client_id, ptr, static_cast<int>(packet.getDataSize()) - sizeof(int32_t) - sizeof(command_t));
+                                        gotAudioPacket(client_id, sequence, flags, ptr, size);
                             }
                         }
                         break;
@@ -386,15 +438,24 @@ void GameServer::update(float /*gameDelta*/)
                     }
                 }
                 break;
-            case CRS_Command:
-                if (objectMap.find(clientList[n].command_object_id) != objectMap.end() && objectMap[clientList[n].command_object_id])
-                    objectMap[clientList[n].command_object_id]->onReceiveClientCommand(clientList[n].command_client_id, packet);
-                clientList[n].receive_state = CRS_Main;
-                break;
             }
         }
         if (clientList[n].socket != NULL) {
             clientList[n].socket->sendSendQueue();
+            if (clientList[n].receive_state != CRS_Auth)
+            {
+                size_t queue_size = clientList[n].socket->getSendQueueSize();
+                if (queue_size > send_queue_max_size + clientList[n].resync_size)
+                {
+                    handleSendQueueOverflow(clientList[n]);
+                }
+                else if (queue_size <= send_queue_coalesce_size)
+                {
+                    clientList[n].resync_size = 0;
+                    if (!clientList[n].pending_updates.empty())
+                        sendPendingUpdates(clientList[n]);
+                }
+            }
         }
         if (clientList[n].socket == NULL || clientList[n].socket->getState() == sp::io::network::StreamSocket::State::Closed)
         {
@@ -444,18 +505,25 @@ void GameServer::handleNewClient(ClientInfo& info)
         packet << CMD_SET_CLIENT_ID << info.client_id;
         info.socket->queue(packet);
     }
+    //The client switches to decompressing right after the client id.
+    if (info.compression)
+        info.socket->setSendCompression(compression_level);
     {
         sp::io::DataBuffer packet;
         packet << CMD_SET_GAME_SPEED << lastGameSpeed;
         info.socket->queue(packet);
     }
+    {
+        sp::io::DataBuffer packet;
+        generateClassTablePacket(packet);
+        info.socket->queue(packet);
+    }
 
     onNewClient(info.client_id);
 
     //On a new client, first create all the already existing objects. And update all the values.
-    for(std::unordered_map<int32_t, P<MultiplayerObject> >::iterator i=objectMap.begin(); i != objectMap.end(); i++)
+    objects.forEach([this, &info](int32_t id, P<MultiplayerObject>& obj)
     {
-        P<MultiplayerObject> obj = i->second;
         if (obj && obj->replicated)
         {
             sp::io::DataBuffer packet;
@@ -463,7 +531,7 @@ void GameServer::handleNewClient(ClientInfo& info)
             sendDataCounter += packet.getDataSize();
             info.socket->queue(packet);
         }
-    }
+    });
 }
 
 void GameServer::handleNewProxy(ClientInfo& info, int32_t temp_id)
@@ -475,41 +543,103 @@ void GameServer::handleNewProxy(ClientInfo& info, int32_t temp_id)
         info.socket->queue(packet);
         nextclient_id++;
     }
-    {
-        sp::io::DataBuffer packet;
-        packet << CMD_SET_GAME_SPEED << lastGameSpeed;
-        info.socket->queue(packet);
-    }
 
+    //The proxy mirrors the world it received when it connected itself, and sends the new client a snapshot from that mirror.
+    // So a client joining behind a proxy does not cost us a full create burst.
     onNewClient(info.proxy_ids.back());
+}
 
-    //On a new client, first create all the already existing objects. And update all the values.
-    for(std::unordered_map<int32_t, P<MultiplayerObject> >::iterator i=objectMap.begin(); i != objectMap.end(); i++)
+
+void GameServer::handleClientCommands(int32_t client_id, sp::io::DataBuffer& packet)
+{
+    //A client sends all commands of a single update in one packet, split them up and hand them to the objects.
+    sp::io::DataBuffer prediction_ack;
+    while(packet.available())
     {
-        P<MultiplayerObject> obj = i->second;
-        if (obj && obj->replicated)
+        int32_t object_id = 0;
+        uint32_t size = 0;
+        packet >> object_id >> size;
+        if (size > packet.available())
         {
-            sp::io::DataBuffer packet;
-            generateCreatePacketFor(obj, packet);
-            sendDataCounter += packet.getDataSize();
-            info.socket->queue(packet);
+            LOG(ERROR) << "Malformed client command from client: " << client_id;
+            break;
+        }
+        client_command_packet.clear();
+        client_command_packet.appendRaw(packet.getReadData(), size);
+        packet.skip(size);
+
+        P<MultiplayerObject> obj = objects.get(object_id);
+        if (obj)
+        {
+            if (obj->client_prediction)
+            {
+                uint32_t sequence = 0;
+                client_command_packet >> sequence;
+                if (prediction_ack.getDataSize() == 0)
+                    prediction_ack << CMD_PREDICTION_ACK;
+                prediction_ack << object_id << sequence;
+            }
+            obj->onReceiveClientCommand(client_id, client_command_packet);
         }
     }
+    //Acknowledged after the commands are applied, so the updates that follow include their effects.
+    if (prediction_ack.getDataSize() > 0)
+        sendToClient(client_id, prediction_ack);
 }
 
+void GameServer::sendToClient(int32_t client_id, sp::io::DataBuffer& packet)
+{
+    for(auto& client : clientList)
+    {
+        if (!client.socket || client.receive_state != CRS_Main)
+            continue;
+        if (client.client_id == client_id)
+        {
+            client.socket->queue(packet, true);
+            return;
+        }
+        if (std::find(client.proxy_ids.begin(), client.proxy_ids.end(), client_id) != client.proxy_ids.end())
+        {
+            //The proxy only forwards the next packet to the listed clients.
+            sp::io::DataBuffer target_packet;
+            target_packet << CMD_PROXY_TO_CLIENTS << client_id;
+            client.socket->queue(target_packet, packet, true);
+            return;
+        }
+    }
+}
 
-void GameServer::handleBroadcastUDPSocket(float delta)
+void GameServer::replyToServerProbes(sp::io::network::UdpSocket& socket, int32_t version, const string& name, const std::function<int32_t()>& get_client_count, bool has_password)
 {
     sp::io::network::Address recvAddress;
     int recvPort;
     sp::io::DataBuffer recvPacket;
-    if (broadcast_listen_socket.receive(recvPacket, recvAddress, recvPort))
+    //Scanners probe all servers at once, so answer a burst of probes in one go, up to a limit.
+    for(int n=0; n<max_udp_replies_per_update && socket.receive(recvPacket, recvAddress, recvPort); n++)
     {
-        //We do not care about what we received. Reply that we live!
+        //Reply that we live! A probe also gets its token back, with how many clients there are, so the scanner can measure the ping.
         sp::io::DataBuffer sendPacket;
-        sendPacket << int32_t(multiplayerVerficationNumber) << int32_t(version_number) << server_name;
-        broadcast_listen_socket.send(sendPacket, recvAddress, recvPort);
+        sendPacket << int32_t(multiplayerVerficationNumber) << version << name;
+        int32_t verification = 0;
+        string query;
+        uint32_t token = 0;
+        recvPacket >> verification >> query >> token;
+        if (verification == multiplayerVerficationNumber && query == "ServerProbe")
+            sendPacket << token << get_client_count() << has_password;
+        socket.send(sendPacket, recvAddress, recvPort);
     }
+}
+
+void GameServer::handleBroadcastUDPSocket(float delta)
+{
+    replyToServerProbes(broadcast_listen_socket, version_number, server_name, [this]()
+    {
+        int32_t client_count = 0;
+        for(auto& client : clientList)
+            if (client.receive_state == CRS_Main)
+                client_count++;
+        return client_count;
+    }, !server_password.empty());
     if (boardcastServerDelay > 0.0f)
     {
         boardcastServerDelay -= delta;
@@ -532,22 +662,63 @@ void GameServer::newClientConnection(std::unique_ptr<sp::io::network::StreamSock
     nextclient_id++;
     {
         sp::io::DataBuffer packet;
-        packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "");
+        packet << CMD_REQUEST_AUTH << int32_t(version_number) << bool(server_password != "") << bool(compression_level > 0);
         info.socket->queue(packet);
     }
     LOG(INFO) << "New connection: " << info.client_id << " waiting for authentication";
     clientList.push_back(std::move(info));
 }
 
+GameServer::ObjectScope::ObjectScope(P<GameServer> server)
+: previous(object_scope_server), previous_active(object_scope_active), world_scope(server ? server->physics_world : nullptr)
+{
+    object_scope_server = server;
+    object_scope_active = true;
+}
+
+GameServer::ObjectScope::~ObjectScope()
+{
+    object_scope_server = previous;
+    object_scope_active = previous_active;
+}
+
+P<GameServer> GameServer::getObjectScopeServer()
+{
+    if (object_scope_active)
+        return object_scope_server;
+    return game_server;
+}
+
+P<GameServer> GameServer::getUpdateScopeServer(Updatable* obj)
+{
+    //With a single server everything already ends up on game_server, so skip the casts.
+    if (servers.size() < 2)
+        return nullptr;
+    if (auto server = dynamic_cast<GameServer*>(obj))
+        return server;
+    if (auto multiplayer_object = dynamic_cast<MultiplayerObject*>(obj))
+        return multiplayer_object->server;
+    return nullptr;
+}
+
+void GameServer::handleCollisions(float delta)
+{
+    foreach(GameServer, server, servers)
+    {
+        if (server != game_server)
+        {
+            ObjectScope scope(server);
+            CollisionManager::handleCollisions(server->physics_world.get(), delta);
+        }
+    }
+}
+
 void GameServer::registerObject(P<MultiplayerObject> obj)
 {
     //Note, at this point in time, the pointed object is only of the MultiplayerObject class.
     // This due to the fact that in C++ does not "is" it's final sub-class till construction is completed.
-    obj->multiplayerObjectId = nextObjectId;
+    obj->multiplayerObjectId = objects.add(obj);
     obj->replicated = false;
-    nextObjectId++;
-
-    objectMap[obj->multiplayerObjectId] = obj;
 }
 
 void GameServer::setPassword(string password)
@@ -555,14 +726,62 @@ void GameServer::setPassword(string password)
     server_password = password;
 }
 
+void GameServer::setClientSendQueueLimits(size_t coalesce_size, size_t max_size, SendQueueOverflowPolicy policy)
+{
+    send_queue_coalesce_size = coalesce_size;
+    send_queue_max_size = max_size;
+    send_queue_overflow_policy = policy;
+}
+
+std::vector<GameServer::ClientSendQueueInfo> GameServer::getClientSendQueueInfo()
+{
+    std::vector<ClientSendQueueInfo> result;
+    for(auto& client : clientList)
+    {
+        if (!client.socket)
+            continue;
+        ClientSendQueueInfo info;
+        info.client_id = client.client_id;
+        info.queued_bytes = client.socket->getSendQueueSize();
+        info.pending_objects = client.pending_updates.size();
+        info.resync_count = client.resync_count;
+        info.ping = client.ping;
+        result.push_back(info);
+    }
+    return result;
+}
+
+sp::io::StreamCompression::Stats GameServer::getCompressionStats()
+{
+    sp::io::StreamCompression::Stats stats;
+    for(auto& client : clientList)
+        if (client.socket)
+            stats += client.socket->getSendCompressionStats();
+    return stats;
+}
+
+void GameServer::generateClassTablePacket(sp::io::DataBuffer& packet)
+{
+    const auto& table = MultiplayerClassListItem::getClassTable();
+    packet << CMD_SET_CLASS_TABLE << uint16_t(table.size());
+    for(auto item : table)
+        packet << item->name;
+}
+
 void GameServer::generateCreatePacketFor(P<MultiplayerObject> obj, sp::io::DataBuffer& packet)
 {
-    packet << CMD_CREATE << obj->multiplayerObjectId << obj->multiplayerClassIdentifier;
+    if (obj->multiplayerClassId == MultiplayerClassListItem::noClassId)
+    {
+        obj->multiplayerClassId = MultiplayerClassListItem::getClassId(obj->multiplayerClassIdentifier);
+        if (obj->multiplayerClassId == MultiplayerClassListItem::noClassId)
+            LOG(WARNING) << "Replicating object of unregistered multiplayer class: " << obj->multiplayerClassIdentifier;
+    }
+    packet << CMD_CREATE << obj->multiplayerObjectId << obj->multiplayerClassId;
 
-    for(unsigned int n=0; n<obj->memberReplicationInfo.size(); n++)
+    for(unsigned int n=0; n<obj->getMemberReplicationCount(); n++)
     {
         packet << int16_t(n);
-        (obj->memberReplicationInfo[n].sendFunction)(obj->memberReplicationInfo[n].ptr, packet);
+        obj->sendMemberReplication(n, packet);
     }
 }
 
@@ -573,10 +792,10 @@ void GameServer::generateDeletePacketFor(int32_t id, sp::io::DataBuffer& packet)
 
 void GameServer::broadcastServerCommandFromObject(int32_t id, sp::io::DataBuffer& packet)
 {
-    sp::io::DataBuffer p;
-    p << CMD_SERVER_COMMAND << id;
-    p.appendRaw(packet.getData(), packet.getDataSize());
-    sendAll(p);
+    auto p = packet_pool.borrow();
+    *p << CMD_SERVER_COMMAND << id;
+    p->appendRaw(packet.getData(), packet.getDataSize());
+    sendAll(*p, true);
 }
 
 void GameServer::keepAliveAll()
@@ -584,6 +803,8 @@ void GameServer::keepAliveAll()
     sp::io::DataBuffer packet;
     packet << CMD_ALIVE;
     sendDataCounterPerClient += packet.getDataSize();
+    if (recorder)
+        recorder->addPacket(packet);
     for(auto& client : clientList)
     {
         if (client.socket)
@@ -594,16 +815,146 @@ void GameServer::keepAliveAll()
     }
 }
 
-void GameServer::sendAll(sp::io::DataBuffer& packet)
+void GameServer::sendAll(sp::io::DataBuffer& packet, bool keep_on_resync)
 {
     sendDataCounterPerClient += packet.getDataSize();
+    if (recorder)
+        recorder->addPacket(packet);
     for(auto& client : clientList)
     {
         if (client.receive_state != CRS_Auth && client.socket)
+            client.socket->queue(packet, keep_on_resync);
+    }
+}
+
+void GameServer::sendUpdate(int32_t id, sp::io::DataBuffer& packet)
+{
+    sendDataCounterPerClient += packet.getDataSize();
+    if (recorder)
+        recorder->addPacket(packet);
+    for(auto& client : clientList)
+    {
+        if (client.receive_state == CRS_Auth || !client.socket)
+            continue;
+        //Keep coalescing till the pending values are send, a delta queued before those would apply to the wrong value on the client.
+        if (client.socket->getSendQueueSize() > send_queue_coalesce_size || !client.pending_updates.empty())
+        {
+            //This client is not keeping up, do not grow its queue with values that will be outdated by the time they arrive.
+            auto& pending = client.pending_updates[id];
+            for(auto n : changed_members)
+            {
+                if (pending.size() <= n)
+                    pending.resize(n + 1, false);
+                pending[n] = true;
+            }
+        }else{
             client.socket->queue(packet);
+        }
     }
 }
 
+void GameServer::sendPendingUpdates(ClientInfo& client)
+{
+    for(auto& it : client.pending_updates)
+    {
+        P<MultiplayerObject> obj = objects.get(it.first);
+        //Objects deleted in the mean time already had their delete packet queued.
+        if (!obj || !obj->replicated)
+            continue;
+        auto packet = packet_pool.borrow();
+        *packet << CMD_UPDATE_VALUE << it.first;
+        for(unsigned int n=0; n<it.second.size() && n<obj->getMemberReplicationCount(); n++)
+        {
+            if (it.second[n])
+            {
+                *packet << int16_t(n);
+                obj->sendMemberReplication(n, *packet);
+            }
+        }
+        sendDataCounter += packet->getDataSize();
+        client.socket->queue(*packet);
+    }
+    client.pending_updates.clear();
+}
+
+void GameServer::handleSendQueueOverflow(ClientInfo& client)
+{
+    switch(send_queue_overflow_policy)
+    {
+    case SendQueueOverflowPolicy::Disconnect:
+        LOG(WARNING) << "Send queue of client " << client.client_id << " overflowed (" << client.socket->getSendQueueSize() << " bytes), disconnecting";
+        client.socket->close();
+        break;
+    case SendQueueOverflowPolicy::Resync:
+        LOG(WARNING) << "Send queue of client " << client.client_id << " overflowed (" << client.socket->getSendQueueSize() << " bytes), resyncing";
+        {
+            //Server commands (like the ticks of a lockstep simulation) are events the snapshot does not recreate, those still go out after it.
+            auto kept = client.socket->dropUnsentQueue();
+            client.pending_updates.clear();
+            client.resync_count++;
+            std::vector<sp::io::DataBuffer> packets;
+            generateSnapshotPackets(packets);
+            for(auto& packet : packets)
+            {
+                sendDataCounter += packet.getDataSize();
+                client.socket->queue(packet);
+            }
+            client.socket->requeue(kept);
+        }
+        client.resync_size = client.socket->getSendQueueSize();
+        break;
+    }
+}
+
+void GameServer::generateSnapshotPackets(std::vector<sp::io::DataBuffer>& packets)
+{
+    {
+        //Tell the client which objects still exist, as it might have missed the delete packets of the others.
+        sp::io::DataBuffer packet;
+        uint32_t count = 0;
+        objects.forEach([&count](int32_t id, P<MultiplayerObject>& obj) { if (obj && obj->replicated) count++; });
+        packet << CMD_RESYNC << count;
+        objects.forEach([&packet](int32_t id, P<MultiplayerObject>& obj) { if (obj && obj->replicated) packet << id; });
+        packets.emplace_back(std::move(packet));
+    }
+    {
+        sp::io::DataBuffer packet;
+        packet << CMD_SET_GAME_SPEED << lastGameSpeed;
+        packets.emplace_back(std::move(packet));
+    }
+    {
+        sp::io::DataBuffer packet;
+        generateClassTablePacket(packet);
+        packets.emplace_back(std::move(packet));
+    }
+    objects.forEach([this, &packets](int32_t id, P<MultiplayerObject>& obj)
+    {
+        if (obj && obj->replicated)
+        {
+            sp::io::DataBuffer packet;
+            generateCreatePacketFor(obj, packet);
+            packets.emplace_back(std::move(packet));
+        }
+    });
+}
+
+bool GameServer::startRecording(const string& filename, float keyframe_interval)
+{
+    recorder = std::make_unique<MultiplayerRecorder>();
+    if (!recorder->open(filename, version_number, keyframe_interval))
+    {
+        recorder = nullptr;
+        return false;
+    }
+    LOG(INFO) << "Recording replication stream to " << filename;
+    return true;
+}
+
+void GameServer::stopRecording()
+{
+    recorder = nullptr;
+}
+
 void GameServer::registerOnMasterServer(string master_url)
 {
     stopMasterServerRegistry();
@@ -684,15 +1035,15 @@ void GameServer::startAudio(int32_t client_id, int32_t target_identifier)
         audio_stream_manager.start(client_id);
 }
 
-void GameServer::gotAudioPacket(int32_t client_id, const unsigned char* packet, int packet_size)
+void GameServer::gotAudioPacket(int32_t client_id, uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size)
 {
     sp::io::DataBuffer audio_packet;
-    audio_packet << CMD_AUDIO_COMM_DATA << client_id;
+    audio_packet << CMD_AUDIO_COMM_DATA << client_id << sequence << flags;
     audio_packet.appendRaw(packet, packet_size);
     sendAudioPacketFrom(client_id, audio_packet);
 
     if (client_id != 0)
-        audio_stream_manager.receivedPacketFromNetwork(client_id, packet, packet_size);
+        audio_stream_manager.receivedPacketFromNetwork(client_id, sequence, flags, packet, packet_size);
 }
 
 void GameServer::stopAudio(int32_t client_id)
@@ -719,9 +1070,10 @@ void GameServer::sendAudioPacketFrom(int32_t client_id, sp::io::DataBuffer& pack
         if (client.receive_state != CRS_Auth && client.socket)
         {
             bool send = ids.find(client.client_id) != ids.end();
+            bool targeted = false;
+            sp::io::DataBuffer target_packet;
             if (client.proxy_ids.size() > 0)
             {
-                sp::io::DataBuffer target_packet;
                 target_packet << CMD_PROXY_TO_CLIENTS;
                 for(auto id : client.proxy_ids)
                 {
@@ -729,12 +1081,17 @@ void GameServer::sendAudioPacketFrom(int32_t client_id, sp::io::DataBuffer& pack
                     {
                         target_packet << id;
                         send = true;
+                        targeted = true;
                     }
                 }
             }
             if (send)
             {
-                client.socket->queue(packet);
+                //The proxy only forwards the next packet to the listed clients.
+                if (targeted)
+                    client.socket->queue(target_packet, packet);
+                else
+                    client.socket->queue(packet);
             }
         }
     }
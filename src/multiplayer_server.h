@@ -5,18 +5,25 @@
 #include "io/network/tcpSocket.h"
 #include "io/network/streamSocket.h"
 #include "io/network/tcpListener.h"
+#include "io/network/localListener.h"
+#include "io/network/localSocket.h"
 #ifdef STEAMSDK
 #include "io/network/steamP2PListener.h"
 #endif
 #include "Updatable.h"
+#include "collisionable.h"
 #include "stringImproved.h"
 #include "networkAudioStream.h"
+#include "multiplayer_object_table.h"
+#include "multiplayer_recording.h"
+#include "io/dataBufferPool.h"
 #include "timer.h"
 
 #include <stdint.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <thread>
+#include <functional>
 
 
 static const int defaultServerPort = 35666;
@@ -24,7 +31,9 @@ static const int multiplayerVerficationNumber = 0x2fab3f0f; //Used to verify tha
 
 class GameServer;
 class MultiplayerObject;
+class Collisionable;
 
+//The first server that is created. Objects created outside of a GameServer::ObjectScope register with this server.
 extern P<GameServer> game_server;
 
 class GameServer : public Updatable
@@ -38,14 +47,61 @@ public:
         FailedToReachMasterServer,
         FailedPortForwarding,
     };
+    //What to do with a client whose send queue grows beyond the configured maximum.
+    enum class SendQueueOverflowPolicy
+    {
+        Resync,     //Drop the queued replication data and send a fresh snapshot of all objects. Server commands are still delivered.
+        Disconnect, //Drop the connection.
+    };
+    struct ClientSendQueueInfo
+    {
+        int32_t client_id;
+        size_t queued_bytes;
+        size_t pending_objects; //Objects with coalesced updates waiting for the queue to drain.
+        int resync_count;
+        int32_t ping;   //Round trip time in milliseconds, measured with the keep alive packets.
+    };
+    /**
+        Multiple servers can run in the same process, each with its own objects, clients, listen port and physics world.
+        New multiplayer objects register with the server of the innermost living ObjectScope, or with game_server if there is none.
+        The scope also puts new collisionables in the physics world of the server.
+            {
+                GameServer::ObjectScope scope(second_server);
+                new SpaceShip(); //Replicated by second_server, and only collides with objects of second_server.
+            }
+        The engine updates the objects of each server in the scope of that server, and reports their collisions in it,
+        so objects they create end up on the same server. A scope with a null server creates plain local objects without physics bodies.
+     */
+    class ObjectScope : sp::NonCopyable
+    {
+    public:
+        ObjectScope(P<GameServer> server);
+        ~ObjectScope();
+    private:
+        P<GameServer> previous;
+        bool previous_active;
+        CollisionManager::WorldScope world_scope;
+    };
+    //The server new multiplayer objects register with, null on a client.
+    static P<GameServer> getObjectScopeServer();
+    //The server to update obj in the scope of, null when there is no need for a scope.
+    static P<GameServer> getUpdateScopeServer(Updatable* obj);
+    //Step the physics worlds of the servers that have their own, the engine does this after stepping the default world.
+    static void handleCollisions(float delta);
+    //Answer the discovery requests that arrived on the UDP socket of a server or proxy, up to max_udp_replies_per_update per call.
+    //A probe of a ServerScanner also gets its token back, with the client count and if a password is needed.
+    static void replyToServerProbes(sp::io::network::UdpSocket& socket, int32_t version, const string& name, const std::function<int32_t()>& get_client_count, bool has_password);
 
 private:
     sp::SystemStopwatch last_update_time;
     sp::SystemTimer keep_alive_send_timer;
     sp::io::network::UdpSocket broadcast_listen_socket;
+    static constexpr int max_udp_replies_per_update = 64;
     
     sp::io::network::TcpListener listen_socket;
     std::unique_ptr<sp::io::network::TcpSocket> new_socket;
+    sp::io::network::LocalListener local_listen_socket;
+    std::unique_ptr<sp::io::network::LocalSocket> new_local_socket;
 #ifdef STEAMSDK
     sp::io::network::SteamP2PListener listen_steam;
 #endif
@@ -66,27 +122,46 @@ private:
     enum EClientReceiveState
     {
         CRS_Auth,
-        CRS_Main,
-        CRS_Command
+        CRS_Main
     };
     struct ClientInfo
     {
         std::unique_ptr<sp::io::network::StreamSocket> socket;
         int32_t client_id;
-        int32_t command_client_id;
         EClientReceiveState receive_state;
-        int32_t command_object_id;
         sp::SystemStopwatch round_trip_start_time;
-        int32_t ping;
+        int32_t ping = 0;
         std::vector<int32_t> proxy_ids;
+        //Members that changed while this client was lagging behind, per object id. Only the latest values get send once it catches up.
+        std::unordered_map<int32_t, std::vector<bool>> pending_updates;
+        int resync_count = 0;
+        size_t resync_size = 0; //Size of the last resync snapshot, which is allowed on top of the maximum queue size till the queue drained.
+        bool compression = false;   //The client accepted compression in its auth reply.
     };
     int32_t nextclient_id;
     std::vector<ClientInfo> clientList;
     std::unordered_map<int32_t, std::unordered_set<int32_t>> voice_targets;
     NetworkAudioStreamManager audio_stream_manager;
+    sp::io::DataBuffer client_command_packet;
+    std::vector<uint16_t> changed_members;
+    sp::io::DataBufferPool packet_pool;
 
-    int32_t nextObjectId;
-    std::unordered_map<int32_t, P<MultiplayerObject> > objectMap;
+    int compression_level = 0;
+    size_t send_queue_coalesce_size = 64 * 1024;
+    size_t send_queue_max_size = 8 * 1024 * 1024;
+    SendQueueOverflowPolicy send_queue_overflow_policy = SendQueueOverflowPolicy::Resync;
+
+    MultiplayerObjectTable<MultiplayerObject> objects;
+    //Collisionables that make the objects around them replicate more often. Shared with the replication data of our objects, as those can outlive us.
+    std::shared_ptr<PVector<Collisionable>> significant_collisionables;
+    std::unique_ptr<MultiplayerRecorder> recorder;
+
+    //The first server uses the default physics world, later servers get their own.
+    std::shared_ptr<b2World> physics_world;
+
+    static P<GameServer> object_scope_server;
+    static bool object_scope_active;
+    static PVector<GameServer> servers;
 
     string master_server_url;
     std::thread master_server_update_thread;
@@ -96,6 +171,9 @@ public:
     virtual ~GameServer();
 
     void connectToProxy(sp::io::network::Address address, int port = defaultServerPort);
+    //Also accept connections on a unix domain socket, for a proxy running on the same machine.
+    //Clients connecting there are handled exactly like TCP clients, but skip the TCP/IP stack.
+    bool listenLocal(const string& path);
 
     virtual void destroy() override;
 
@@ -113,22 +191,56 @@ public:
     void stopMasterServerRegistry();
     void setPassword(string password);
 
+    //Clients with more then coalesce_size bytes queued no longer get every update, but only the latest value of each changed member once their queue drains.
+    //Clients with more then max_size bytes queued are handled according to the overflow policy.
+    void setClientSendQueueLimits(size_t coalesce_size, size_t max_size, SendQueueOverflowPolicy policy);
+    std::vector<ClientSendQueueInfo> getClientSendQueueInfo();
+    //Allocation statistics of the buffers used to build packets.
+    const sp::io::DataBufferPool::Stats& getPacketPoolStats() { return packet_pool.getStats(); }
+
+    //Offer compression of everything send to clients with the given level (1-9, 0 disables it), see io/streamCompression.h.
+    //Clients that accept it get compressed packets after their client id, each with its own compression history.
+    //Changing the level only affects clients that connect afterwards.
+    void setCompressionLevel(int level) { compression_level = level; }
+    //Compression statistics summed over the connected clients.
+    sp::io::StreamCompression::Stats getCompressionStats();
+
+    //Keep alive packets are also used to measure the ping of each client, so load tests might want them more often.
+    void setKeepAliveInterval(float interval) { keep_alive_send_timer.repeat(interval); }
+
+    //Record everything that is broadcast to the clients, with a full snapshot of the world every keyframe_interval seconds.
+    bool startRecording(const string& filename, float keyframe_interval = 10.0f);
+    void stopRecording();
+    bool isRecording() { return recorder != nullptr; }
+
     void startAudio(int32_t client_id, int32_t target_identifier);
-    void gotAudioPacket(int32_t client_id, const unsigned char* packet, int packet_size);
+    //The packets of a client are numbered in sequence, flags are NetworkAudioStream::flag_*.
+    void gotAudioPacket(int32_t client_id, uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size);
     void stopAudio(int32_t client_id);
     void sendAudioPacketFrom(int32_t client_id, sp::io::DataBuffer& packet);
+    //Voice level of a client that talks to the server, from 0.0 to 1.0, see NetworkAudioStream::getLevel.
+    float getVoiceLevel(int32_t client_id) { return audio_stream_manager.getLevel(client_id); }
+    NetworkAudioStream::Stats getVoiceStats(int32_t client_id) { return audio_stream_manager.getStats(client_id); }
 private:
     void newClientConnection(std::unique_ptr<sp::io::network::StreamSocket> socket);
     void registerObject(P<MultiplayerObject> obj);
     void broadcastServerCommandFromObject(int32_t id, sp::io::DataBuffer& packet);
     void keepAliveAll();
-    void sendAll(sp::io::DataBuffer& packet);
+    //Packets send with keep_on_resync survive the resync of a client that fell behind, see handleSendQueueOverflow.
+    void sendAll(sp::io::DataBuffer& packet, bool keep_on_resync = false);
+    void sendToClient(int32_t client_id, sp::io::DataBuffer& packet);
+    void sendUpdate(int32_t id, sp::io::DataBuffer& packet);
+    void sendPendingUpdates(ClientInfo& client);
+    void handleSendQueueOverflow(ClientInfo& client);
+    void generateSnapshotPackets(std::vector<sp::io::DataBuffer>& packets);
 
+    void generateClassTablePacket(sp::io::DataBuffer& packet);
     void generateCreatePacketFor(P<MultiplayerObject> obj, sp::io::DataBuffer& packet);
     void generateDeletePacketFor(int32_t id, sp::io::DataBuffer& packet);
     
     void handleNewClient(ClientInfo& info);
     void handleNewProxy(ClientInfo& info, int32_t temp_id);
+    void handleClientCommands(int32_t client_id, sp::io::DataBuffer& packet);
     
     void runMasterServerUpdateThread();
     
@@ -1,10 +1,14 @@
 #include "multiplayer_server_scanner.h"
 #include "io/http/request.h"
+#include <random>
 using namespace std::chrono_literals;
 
 ServerScanner::ServerScanner(int version_number, int server_port)
 : server_port(server_port), version_number(version_number)
 {
+    //Replies have to echo the token of a probe, so start somewhere that can not be guessed.
+    next_probe_token = std::random_device()();
+    last_probe_update = std::chrono::steady_clock::now();
 }
 
 ServerScanner::~ServerScanner()
@@ -51,6 +55,7 @@ void ServerScanner::update(float /*gameDelta*/)
     }
     master_server_update_list.clear();
     master_server_list_mutex.unlock();
+    updateProbes();
     for(unsigned int n=0; n<server_list.size(); n++)
     {
         if (server_list[n].timeout.isExpired())
@@ -103,16 +108,111 @@ void ServerScanner::updateServerEntry(const ServerInfo& info)
     LOG(INFO) << "ServerScanner::New server: " << info.address.getHumanReadable()[0] << " " << info.port << " " << info.name;
     ServerInfo si = info;
     si.timeout.start(ServerTimeout);
+    si.next_probe_time = std::chrono::steady_clock::now();
     server_list.push_back(si);
     
     if (newServerCallback)
         newServerCallback(si);
 }
 
-void ServerScanner::addCallbacks(std::function<void(const ServerInfo&)> newServerCallbackIn, std::function<void(const ServerInfo&)> removedServerCallbackIn)
+void ServerScanner::addCallbacks(std::function<void(const ServerInfo&)> newServerCallbackIn, std::function<void(const ServerInfo&)> removedServerCallbackIn, std::function<void(const ServerInfo&)> updatedServerCallbackIn)
 {
     this->newServerCallback = newServerCallbackIn;
     this->removedServerCallback = removedServerCallbackIn;
+    this->updatedServerCallback = updatedServerCallbackIn;
+}
+
+void ServerScanner::updateProbes()
+{
+    auto now = std::chrono::steady_clock::now();
+    float delta = std::chrono::duration<float>(now - last_probe_update).count();
+    last_probe_update = now;
+    //Allow bursts of a tenth of a second worth of probes, so a big list still gets probed at an even pace.
+    probe_budget = std::min(probe_budget + delta * probe_rate, std::max(1.0f, probe_rate * 0.1f));
+
+    if (!probe_socket)
+    {
+        probe_socket = std::make_unique<sp::io::network::UdpSocket>();
+        if (!probe_socket->bind(0))
+            LOG(ERROR, "Failed to create socket for server probes");
+        probe_socket->setBlocking(false);
+    }
+
+    sp::io::network::Address recv_address;
+    int recv_port;
+    sp::io::DataBuffer recv_packet;
+    while(probe_socket->receive(recv_packet, recv_address, recv_port))
+    {
+        int32_t verification = 0, version_nr = 0;
+        string name;
+        uint32_t token = 0;
+        int32_t client_count = -1;
+        bool has_password = false;
+        recv_packet >> verification >> version_nr >> name >> token >> client_count >> has_password;
+        if (verification != multiplayerVerficationNumber)
+            continue;
+        for(auto& info : server_list)
+        {
+            if (!info.probe_pending || info.probe_token != token)
+                continue;
+            info.probe_pending = false;
+            info.probe_attempts = 0;
+            info.ping = std::chrono::duration<float, std::milli>(now - info.probe_send_time).count();
+            info.client_count = client_count;
+            info.has_password = has_password;
+            info.next_probe_time = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(ProbeInterval));
+            if (updatedServerCallback)
+                updatedServerCallback(info);
+            break;
+        }
+    }
+
+    size_t pending = 0;
+    for(auto& info : server_list)
+    {
+        if (!info.probe_pending || now - info.probe_send_time < std::chrono::duration<float>(ProbeTimeout))
+        {
+            pending += info.probe_pending ? 1 : 0;
+            continue;
+        }
+        info.probe_pending = false;
+        info.probe_attempts++;
+        if (info.probe_attempts < ProbeRetries)
+        {
+            info.next_probe_time = now;
+            continue;
+        }
+        //No reply to any of the retries, report it as not responding and try again later.
+        info.probe_attempts = 0;
+        info.next_probe_time = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(ProbeInterval));
+        bool was_responding = info.ping >= 0.0f;
+        info.ping = -1.0f;
+        if (was_responding && updatedServerCallback)
+            updatedServerCallback(info);
+    }
+
+    //Continue after the last probed server next time, so every server gets its turn.
+    size_t start_index = next_probe_index;
+    size_t probed_until = 0;
+    for(size_t n=0; n<server_list.size() && probe_budget >= 1.0f && pending < MaxPendingProbes; n++)
+    {
+        auto& info = server_list[(start_index + n) % server_list.size()];
+        //Steam friends have no address to probe.
+        if (info.probe_pending || info.type == ServerType::SteamFriend || now < info.next_probe_time)
+            continue;
+        info.probe_token = next_probe_token++;
+        info.probe_send_time = now;
+        info.probe_pending = true;
+        pending++;
+        probe_budget -= 1.0f;
+
+        sp::io::DataBuffer probe;
+        probe << int32_t(multiplayerVerficationNumber) << string("ServerProbe") << info.probe_token;
+        probe_socket->send(probe, info.address, int(info.port));
+        probed_until = n + 1;
+    }
+    if (!server_list.empty())
+        next_probe_index = (start_index + probed_until) % server_list.size();
 }
 
 std::vector<ServerScanner::ServerInfo> ServerScanner::getServerList()
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include "multiplayer_server.h"
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -26,6 +27,18 @@ public:
         string name;
 
         sp::SystemTimer timeout;
+
+        //Filled in by the UDP probes, ping is -1 until the first reply and after the server stopped replying.
+        float ping = -1.0f;     //Round trip time in milliseconds.
+        int32_t client_count = -1;
+        bool has_password = false;
+
+        //Probe state, only used by the scanner.
+        uint32_t probe_token = 0;
+        bool probe_pending = false;
+        int probe_attempts = 0;
+        std::chrono::steady_clock::time_point probe_send_time{};
+        std::chrono::steady_clock::time_point next_probe_time{};
     };
 
     ServerScanner(int version_number, int server_port = defaultServerPort);
@@ -34,10 +47,13 @@ public:
     virtual void destroy() override;
 
     virtual void update(float delta) override;
-    void addCallbacks(std::function<void(const ServerInfo&)> newServerCallback, std::function<void(const ServerInfo&)> removedServerCallback);
+    //The updated callback is called for every probe reply, and when a server stops replying to probes.
+    void addCallbacks(std::function<void(const ServerInfo&)> newServerCallback, std::function<void(const ServerInfo&)> removedServerCallback, std::function<void(const ServerInfo&)> updatedServerCallback = nullptr);
     
     void scanLocalNetwork();
     void scanMasterServer(string url);
+    //Probe every listed server over UDP to measure its ping, with at most probes_per_second probes send each second.
+    void setProbeRate(float probes_per_second) { probe_rate = probes_per_second; }
 
     std::vector<ServerInfo> getServerList();
 
@@ -45,6 +61,7 @@ private:
     void masterServerScanThread();
     
     void updateServerEntry(const ServerInfo& info);
+    void updateProbes();
 
     int server_port;
     std::unique_ptr<sp::io::network::UdpSocket> socket;
@@ -54,6 +71,17 @@ private:
     int version_number;
     constexpr static float BroadcastTimeout = 2.0f;
     constexpr static float ServerTimeout = 30.0f;
+    constexpr static float ProbeTimeout = 1.0f;
+    constexpr static float ProbeInterval = 10.0f;
+    constexpr static int ProbeRetries = 3;
+    constexpr static size_t MaxPendingProbes = 64;
+
+    std::unique_ptr<sp::io::network::UdpSocket> probe_socket;
+    float probe_rate = 100.0f;
+    float probe_budget = 0.0f;
+    uint32_t next_probe_token;
+    size_t next_probe_index = 0;    //Where the next round of probes starts, so a low rate still reaches every server.
+    std::chrono::steady_clock::time_point last_probe_update;
 
     string master_server_url;
     std::mutex master_server_list_mutex;
@@ -63,6 +91,7 @@ private:
 
     std::function<void(const ServerInfo&)> newServerCallback;
     std::function<void(const ServerInfo&)> removedServerCallback;
+    std::function<void(const ServerInfo&)> updatedServerCallback;
 };
 
 #endif//MULTIPLAYER_SERVER_SCANER_H
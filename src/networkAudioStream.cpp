@@ -1,78 +1,353 @@
 #include "networkAudioStream.h"
 #include "logging.h"
 
-#include <array>
+#include <algorithm>
+#include <cmath>
 #include <opus.h>
 
 
 NetworkAudioStream::NetworkAudioStream()
 {
-    sample_rate = 44100;
-    
-    //Reserve 10 seconds of playback in our buffers.
-    samples.reserve(sample_rate * 10);
-    
+    stats.target_depth = target_depth;
+
     int error = 0;
-    decoder = opus_decoder_create(48000, 1, &error);
+    decoder = opus_decoder_create(decoder_rate, 1, &error);
+    if (!decoder)
+        LOG(ERROR) << "Failed to create opus decoder:" << error;
+}
+
+NetworkAudioStream::~NetworkAudioStream()
+{
+    stop();
+    if (decoder)
+        opus_decoder_destroy(decoder);
+}
+
+void NetworkAudioStream::reset()
+{
+    QueuedPacket packet;
+    packet.type = QueuedPacket::Type::Reset;
+    packet_queue.push(packet);
+}
+
+void NetworkAudioStream::receivedPacketFromNetwork(uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size)
+{
+    if (packet_size > max_packet_size)
+    {
+        oversized_packets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    QueuedPacket queued;
+    queued.sequence = sequence;
+    queued.flags = flags;
+    queued.size = uint16_t(packet_size);
+    queued.arrival = Clock::now();
+    std::copy(packet, packet + packet_size, queued.data.begin());
+    packet_queue.push(queued);
+    if (!isPlaying())
+        start();
+}
+
+void NetworkAudioStream::finalize()
+{
+    QueuedPacket packet;
+    packet.type = QueuedPacket::Type::Finalize;
+    packet_queue.push(packet);
+    //The mixer stops the playback once it got here.
+    if (!isPlaying())
+        start();
+}
+
+bool NetworkAudioStream::isFinished()
+{
+    return !isPlaying() && packet_queue.available() == 0;
+}
+
+float NetworkAudioStream::getLevel()
+{
+    auto age = Clock::now() - Clock::time_point(Clock::duration(level_time.load(std::memory_order_relaxed)));
+    if (std::chrono::duration<float>(age).count() > level_timeout)
+        return 0.0f;
+    return level.load(std::memory_order_relaxed);
+}
+
+NetworkAudioStream::Stats NetworkAudioStream::getStats()
+{
+    Stats result;
+    result.packets = stats.packets.load(std::memory_order_relaxed);
+    result.late_packets = stats.late_packets.load(std::memory_order_relaxed);
+    result.recovered_packets = stats.recovered_packets.load(std::memory_order_relaxed);
+    result.concealed_packets = stats.concealed_packets.load(std::memory_order_relaxed);
+    result.dropped_packets = stats.dropped_packets.load(std::memory_order_relaxed) + oversized_packets.load(std::memory_order_relaxed);
+    result.underruns = stats.underruns.load(std::memory_order_relaxed);
+    result.overruns = packet_queue.getOverruns();
+    result.jitter = stats.jitter.load(std::memory_order_relaxed);
+    result.target_depth = stats.target_depth.load(std::memory_order_relaxed);
+    result.max_mix_time = stats.max_mix_time.load(std::memory_order_relaxed);
+    size_t calls = stats.mix_calls.load(std::memory_order_relaxed);
+    if (calls > 0)
+        result.average_mix_time = stats.total_mix_time.load(std::memory_order_relaxed) / float(calls);
+    return result;
 }
 
 void NetworkAudioStream::onMixSamples(int16_t* stream, int sample_count)
 {
-    std::lock_guard<std::mutex> guard(samples_lock);    //Get exclusive access to the samples vector.
+    auto start_time = Clock::now();
+    processQueue();
+
+    size_t needed = size_t(sample_count / 2);
+    while(samples.available() < needed && samples.space() >= size_t(frame_size) && decodeFrame())
+    {
+    }
 
-    //Copy all new samples to the playback buffer. And clear our sample buffer.
-    int mix_count = std::min(sample_count / 2, int(samples.size()));
-    for(int index=0; index<mix_count; index++) {
-        int sample = samples[index];
-        mix(stream[index*2+0], sample);
-        mix(stream[index*2+1], sample);
+    std::array<int16_t, 512> chunk;
+    int index = 0;
+    while(index < sample_count / 2)
+    {
+        size_t count = samples.read(chunk.data(), std::min({chunk.size(), size_t(sample_count / 2 - index), samples.available()}));
+        if (count == 0)
+            break;
+        for(size_t n=0; n<count; n++, index++)
+        {
+            int sample = chunk[n];
+            mix(stream[index*2+0], sample);
+            mix(stream[index*2+1], sample);
+        }
     }
-    samples.erase(samples.begin(), samples.begin() + mix_count);
-    
-    //Stop playback if the buffer is empty.
-    if (samples.empty())
+
+    //Stop playback when the transmission ended and everything is played.
+    if (samples.available() == 0 && finalized && buffered == 0)
         stop();
+
+    float time = std::chrono::duration<float>(Clock::now() - start_time).count();
+    if (time > stats.max_mix_time.load(std::memory_order_relaxed))
+        stats.max_mix_time.store(time, std::memory_order_relaxed);
+    stats.total_mix_time.store(stats.total_mix_time.load(std::memory_order_relaxed) + time, std::memory_order_relaxed);
+    stats.mix_calls.fetch_add(1, std::memory_order_relaxed);
 }
 
-void NetworkAudioStream::receivedPacketFromNetwork(const unsigned char* packet, int packet_size)
+void NetworkAudioStream::processQueue()
 {
-    std::array<int16_t, 2880> samples_buffer{};
-    int sample_count = opus_decode(decoder, packet, packet_size, samples_buffer.data(), static_cast<int>(samples_buffer.size()), 0);
-    if (sample_count > 0)
+    while(const QueuedPacket* packet = packet_queue.front())
     {
-        std::lock_guard<std::mutex> guard(samples_lock);
-        this->samples.insert(this->samples.end(), samples_buffer.begin(), samples_buffer.begin() + sample_count);
+        switch(packet->type)
+        {
+        case QueuedPacket::Type::Audio:
+            receivePacket(*packet);
+            break;
+        case QueuedPacket::Type::Reset:
+            clearBuffer();
+            break;
+        case QueuedPacket::Type::Finalize:
+            finalized = true;
+            break;
+        }
+        packet_queue.pop();
     }
-    if (this->samples.size() > sample_rate / 10 && !isPlaying()) //Start playback when there is 0.1 second of data
+}
+
+void NetworkAudioStream::receivePacket(const QueuedPacket& packet)
+{
+    stats.packets.fetch_add(1, std::memory_order_relaxed);
+
+    //Jitter as in RTP: how much the time between two packets differs from the time between their frames.
+    int16_t distance = int16_t(packet.sequence - last_arrival_sequence);
+    if (!has_last_arrival || distance > 0)
     {
-        start();
+        if (has_last_arrival && !(packet.flags & flag_talk_start))
+        {
+            float difference = std::abs(std::chrono::duration<float>(packet.arrival - last_arrival).count() - float(distance) * frame_duration);
+            jitter += (difference - jitter) / 16.0f;
+            target_depth = std::clamp(1 + int(std::ceil(jitter * 4.0f / frame_duration)), 1, max_target_depth);
+            stats.jitter.store(jitter, std::memory_order_relaxed);
+            stats.target_depth.store(target_depth, std::memory_order_relaxed);
+        }
+        has_last_arrival = true;
+        last_arrival_sequence = packet.sequence;
+        last_arrival = packet.arrival;
+    }
+
+    if (ran_empty)
+    {
+        if (!(packet.flags & flag_talk_start))
+            stats.underruns.fetch_add(1, std::memory_order_relaxed);
+        ran_empty = false;
+    }
+
+    if (has_next && int16_t(packet.sequence - next_sequence) < 0)
+    {
+        stats.late_packets.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
+    //Too far ahead to fit in the buffer, give up on the oldest packets.
+    while(has_next && int16_t(packet.sequence - next_sequence) >= slot_count)
+    {
+        if (Slot* slot = findSlot(next_sequence))
+        {
+            clearSlot(*slot);
+            stats.dropped_packets.fetch_add(1, std::memory_order_relaxed);
+        }
+        next_sequence++;
+    }
+    Slot& slot = slots[packet.sequence % slot_count];
+    if (slot.filled)
+    {
+        if (slot.sequence == packet.sequence)
+        {
+            stats.late_packets.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        clearSlot(slot);
+        stats.dropped_packets.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot.filled = true;
+    slot.sequence = packet.sequence;
+    slot.flags = packet.flags;
+    slot.size = packet.size;
+    std::copy(packet.data.begin(), packet.data.begin() + packet.size, slot.data.begin());
+    buffered++;
 }
 
-void NetworkAudioStream::finalize()
+void NetworkAudioStream::clearBuffer()
+{
+    for(auto& slot : slots)
+        clearSlot(slot);
+    samples.clear();
+    buffering = true;
+    has_next = false;
+    ran_empty = false;
+    finalized = false;
+    has_last_arrival = false;
+    resampler.reset();
+    if (decoder)
+        opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+}
+
+bool NetworkAudioStream::decodeFrame()
 {
-    if (this->samples.size() > 0 && !isPlaying())
+    if (!decoder)
+        return false;
+    if (buffering)
     {
-        start();
+        //At the end of a transmission, play what is left without waiting for more.
+        if (buffered == 0 || (buffered < target_depth && !finalized))
+            return false;
+        if (!has_next || !findSlot(next_sequence))
+        {
+            //Start with the oldest packet. All buffered packets are within slot_count of each other, so comparing their distance works across the wrap around.
+            Slot* oldest = nullptr;
+            for(auto& slot : slots)
+                if (slot.filled && (!oldest || int16_t(slot.sequence - oldest->sequence) < 0))
+                    oldest = &slot;
+            next_sequence = oldest->sequence;
+            has_next = true;
+        }
+        buffering = false;
+    }
+
+    std::array<int16_t, frame_size> pcm;
+    int count = 0;
+    if (Slot* slot = findSlot(next_sequence))
+    {
+        count = opus_decode(decoder, slot->data.data(), slot->size, pcm.data(), frame_size, 0);
+        clearSlot(*slot);
     }
+    else if (Slot* after = findSlot(next_sequence + 1); after && !(after->flags & flag_talk_start))
+    {
+        //The packet after the missing one carries a lower quality copy of it.
+        count = opus_decode(decoder, after->data.data(), after->size, pcm.data(), frame_size, 1);
+        stats.recovered_packets.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (buffered > 0)
+    {
+        count = opus_decode(decoder, nullptr, 0, pcm.data(), frame_size, 0);
+        stats.concealed_packets.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        //Ran empty. Wait for target depth packets again, the next one can still be on its way.
+        buffering = true;
+        if (finalized)
+            return false;
+        ran_empty = true;
+        //Conceal one frame, so the sound fades out instead of stopping with a click.
+        count = opus_decode(decoder, nullptr, 0, pcm.data(), frame_size, 0);
+        if (count > 0)
+            queueSamples(pcm.data(), count);
+        return count > 0;
+    }
+    next_sequence++;
+
+    //More packets arrived then played, after a burst or because the sender runs a bit fast. Skip some to keep the delay down.
+    while(buffered > target_depth * 2 + 2)
+    {
+        if (Slot* slot = findSlot(next_sequence))
+        {
+            clearSlot(*slot);
+            stats.dropped_packets.fetch_add(1, std::memory_order_relaxed);
+        }
+        next_sequence++;
+    }
+
+    if (count <= 0)
+        return false;
+    updateLevel(pcm.data(), count);
+    queueSamples(pcm.data(), count);
+    return true;
 }
 
-bool NetworkAudioStream::isFinished()
+NetworkAudioStream::Slot* NetworkAudioStream::findSlot(uint16_t sequence)
 {
-    return !isPlaying() && this->samples.size() == 0;
+    Slot& slot = slots[sequence % slot_count];
+    if (slot.filled && slot.sequence == sequence)
+        return &slot;
+    return nullptr;
+}
+
+void NetworkAudioStream::clearSlot(Slot& slot)
+{
+    if (!slot.filled)
+        return;
+    slot.filled = false;
+    buffered--;
+}
+
+void NetworkAudioStream::updateLevel(const int16_t* data, int count)
+{
+    float sum = 0.0f;
+    for(int n=0; n<count; n++)
+    {
+        float sample = float(data[n]) / 32768.0f;
+        sum += sample * sample;
+    }
+    level.store(std::sqrt(sum / float(count)), std::memory_order_relaxed);
+    level_time.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void NetworkAudioStream::queueSamples(const int16_t* data, int count)
+{
+    static_assert(sample_rate <= decoder_rate, "The resampled frame has to fit in the decoded frame size");
+    std::array<int16_t, frame_size + 2> resampled;
+    size_t resampled_count = resampler.process(data, size_t(count), resampled.data());
+    samples.write(resampled.data(), resampled_count);
 }
 
 void NetworkAudioStreamManager::start(int32_t id)
 {
-    streams[id] = std::unique_ptr<NetworkAudioStream>(new NetworkAudioStream());
+    //Keep the stream of a speaker, the mixer might be using it right now.
+    auto it = streams.find(id);
+    if (it != streams.end())
+        it->second->reset();
+    else
+        streams[id] = std::unique_ptr<NetworkAudioStream>(new NetworkAudioStream());
 }
 
-void NetworkAudioStreamManager::receivedPacketFromNetwork(int32_t id, const unsigned char* packet, int packet_size)
+void NetworkAudioStreamManager::receivedPacketFromNetwork(int32_t id, uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size)
 {
     auto it = streams.find(id);
     if (it == streams.end())
         return;
-    it->second->receivedPacketFromNetwork(packet, packet_size);
+    it->second->receivedPacketFromNetwork(sequence, flags, packet, packet_size);
 }
 
 void NetworkAudioStreamManager::stop(int32_t id)
@@ -82,3 +357,19 @@ void NetworkAudioStreamManager::stop(int32_t id)
         return;
     it->second->finalize();
 }
+
+float NetworkAudioStreamManager::getLevel(int32_t id)
+{
+    auto it = streams.find(id);
+    if (it == streams.end())
+        return 0.0f;
+    return it->second->getLevel();
+}
+
+NetworkAudioStream::Stats NetworkAudioStreamManager::getStats(int32_t id)
+{
+    auto it = streams.find(id);
+    if (it == streams.end())
+        return {};
+    return it->second->getStats();
+}
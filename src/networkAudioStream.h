@@ -2,40 +2,163 @@
 #define NETWORK_AUDIOSTREAM_H
 
 #include <audio/source.h>
+#include <audio/ringBuffer.h>
+#include <audio/resampler.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include <unordered_map>
-#include <mutex>
-#include <vector>
 
 
 struct OpusDecoder;
+/**
+    Playback of the voice of a single speaker.
+
+    Received packets go into a jitter buffer by their sequence number, so they can arrive late or out of order.
+    Playback starts once target depth packets are buffered, and the target follows the jitter measured from the arrival times.
+    The packets are decoded as the mixer needs them. A missing packet is recovered from the forward error correction data
+    in the packet after it when that one already arrived, or else concealed by the decoder.
+
+    The network side only queues packets, the jitter buffer and the decoder belong to the mixer. The queue is a lock free
+    ring buffer, so the mixer never waits for the main thread.
+ */
 class NetworkAudioStream: public sp::audio::Source
 {
 public:
+    static constexpr int decoder_rate = 48000;  //Opus decodes at this rate, the result is resampled to the rate of the mixer.
+    static constexpr int frame_size = 2880;    //Samples in each packet, 60ms at 48kHz.
+    static constexpr float frame_duration = frame_size / float(decoder_rate);
+    static constexpr int max_packet_size = 1500;   //Enough for 60ms frames up to 200kbit/s, larger packets are dropped.
+    //Set on the first packet after a silence. The sender does not send silence, so a gap before such a packet is no underrun.
+    static constexpr uint8_t flag_talk_start = 0x01;
+
+    struct Stats
+    {
+        size_t packets = 0;
+        size_t late_packets = 0;        //Arrived after their turn, or twice.
+        size_t recovered_packets = 0;   //Missing packets recovered with forward error correction.
+        size_t concealed_packets = 0;   //Missing packets concealed by the decoder.
+        size_t dropped_packets = 0;     //Skipped because too many were buffered, or too large.
+        size_t underruns = 0;           //Times the buffer ran empty while the speaker was talking.
+        size_t overruns = 0;            //Packets lost because the mixer did not take them from the queue in time.
+        float jitter = 0.0f;            //In seconds.
+        int target_depth = 0;           //In packets.
+        float max_mix_time = 0.0f;      //Longest and average time spend in the mixer callback, in seconds.
+        float average_mix_time = 0.0f;
+    };
+
     NetworkAudioStream();
+    virtual ~NetworkAudioStream();
 
-    void receivedPacketFromNetwork(const unsigned char* packet, int packet_size);
+    //Start a new transmission of the same speaker.
+    void reset();
+    void receivedPacketFromNetwork(uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size);
     void finalize();
     bool isFinished();
+    //RMS level of the audio that is playing, from 0.0 to 1.0. Silence is not send, so this drops to 0.0 when nothing played for level_timeout seconds.
+    float getLevel();
+    Stats getStats();
 protected:
+    static constexpr float level_timeout = 0.25f;
+    static constexpr int slot_count = 32;
+    static constexpr int max_target_depth = 8;
+    static constexpr size_t packet_queue_size = 16;
+    static constexpr size_t samples_size = 16 * 1024;
+
     // Inherited functions
     virtual void onMixSamples(int16_t* stream, int sample_count) override;
 
-    //Members
-    unsigned int sample_rate;
-    std::mutex             samples_lock;
-    std::vector<int16_t>   samples;
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedPacket
+    {
+        enum class Type : uint8_t
+        {
+            Audio,
+            Reset,
+            Finalize,
+        };
+        Type type = Type::Audio;
+        uint8_t flags = 0;
+        uint16_t sequence = 0;
+        uint16_t size = 0;
+        Clock::time_point arrival;
+        std::array<uint8_t, max_packet_size> data;
+    };
+    struct Slot
+    {
+        bool filled = false;
+        uint8_t flags = 0;
+        uint16_t sequence = 0;
+        uint16_t size = 0;
+        std::array<uint8_t, max_packet_size> data;
+    };
+    //Counters written by the mixer and read by the main thread.
+    struct SharedStats
+    {
+        std::atomic<size_t> packets{0};
+        std::atomic<size_t> late_packets{0};
+        std::atomic<size_t> recovered_packets{0};
+        std::atomic<size_t> concealed_packets{0};
+        std::atomic<size_t> dropped_packets{0};
+        std::atomic<size_t> underruns{0};
+        std::atomic<float> jitter{0.0f};
+        std::atomic<int> target_depth{0};
+        std::atomic<float> max_mix_time{0.0f};
+        std::atomic<float> total_mix_time{0.0f};
+        std::atomic<size_t> mix_calls{0};
+    };
+
+    //All of these run in the mixer.
+    void processQueue();
+    void receivePacket(const QueuedPacket& packet);
+    void clearBuffer();
+    //Decode the next frame into samples, false while buffering or when there is nothing to decode.
+    bool decodeFrame();
+    Slot* findSlot(uint16_t sequence);
+    void clearSlot(Slot& slot);
+    void updateLevel(const int16_t* data, int count);
+    //Resample decoded audio to the mixer rate and queue it for mixing.
+    void queueSamples(const int16_t* data, int count);
 
+    sp::audio::RingBuffer<QueuedPacket> packet_queue{packet_queue_size};   //From the main thread to the mixer.
+    sp::audio::RingBuffer<int16_t> samples{samples_size};                  //Decoded and resampled, but not mixed yet.
+    sp::audio::Resampler resampler{decoder_rate, sample_rate};
     OpusDecoder* decoder = nullptr;
+
+    std::array<Slot, slot_count> slots;
+    int buffered = 0;               //Filled slots.
+    bool buffering = true;          //Waiting for target depth packets before playing.
+    bool has_next = false;
+    uint16_t next_sequence = 0;     //Packet to decode next, valid when has_next is set.
+    bool ran_empty = false;         //The buffer ran empty, the next packet tells if that was an underrun or a silence.
+    bool finalized = false;
+    bool has_last_arrival = false;
+    uint16_t last_arrival_sequence = 0;
+    Clock::time_point last_arrival;
+    float jitter = 0.0f;
+    int target_depth = 2;
+
+    SharedStats stats;
+    std::atomic<size_t> oversized_packets{0};   //Counted by the main thread.
+    std::atomic<float> level{0.0f};
+    std::atomic<Clock::rep> level_time{0};
 };
 
 class NetworkAudioStreamManager
 {
 public:
     void start(int32_t id);
-    void receivedPacketFromNetwork(int32_t id, const unsigned char* packet, int packet_size);
+    void receivedPacketFromNetwork(int32_t id, uint16_t sequence, uint8_t flags, const unsigned char* packet, int packet_size);
     void stop(int32_t id);
+    //Voice level of a speaker, 0.0 when it is not speaking.
+    float getLevel(int32_t id);
+    //Jitter buffer statistics of a speaker, empty when it never talked.
+    NetworkAudioStream::Stats getStats(int32_t id);
 
 private:
     std::unordered_map<int32_t, std::unique_ptr<NetworkAudioStream>> streams;
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <algorithm>
+#include <array>
 #include <cmath>
 
 #include "networkRecorder.h"
@@ -6,11 +8,14 @@
 #include "multiplayer_client.h"
 #include "multiplayer_internal.h"
 #include "logging.h"
+#include "timer.h"
 
 #include <SDL.h>
 #include <opus.h>
 
 static SDL_AudioDeviceID record_device_id;
+static int record_device_rate;
+static int record_device_channels;
 static NetworkAudioRecorder* active_recorder;
 
 NetworkAudioRecorder::NetworkAudioRecorder()
@@ -19,14 +24,43 @@ NetworkAudioRecorder::NetworkAudioRecorder()
     {
         SDL_AudioSpec want, obtained;
         memset(&want, 0, sizeof(want));
-        want.freq = 44100;
+        want.freq = sample_rate;
         want.format = AUDIO_S16SYS;
-        want.samples = 4410;
-        want.channels = 2;
+        want.samples = 4096;
+        want.channels = 1;
         want.callback = &NetworkAudioRecorder::SDLCallback;
-        record_device_id = SDL_OpenAudioDevice(nullptr, true, &want, &obtained, false);
+        //Take the rate and channels the device records at, instead of letting SDL convert them, as our resampler does a better job of that.
+        record_device_id = SDL_OpenAudioDevice(nullptr, true, &want, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+        if (record_device_id != 0)
+        {
+            record_device_rate = obtained.freq;
+            record_device_channels = std::clamp(int(obtained.channels), 1, max_channels);
+        }
+        else
+        {
+            record_device_rate = want.freq;
+            record_device_channels = want.channels;
+        }
     }
     active_recorder = this;
+    if (record_device_rate != sample_rate)
+        resampler = std::make_unique<sp::audio::Resampler>(record_device_rate, sample_rate);
+
+    int error = 0;
+    encoder = opus_encoder_create(sample_rate, 1, OPUS_APPLICATION_VOIP, &error);
+    if (encoder)
+    {
+        opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+        //With DTX the encoder itself marks frames it considers silence, those are not send either.
+        opus_encoder_ctl(encoder, OPUS_SET_DTX(1));
+        opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(1));
+        opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(expected_packet_loss));
+        setBitrate(default_bitrate);
+    }
+    else
+    {
+        LOG(ERROR) << "Failed to create opus encoder:" << error;
+    }
 }
 
 NetworkAudioRecorder::~NetworkAudioRecorder()
@@ -45,6 +79,12 @@ void NetworkAudioRecorder::addKeyActivation(sp::io::Keybinding* key, int target_
     keys.push_back({key, target_identifier});
 }
 
+void NetworkAudioRecorder::setBitrate(int bitrate)
+{
+    if (encoder)
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+}
+
 /// Called from a seperate thread, be sure to watch for thread safety!
 void NetworkAudioRecorder::SDLCallback(void* userdata, uint8_t* stream, int len)
 {
@@ -54,11 +94,12 @@ void NetworkAudioRecorder::SDLCallback(void* userdata, uint8_t* stream, int len)
 void NetworkAudioRecorder::onProcessSamples(const int16_t* samples, std::size_t sample_count)
 {
     //Add samples to the sample buffer. The update function (which is run from the main thread) will handle sending of the actual audio packet.
-    sample_buffer_mutex.lock();
-    auto old_size = sample_buffer.size();
-    sample_buffer.resize(old_size + sample_count);
-    memcpy(&sample_buffer[old_size], samples, sizeof(int16_t) * sample_count);
-    sample_buffer_mutex.unlock();
+    //The buffer does not lock or allocate, when the main thread falls too far behind the samples that do not fit are lost.
+    sp::SystemStopwatch clock;
+    sample_buffer.write(samples, sample_count, record_device_channels);
+    float time = clock.get();
+    if (time > max_callback_time.load(std::memory_order_relaxed))
+        max_callback_time.store(time, std::memory_order_relaxed);
 }
 
 void NetworkAudioRecorder::update(float /*delta*/)
@@ -86,7 +127,7 @@ void NetworkAudioRecorder::update(float /*delta*/)
     {
         if (keys[active_key_index].key->getUp())
         {
-            samples_till_stop = 44100 / 2;
+            samples_till_stop = sample_rate / 2;
         }
     }
     if (samples_till_stop == 0)
@@ -98,14 +139,25 @@ void NetworkAudioRecorder::update(float /*delta*/)
     }
 }
 
+NetworkAudioRecorder::Stats NetworkAudioRecorder::getStats() const
+{
+    Stats result = stats;
+    result.overruns = sample_buffer.getOverruns();
+    result.max_callback_time = max_callback_time.load(std::memory_order_relaxed);
+    return result;
+}
+
 void NetworkAudioRecorder::startSending()
 {
-    int error = 0;
-    encoder = opus_encoder_create(48000, 1, OPUS_APPLICATION_VOIP, &error);
-    if (!encoder)
-    {
-        LOG(ERROR) << "Failed to create opus encoder:" << error;
-    }
+    //Samples left from the previous transmission.
+    sample_buffer.clear();
+    converted_buffer.clear();
+    if (resampler)
+        resampler->reset();
+    if (encoder)
+        opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+    hangover_frames = 0;
+    talk_start = true;
 
     if (game_client)
     {
@@ -119,37 +171,83 @@ void NetworkAudioRecorder::startSending()
     }
 }
 
+void NetworkAudioRecorder::convertSamples()
+{
+    std::array<int16_t, convert_block_size * max_channels> input;
+    std::array<int16_t, convert_block_size * 2> output;
+    while(true)
+    {
+        size_t frames = std::min(sample_buffer.available() / record_device_channels, convert_block_size);
+        //Recording at a low rate gives more output then input.
+        while(resampler && resampler->getMaxOutputCount(frames) > output.size())
+            frames /= 2;
+        size_t output_count = resampler ? resampler->getMaxOutputCount(frames) : frames;
+        if (frames == 0 || converted_buffer.space() < output_count)
+            return;
+        sample_buffer.read(input.data(), frames * record_device_channels);
+        sp::audio::Resampler::downmix(input.data(), frames, record_device_channels, input.data());
+        if (resampler)
+        {
+            output_count = resampler->process(input.data(), frames, output.data());
+            converted_buffer.write(output.data(), output_count);
+        }
+        else
+        {
+            converted_buffer.write(input.data(), frames);
+        }
+    }
+}
+
 bool NetworkAudioRecorder::sendAudioPacket()
 {
-    bool result = false;
-    std::lock_guard<std::mutex> guard(sample_buffer_mutex);
-    if (sample_buffer.size() >= frame_size)
-    {
-        unsigned char packet_buffer[4096];
-        int packet_size = 0;
-        if (encoder)
-            packet_size = opus_encode(encoder, sample_buffer.data(), frame_size, packet_buffer, sizeof(packet_buffer));
+    convertSamples();
+    if (converted_buffer.available() < frame_size)
+        return false;
+    std::array<int16_t, frame_size> frame;
+    converted_buffer.read(frame.data(), frame_size);
+    sendFrame(frame.data());
+
+    if (samples_till_stop > -1)
+    {
+        samples_till_stop = std::max(0, samples_till_stop - frame_size);
+    }
+    return true;
+}
+
+void NetworkAudioRecorder::sendFrame(const int16_t* samples)
+{
+    unsigned char packet_buffer[4096];
+    int packet_size = 0;
+    bool voice = detectVoice(samples) || !voice_activity_detection;
+    //Always encode, so the encoder state follows the audio and the first frame after a silence is not garbled.
+    if (encoder)
+        packet_size = opus_encode(encoder, samples, frame_size, packet_buffer, sizeof(packet_buffer));
+    stats.frames++;
+    //A DTX frame is only the 1 or 2 byte header, the decoders do not need those.
+    if (voice && packet_size > 2)
+    {
+        stats.frames_send++;
+        stats.bytes_send += packet_size;
+        uint8_t flags = talk_start ? NetworkAudioStream::flag_talk_start : 0;
         if (game_client)
         {
             sp::io::DataBuffer audio_packet;
-            audio_packet << CMD_AUDIO_COMM_DATA << game_client->getClientId();
+            audio_packet << CMD_AUDIO_COMM_DATA << game_client->getClientId() << sequence << flags;
             audio_packet.appendRaw(packet_buffer, packet_size);
 
             game_client->sendPacket(audio_packet);
         }
         else if (game_server)
         {
-            game_server->gotAudioPacket(0, packet_buffer, packet_size);
-        }
-        sample_buffer.erase(sample_buffer.begin(), sample_buffer.begin() + frame_size);
-        result = true;
-
-        if (samples_till_stop > -1)
-        {
-            samples_till_stop = std::max(0, samples_till_stop - frame_size);
+            game_server->gotAudioPacket(0, sequence, flags, packet_buffer, packet_size);
         }
+        sequence++;
+        talk_start = false;
+    }
+    else
+    {
+        talk_start = true;
     }
-    return result;
 }
 
 void NetworkAudioRecorder::finishSending()
@@ -158,15 +256,10 @@ void NetworkAudioRecorder::finishSending()
     {
     }
 
-    {
-        std::lock_guard<std::mutex> guard(sample_buffer_mutex);
-        while(sample_buffer.size() < frame_size)
-            sample_buffer.push_back(0);
-    }
-    
-    sendAudioPacket();
-    opus_encoder_destroy(encoder);
-    encoder = nullptr;
+    //Send what is left as a last frame, padded with silence.
+    std::array<int16_t, frame_size> frame{};
+    converted_buffer.read(frame.data(), converted_buffer.available());
+    sendFrame(frame.data());
 
     if (game_client)
     {
@@ -179,3 +272,36 @@ void NetworkAudioRecorder::finishSending()
         game_server->stopAudio(0);
     }
 }
+
+bool NetworkAudioRecorder::detectVoice(const int16_t* samples)
+{
+    float sum = 0.0f;
+    for(int n=0; n<frame_size; n++)
+    {
+        float sample = float(samples[n]) / 32768.0f;
+        sum += sample * sample;
+    }
+    level = std::sqrt(sum / float(frame_size));
+
+    //Even while talking there are short pauses, so the lowest level over a few seconds is the background noise.
+    noise_block_min = std::min(noise_block_min, level);
+    noise_floor = std::min(noise_floor, level);
+    if (++noise_block_frames == noise_block_size)
+    {
+        noise_floor = noise_block_min;
+        noise_block_min = 1.0f;
+        noise_block_frames = 0;
+    }
+
+    if (level > noise_floor * voice_threshold && level > min_voice_level)
+    {
+        hangover_frames = voice_hangover_frames;
+        return true;
+    }
+    if (hangover_frames > 0)
+    {
+        hangover_frames--;
+        return true;
+    }
+    return false;
+}
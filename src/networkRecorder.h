@@ -2,10 +2,13 @@
 #define NETWORK_AUDIO_RECORDER_H
 
 #include <stdint.h>
+#include <atomic>
 #include <list>
-#include <mutex>
+#include <memory>
 
 #include "Updatable.h"
+#include "audio/resampler.h"
+#include "audio/ringBuffer.h"
 #include "io/keybinding.h"
 
 
@@ -20,27 +23,80 @@ private:
     };
     std::vector<KeyConfig> keys;
     int active_key_index = -1;
-    std::mutex sample_buffer_mutex;
-    std::vector<int16_t> sample_buffer;
-    OpusEncoder* encoder = nullptr;
+    //Filled by the SDL callback, emptied by update. In the format of the recording device.
+    sp::audio::RingBuffer<int16_t> sample_buffer{sample_buffer_size};
+    //The recording converted to mono at the 48kHz of the encoder.
+    sp::audio::RingBuffer<int16_t> converted_buffer{converted_buffer_size};
+    std::unique_ptr<sp::audio::Resampler> resampler;    //Only when the device does not record at 48kHz.
+    std::atomic<float> max_callback_time{0.0f};
+    OpusEncoder* encoder = nullptr;  //Kept for the lifetime of the recorder, only its state is reset for each transmission.
     int samples_till_stop = -1;
+
+    bool voice_activity_detection = true;
+    float level = 0.0f;
+    float noise_floor = initial_noise_floor;
+    float noise_block_min = 1.0f;
+    int noise_block_frames = 0;
+    int hangover_frames = 0;
+    uint16_t sequence = 0;      //Of the send packets, so the receivers can tell lost packets from silence.
+    bool talk_start = true;     //The next send packet is the first after a silence.
 public:
+    struct Stats
+    {
+        size_t frames = 0;      //Frames recorded while transmitting.
+        size_t frames_send = 0; //Frames that contained voice and were send.
+        size_t bytes_send = 0;  //Encoded audio, without the packet headers.
+        size_t overruns = 0;    //Times recorded samples were lost, because update did not keep up.
+        float max_callback_time = 0.0f; //Longest time spend in the recording callback, in seconds.
+    };
+
     NetworkAudioRecorder();
     virtual ~NetworkAudioRecorder();
 
     void addKeyActivation(sp::io::Keybinding* key, int target_identifier);
 
+    //Opus bitrate in bits per second.
+    void setBitrate(int bitrate);
+    //With voice activity detection, frames without speech are not send while the key is held, so silence costs no bandwidth.
+    void setVoiceActivityDetection(bool enabled) { voice_activity_detection = enabled; }
+    //RMS level of the last recorded frame, from 0.0 to 1.0.
+    float getLevel() const { return level; }
+    //True while the frames are send, which includes a short time after speech stops.
+    bool isSpeaking() const { return active_key_index != -1 && (hangover_frames > 0 || !voice_activity_detection); }
+    Stats getStats() const;
+
 public:
     virtual void update(float delta) override;
 
 private:
     static void SDLCallback(void* userdata, uint8_t* stream, int len);
     void onProcessSamples(const int16_t* samples, std::size_t sample_count);
+    static constexpr int sample_rate = 48000;
     static constexpr int frame_size = 2880;
+    static constexpr size_t sample_buffer_size = 128 * 1024;
+    static constexpr size_t converted_buffer_size = 8 * 1024;
+    static constexpr size_t convert_block_size = 256;
+    static constexpr int max_channels = 8;
+    static constexpr int default_bitrate = 24000;
+    //Expected packet loss, the encoder spends part of the bitrate on a copy of each frame in the next packet to recover from that.
+    static constexpr int expected_packet_loss = 10;
+    //A frame is voice when its level is voice_threshold times above the noise floor, and above min_voice_level.
+    static constexpr float voice_threshold = 3.0f;
+    static constexpr float min_voice_level = 0.005f;
+    static constexpr float initial_noise_floor = 0.001f;
+    //The noise floor is the lowest level in the current and the previous block of this many frames, so it follows louder noise within a few seconds.
+    static constexpr int noise_block_size = 32;
+    //Keep sending this many frames after the voice stops, so quiet word endings and short pauses are not cut off.
+    static constexpr int voice_hangover_frames = 5;
 
     void startSending();
+    void convertSamples();
     bool sendAudioPacket();
+    void sendFrame(const int16_t* samples);
     void finishSending();
+    bool detectVoice(const int16_t* samples);
+
+    Stats stats;
 };
 
 #endif //NETWORK_VOICE_RECORDER_H
@@ -0,0 +1,52 @@
+#include "multiplayer_swarm.h"
+#include "logging.h"
+
+#include <chrono>
+#include <thread>
+
+
+//Standalone client swarm, to load test a running server.
+//Usage: seriousproton_swarm <host> [port] [version] [client count] [seconds] [password]
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        LOG(Error, "Usage: ", argv[0], " <host> [port] [version] [client count] [seconds] [password]");
+        return 1;
+    }
+    string host = argv[1];
+    int port_nr = defaultServerPort;
+    int version = 0;
+    int client_count = 100;
+    int seconds = 60;
+    string password;
+    if (argc > 2)
+        port_nr = string(argv[2]).toInt();
+    if (argc > 3)
+        version = string(argv[3]).toInt();
+    if (argc > 4)
+        client_count = string(argv[4]).toInt();
+    if (argc > 5)
+        seconds = string(argv[5]).toInt();
+    if (argc > 6)
+        password = argv[6];
+
+    MultiplayerClientSwarm swarm(version, sp::io::network::Address(host), port_nr, password);
+    swarm.spawn(client_count);
+
+    //Report every 5 seconds. Ping and send queue sizes are only known by the server, these show up as zero.
+    auto start = std::chrono::steady_clock::now();
+    auto next_report = start + std::chrono::seconds(5);
+    while(std::chrono::steady_clock::now() < start + std::chrono::seconds(seconds))
+    {
+        swarm.update();
+        if (std::chrono::steady_clock::now() >= next_report)
+        {
+            swarm.logReport();
+            next_report += std::chrono::seconds(5);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    swarm.logReport();
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "multiplayer_swarm.h"
+#include "multiplayer_internal.h"
+#include "logging.h"
+
+#include <algorithm>
+
+
+void MultiplayerClientSwarm::Client::queueCommand(int32_t object_id, const sp::io::DataBuffer& command)
+{
+    if (command_batch.getDataSize() == 0)
+        command_batch << CMD_CLIENT_COMMAND;
+    command_batch << object_id << uint32_t(command.getDataSize());
+    command_batch.appendRaw(command.getData(), command.getDataSize());
+}
+
+MultiplayerClientSwarm::MultiplayerClientSwarm(int version_number, sp::io::network::Address server, int port_nr, string password)
+: version_number(version_number), server(server), port_nr(port_nr), password(password)
+{
+}
+
+void MultiplayerClientSwarm::spawn(int count)
+{
+    for(int n=0; n<count; n++)
+    {
+        auto client = std::make_unique<Client>();
+        client->socket = std::make_unique<sp::io::network::TcpSocket>();
+        client->socket->setBlocking(false);
+        if (!client->socket->connect(server, port_nr))
+        {
+            LOG(WARNING) << "Swarm client failed to connect";
+            client->state = Client::State::Disconnected;
+        }
+        clients.emplace_back(std::move(client));
+    }
+}
+
+void MultiplayerClientSwarm::update()
+{
+    sp::io::DataBuffer packet;
+    for(auto& client_ptr : clients)
+    {
+        Client& client = *client_ptr;
+        if (client.state == Client::State::Disconnected)
+            continue;
+        if (client.state == Client::State::Connecting)
+        {
+            auto state = client.socket->getState();
+            if (state == sp::io::network::StreamSocket::State::Connecting)
+                continue;
+            if (state == sp::io::network::StreamSocket::State::Closed)
+            {
+                client.state = Client::State::Disconnected;
+                continue;
+            }
+            client.socket->setDelay(false);
+            client.state = Client::State::Authenticating;
+        }
+
+        while(client.socket->receive(packet))
+        {
+            client.received_bytes += packet.getDataSize();
+            client.received_packets++;
+            report_received_bytes += packet.getDataSize();
+            handlePacket(client, packet);
+        }
+
+        if (client.state == Client::State::Connected && script)
+            script(client);
+        if (client.command_batch.getDataSize() > 0)
+        {
+            client.socket->queue(client.command_batch);
+            client.command_batch.clear();
+        }
+        client.socket->sendSendQueue();
+
+        if (client.socket->getState() == sp::io::network::StreamSocket::State::Closed)
+            client.state = Client::State::Disconnected;
+    }
+}
+
+void MultiplayerClientSwarm::handlePacket(Client& client, sp::io::DataBuffer& packet)
+{
+    command_t command;
+    packet >> command;
+    switch(command)
+    {
+    case CMD_REQUEST_AUTH:
+        {
+            int32_t server_version;
+            bool require_password;
+            packet >> server_version >> require_password >> client.compression;
+            sp::io::DataBuffer reply;
+            reply << CMD_CLIENT_SEND_AUTH << int32_t(version_number) << password << client.compression;
+            client.socket->queue(reply);
+        }
+        break;
+    case CMD_SET_CLIENT_ID:
+        packet >> client.client_id;
+        if (client.compression)
+            client.socket->setReceiveCompression(true);
+        client.state = Client::State::Connected;
+        break;
+    case CMD_ALIVE:
+        {
+            sp::io::DataBuffer reply;
+            reply << CMD_ALIVE_RESP;
+            client.socket->queue(reply);
+        }
+        break;
+    case CMD_SET_CLASS_TABLE:
+        {
+            uint16_t count;
+            packet >> count;
+            client.class_names.resize(count);
+            for(unsigned int n=0; n<count; n++)
+                packet >> client.class_names[n];
+        }
+        break;
+    case CMD_CREATE:
+        {
+            int32_t id;
+            uint16_t class_id;
+            packet >> id >> class_id;
+            client.objects[id] = class_id < client.class_names.size() ? client.class_names[class_id] : string("?");
+        }
+        break;
+    case CMD_DELETE:
+        {
+            int32_t id;
+            packet >> id;
+            client.objects.erase(id);
+        }
+        break;
+    case CMD_UPDATE_VALUE:
+        client.received_updates++;
+        break;
+    case CMD_RESYNC:
+        {
+            uint32_t count;
+            packet >> count;
+            std::unordered_map<int32_t, string> alive;
+            for(uint32_t n=0; n<count && packet.available(); n++)
+            {
+                int32_t id;
+                packet >> id;
+                auto it = client.objects.find(id);
+                if (it != client.objects.end())
+                    alive[id] = it->second;
+            }
+            client.objects = std::move(alive);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+MultiplayerClientSwarm::Report MultiplayerClientSwarm::getReport(P<GameServer> server)
+{
+    Report report;
+    report.client_count = int(clients.size());
+    report.connected_count = int(std::count_if(clients.begin(), clients.end(), [](const std::unique_ptr<Client>& c) { return c->isConnected(); }));
+    float time = std::max(report_time.restart(), 0.001f);
+    report.receive_rate_total = float(report_received_bytes) / time;
+    report.receive_rate_per_client = report.connected_count > 0 ? report.receive_rate_total / report.connected_count : 0.0f;
+    report_received_bytes = 0;
+
+    report.server_update_time = 0.0f;
+    report.average_ping = 0.0f;
+    report.max_ping = 0;
+    report.max_send_queue = 0;
+    report.packet_buffers = 0;
+    report.packet_buffer_allocations = 0;
+    report.packet_buffer_high_water = 0;
+    report.compression_ratio = 1.0f;
+    report.compression_time = 0.0f;
+    if (server)
+    {
+        report.server_update_time = server->getUpdateTime();
+        const auto& pool_stats = server->getPacketPoolStats();
+        report.packet_buffers = pool_stats.borrowed - report_pool_stats.borrowed;
+        report.packet_buffer_allocations = (pool_stats.allocated + pool_stats.grown) - (report_pool_stats.allocated + report_pool_stats.grown);
+        report.packet_buffer_high_water = pool_stats.high_water;
+        report_pool_stats = pool_stats;
+        //Clients that disconnected take their compression statistics with them, then there is nothing to compare to.
+        auto compression_stats = server->getCompressionStats();
+        if (compression_stats.raw_bytes > report_compression_stats.raw_bytes && compression_stats.compressed_bytes >= report_compression_stats.compressed_bytes)
+        {
+            report.compression_ratio = float(compression_stats.compressed_bytes - report_compression_stats.compressed_bytes) / float(compression_stats.raw_bytes - report_compression_stats.raw_bytes);
+            report.compression_time = compression_stats.time - report_compression_stats.time;
+        }
+        report_compression_stats = compression_stats;
+        //Only look at our own clients, the server might have other connections.
+        std::unordered_map<int32_t, bool> ours;
+        for(auto& client : clients)
+            if (client->isConnected())
+                ours[client->client_id] = true;
+        int ping_count = 0;
+        for(auto& info : server->getClientSendQueueInfo())
+        {
+            if (ours.find(info.client_id) == ours.end())
+                continue;
+            report.average_ping += info.ping;
+            report.max_ping = std::max(report.max_ping, info.ping);
+            report.max_send_queue = std::max(report.max_send_queue, info.queued_bytes);
+            ping_count++;
+        }
+        if (ping_count > 0)
+            report.average_ping /= ping_count;
+    }
+    return report;
+}
+
+void MultiplayerClientSwarm::logReport(P<GameServer> server)
+{
+    Report report = getReport(server);
+    LOG(INFO) << "Swarm: " << report.connected_count << "/" << report.client_count << " connected, "
+        << "server update " << (report.server_update_time * 1000.0f) << "ms, "
+        << "ping avg " << report.average_ping << "ms max " << report.max_ping << "ms, "
+        << "receive " << (report.receive_rate_per_client / 1024.0f) << "KB/s per client " << (report.receive_rate_total / 1024.0f) << "KB/s total, "
+        << "max send queue " << report.max_send_queue << " bytes, "
+        << "packet buffers " << report.packet_buffers << " with " << report.packet_buffer_allocations << " allocations, "
+        << "compressed to " << int(report.compression_ratio * 100.0f) << "% in " << (report.compression_time * 1000.0f) << "ms";
+}
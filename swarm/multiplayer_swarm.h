@@ -0,0 +1,113 @@
+#ifndef MULTIPLAYER_SWARM_H
+#define MULTIPLAYER_SWARM_H
+
+#include "io/network/tcpSocket.h"
+#include "multiplayer_server.h"
+#include "timer.h"
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+/**
+    Load test harness: a lot of lightweight simulated clients in a single process.
+
+    The clients connect over TCP, go trough the auth handshake, answer keep alives and decode the replication
+    stream up to the object level: they track which objects exist and how many updates each receives, without creating
+    the objects themselves. That keeps them cheap enough to run hundreds next to a GameServer in the same process,
+    without a window or any other client side subsystem.
+
+    Not part of the seriousproton library: build it with SERIOUS_PROTON_SWARM, which also gives the seriousproton_swarm
+    executable to run a swarm against a server on an other machine, or add swarm/multiplayer_swarm.cpp to your own target.
+
+    Usage:
+        MultiplayerClientSwarm swarm(version, sp::io::network::Address("127.0.0.1"), port);
+        swarm.setScript([](MultiplayerClientSwarm::Client& client) { ... client.queueCommand(id, packet); });
+        swarm.spawn(200);
+        while(running) { server->update(delta); swarm.update(); }
+        swarm.logReport(server);
+ */
+class MultiplayerClientSwarm
+{
+public:
+    class Client
+    {
+    public:
+        int32_t getClientId() const { return client_id; }
+        bool isConnected() const { return state == State::Connected; }
+        //Object id to class name, for all objects this client knows.
+        const std::unordered_map<int32_t, string>& getObjects() const { return objects; }
+
+        //Queue a client command for an object, all commands are send together at the end of the swarm update.
+        void queueCommand(int32_t object_id, const sp::io::DataBuffer& command);
+
+        size_t received_bytes = 0;
+        size_t received_packets = 0;
+        size_t received_updates = 0;
+    private:
+        enum class State
+        {
+            Connecting,
+            Authenticating,
+            Connected,
+            Disconnected,
+        };
+
+        std::unique_ptr<sp::io::network::TcpSocket> socket;
+        State state = State::Connecting;
+        int32_t client_id = -1;
+        std::vector<string> class_names;
+        std::unordered_map<int32_t, string> objects;
+        sp::io::DataBuffer command_batch;
+        bool compression = false;   //Accepted when the server offers it.
+
+        friend class MultiplayerClientSwarm;
+    };
+
+    struct Report
+    {
+        int client_count;
+        int connected_count;
+        float server_update_time;       //Time of the last server update, in seconds.
+        float average_ping;             //In milliseconds, as measured by the server.
+        int32_t max_ping;
+        float receive_rate_per_client;  //Average bytes per second.
+        float receive_rate_total;
+        size_t max_send_queue;          //Largest server side send queue of a client, in bytes.
+        size_t packet_buffers;          //Packet buffers the server used, and how many of those needed a heap allocation.
+        size_t packet_buffer_allocations;
+        size_t packet_buffer_high_water;
+        float compression_ratio;        //Compressed size divided by the raw size of what the server send, 1.0 without compression.
+        float compression_time;         //Seconds the server spend compressing.
+    };
+
+    MultiplayerClientSwarm(int version_number, sp::io::network::Address server, int port_nr = defaultServerPort, string password = "");
+
+    void spawn(int count);
+    //Called for each connected client on every update, to send the scripted commands.
+    void setScript(std::function<void(Client& client)> script) { this->script = script; }
+    void update();
+
+    std::vector<std::unique_ptr<Client>>& getClients() { return clients; }
+    //Statistics since the previous report. Pass the server when it runs in this process, to include the server side numbers.
+    Report getReport(P<GameServer> server = nullptr);
+    void logReport(P<GameServer> server = nullptr);
+
+private:
+    void handlePacket(Client& client, sp::io::DataBuffer& packet);
+
+    int version_number;
+    sp::io::network::Address server;
+    int port_nr;
+    string password;
+
+    std::vector<std::unique_ptr<Client>> clients;
+    std::function<void(Client& client)> script;
+    sp::SystemStopwatch report_time;
+    size_t report_received_bytes = 0;
+    sp::io::DataBufferPool::Stats report_pool_stats;
+    sp::io::StreamCompression::Stats report_compression_stats;
+};
+
+#endif//MULTIPLAYER_SWARM_H
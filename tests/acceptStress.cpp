@@ -0,0 +1,98 @@
+#include "multiplayer_server.h"
+#include "multiplayer_swarm.h"
+#include "multiplayer.h"
+#include "engine.h"
+#include "check.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+
+//Hundreds of clients connecting at the same moment, like after a server restart. The listen backlog has to hold them all,
+//and the server has to accept them in a few updates, as it takes up to 64 pending connections per update.
+//Usage: seriousproton_test_acceptstress [client count]
+//Every client and its server side use a file descriptor, so the soft open file limit is raised when it is too low.
+//When the hard limit does not allow that either, the test is skipped (exit code 77).
+class StressObject : public MultiplayerObject
+{
+public:
+    int32_t value = 0;
+
+    StressObject() : MultiplayerObject("StressObject") { registerMemberReplication(&value); }
+};
+REGISTER_MULTIPLAYER_CLASS(StressObject, "StressObject");
+
+static bool ensureFileLimit(int client_count)
+{
+#ifndef _WIN32
+    rlim_t needed = rlim_t(client_count) * 2 + 64;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return true;
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < needed)
+    {
+        if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed)
+        {
+            printf("skipped: %d clients need %d file descriptors, hard limit is %d\n", client_count, int(needed), int(limit.rlim_max));
+            return false;
+        }
+        limit.rlim_cur = needed;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            printf("skipped: could not raise the open file limit to %d\n", int(needed));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int client_count = 400;
+    if (argc > 1)
+        client_count = std::max(1, atoi(argv[1]));
+    const int port_nr = 36120;
+    const int max_updates = 500;
+    if (!ensureFileLimit(client_count))
+        return 77;
+
+    new Engine();
+    P<GameServer> server = new GameServer("stress", 1, port_nr);
+    for(int n=0; n<10; n++)
+        new StressObject();
+
+    MultiplayerClientSwarm swarm(1, sp::io::network::Address("127.0.0.1"), port_nr);
+    swarm.spawn(client_count);
+
+    int accept_updates = -1;
+    int connect_updates = -1;
+    auto start = std::chrono::steady_clock::now();
+    for(int update=1; update<=max_updates && connect_updates < 0; update++)
+    {
+        server->update(0.01f);
+        swarm.update();
+        if (accept_updates < 0 && int(server->getClientSendQueueInfo().size()) == client_count)
+            accept_updates = update;
+        int connected = 0;
+        for(auto& client : swarm.getClients())
+            if (client->isConnected() && client->getObjects().size() == 10)
+                connected++;
+        if (connected == client_count)
+            connect_updates = update;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    swarm.logReport(server);
+
+    //Accepting takes client_count / 64 updates, allow some for connections still in the kernel handshake.
+    int accept_limit = client_count / 64 + 10;
+    check(accept_updates > 0 && accept_updates <= accept_limit, "%d clients accepted in %d updates (limit %d)", client_count, accept_updates, accept_limit);
+    check(connect_updates > 0, "%d clients connected with all objects in %d updates, %.0fms", client_count, connect_updates, time * 1000.0);
+    return checkResult();
+}
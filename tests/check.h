@@ -0,0 +1,32 @@
+#ifndef SP_TESTS_CHECK_H
+#define SP_TESTS_CHECK_H
+
+#include <cstdarg>
+#include <cstdio>
+
+
+//Shared by the tests: every check prints a line, and main returns checkResult(), which fails when any check failed.
+inline int& checkFailureCount()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void check(bool ok, const char* format, ...)
+{
+    printf("%s: ", ok ? "ok" : "FAILED");
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    if (!ok)
+        checkFailureCount()++;
+}
+
+inline int checkResult()
+{
+    return checkFailureCount() ? 1 : 0;
+}
+
+#endif//SP_TESTS_CHECK_H
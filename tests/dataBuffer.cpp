@@ -0,0 +1,84 @@
+#include "io/dataBuffer.h"
+#include "check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+
+//writeArray has to give exactly the same bytes as writing each value by itself, and readArray has to read those back.
+template<typename T> static void writeEach(sp::io::DataBuffer& buffer, const std::vector<T>& values)
+{
+    for(auto& value : values)
+        buffer.write(value);
+}
+
+static void writeEach(sp::io::DataBuffer& buffer, const std::vector<glm::vec2>& values)
+{
+    for(auto& value : values)
+        buffer.write(value.x, value.y);
+}
+
+template<typename T> static void testArray(const char* type, std::vector<T> values)
+{
+    static_assert(sp::io::DataBuffer::hasArraySupport<T>(), "type without array support");
+    //Also mix in a value before and after, so the array is not at the start or end of the buffer.
+    sp::io::DataBuffer single;
+    single.write(uint32_t(1234567));
+    writeEach(single, values);
+    single.write(uint8_t(42));
+
+    sp::io::DataBuffer array;
+    array.write(uint32_t(1234567));
+    array.writeArray(values.data(), values.size());
+    array.write(uint8_t(42));
+
+    check(single.getDataSize() == array.getDataSize() && memcmp(single.getData(), array.getData(), single.getDataSize()) == 0, "%s writeArray matches write", type);
+
+    uint32_t before = 0;
+    uint8_t after = 0;
+    std::vector<T> result(values.size());
+    array >> before;
+    array.readArray(result.data(), result.size());
+    array >> after;
+    check(before == 1234567 && after == 42 && memcmp(result.data(), values.data(), values.size() * sizeof(T)) == 0, "%s readArray round trip", type);
+}
+
+//Values around each point where the VLQ encoding needs one more byte.
+template<typename T> static std::vector<T> vlqBoundaries(bool negative)
+{
+    std::vector<T> values;
+    for(uint64_t bound : {uint64_t(1) << 6, uint64_t(1) << 7, uint64_t(1) << 13, uint64_t(1) << 14, uint64_t(1) << 20, uint64_t(1) << 21, uint64_t(1) << 27, uint64_t(1) << 28})
+    {
+        for(uint64_t value : {bound - 1, bound, bound + 1})
+        {
+            if (value > uint64_t(std::numeric_limits<T>::max()))
+                continue;
+            values.push_back(T(value));
+            if (negative)
+                values.push_back(T(-int64_t(value)));
+        }
+    }
+    values.push_back(0);
+    values.push_back(std::numeric_limits<T>::max());
+    //The sign is stored next to the magnitude, so the lowest value of a 32 bit type does not fit. Use the lowest one that does.
+    if (negative)
+        values.push_back(T(-std::numeric_limits<T>::max()));
+    return values;
+}
+
+int main()
+{
+    testArray<int8_t>("int8", {0, 1, -1, 63, 64, -64, -65, 127, -128});
+    testArray<uint8_t>("uint8", {0, 1, 127, 128, 255});
+    testArray<int16_t>("int16", vlqBoundaries<int16_t>(true));
+    testArray<uint16_t>("uint16", vlqBoundaries<uint16_t>(false));
+    testArray<int32_t>("int32", vlqBoundaries<int32_t>(true));
+    testArray<uint32_t>("uint32", vlqBoundaries<uint32_t>(false));
+    testArray<float>("float", {0.0f, -0.0f, 1.5f, -3.25f, std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::denorm_min()});
+    testArray<double>("double", {0.0, -1.0, 1e300, -1e-300, std::numeric_limits<double>::max()});
+    testArray<glm::vec2>("vec2", {{0.0f, 0.0f}, {1.0f, -2.0f}, {-1e30f, 1e-30f}});
+    testArray<int32_t>("empty int32", {});
+    return checkResult();
+}
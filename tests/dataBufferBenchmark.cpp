@@ -0,0 +1,86 @@
+#include "io/dataBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+
+//Throughput of the VLQ encoding that every packet uses, in MB of encoded output per second.
+//"before" is the encoding as it was, with a push_back for every byte, the others are the DataBuffer writes.
+//Usage: seriousproton_benchmark_databuffer [MB to encode per run]
+using Clock = std::chrono::steady_clock;
+
+static void writeVLQuPerByte(std::vector<uint8_t>& buffer, uint32_t v)
+{
+    if (v >= (1 << 28))
+        buffer.push_back((v >> 28) | 0x80);
+    if (v >= (1 << 21))
+        buffer.push_back((v >> 21) | 0x80);
+    if (v >= (1 << 14))
+        buffer.push_back((v >> 14) | 0x80);
+    if (v >= (1 << 7))
+        buffer.push_back((v >> 7) | 0x80);
+    buffer.push_back((v & 0x7F));
+}
+
+//Mostly small values like ids, indexes and counts, some larger ones.
+static std::vector<uint32_t> makeValues(size_t count)
+{
+    std::mt19937 random_engine(1234);
+    std::vector<uint32_t> values(count);
+    for(auto& v : values)
+    {
+        int kind = std::uniform_int_distribution<int>(0, 9)(random_engine);
+        uint32_t max = kind < 7 ? 0x7F : (kind < 9 ? 0x3FFF : 0xFFFFFFFF);
+        v = std::uniform_int_distribution<uint32_t>(0, max)(random_engine);
+    }
+    return values;
+}
+
+template<typename F> static void benchmark(const char* name, size_t megabytes, const F& encode_packet)
+{
+    size_t total = 0;
+    auto start = Clock::now();
+    while(total < megabytes * 1024 * 1024)
+        total += encode_packet();
+    double time = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%-28s %8.1f MB/s, %.3fms per MB\n", name, double(total) / time / (1024.0 * 1024.0), time * 1000.0 / (double(total) / (1024.0 * 1024.0)));
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = 256;
+    if (argc > 1)
+        megabytes = std::max(1, atoi(argv[1]));
+
+    //A packet worth of values, the buffers are reused like the packet pool does.
+    const size_t packet_values = 256;
+    auto values = makeValues(packet_values);
+
+    std::vector<uint8_t> vector_buffer;
+    benchmark("before: push_back per byte", megabytes, [&]()
+    {
+        vector_buffer.clear();
+        for(auto v : values)
+            writeVLQuPerByte(vector_buffer, v);
+        return vector_buffer.size();
+    });
+
+    sp::io::DataBuffer buffer;
+    benchmark("after: write(uint32_t)", megabytes, [&]()
+    {
+        buffer.clear();
+        for(auto v : values)
+            buffer.write(v);
+        return size_t(buffer.getDataSize());
+    });
+    benchmark("after: writeArray(uint32_t)", megabytes, [&]()
+    {
+        buffer.clear();
+        buffer.writeArray(values.data(), values.size());
+        return size_t(buffer.getDataSize());
+    });
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "io/network/localListener.h"
+#include "io/network/localSocket.h"
+#include "check.h"
+
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+//LocalListener::listen replaces a stale socket, but never removes a file that is not a socket.
+int main()
+{
+#ifndef _WIN32
+    std::string path = "/tmp/seriousproton_test_" + std::to_string(getpid()) + ".sock";
+
+    FILE* f = fopen(path.c_str(), "w");
+    fputs("data", f);
+    fclose(f);
+    {
+        sp::io::network::LocalListener listener;
+        check(!listener.listen(path), "listen refuses a path that is a regular file");
+    }
+    check(access(path.c_str(), F_OK) == 0, "the regular file is left alone");
+    ::unlink(path.c_str());
+
+    {
+        //Leave a socket file behind, like a crashed process would.
+        int handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        check(::bind(handle, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0, "create a stale socket");
+        ::close(handle);
+    }
+    {
+        sp::io::network::LocalListener listener;
+        check(listener.listen(path), "listen replaces a stale socket");
+        sp::io::network::LocalSocket socket;
+        check(socket.connect(path), "connect to the new socket");
+    }
+    check(access(path.c_str(), F_OK) != 0, "close removes the socket");
+#endif
+    return checkResult();
+}
@@ -0,0 +1,80 @@
+#include "io/network/tcpListener.h"
+#include "io/network/tcpSocket.h"
+#include "io/network/localListener.h"
+#include "io/network/localSocket.h"
+#include "io/dataBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+
+//Compares the TCP loopback and the unix domain socket transport with 200 byte packets, in a single process.
+//Usage: seriousproton_benchmark_localsocket [socket path]
+using namespace sp::io::network;
+using Clock = std::chrono::steady_clock;
+
+template<typename SOCKET> static void benchmark(const char* name, SOCKET& a, SOCKET& b)
+{
+    a.setBlocking(false);
+    b.setBlocking(false);
+    sp::io::DataBuffer packet;
+    std::vector<uint8_t> payload(200, 7);
+    packet.appendRaw(payload.data(), payload.size());
+    sp::io::DataBuffer received_packet;
+
+    const int count = 200000;
+    int sent = 0;
+    int received = 0;
+    auto start = Clock::now();
+    while(received < count)
+    {
+        for(int n=0; n<64 && sent<count; n++, sent++)
+            a.queue(packet);
+        a.sendSendQueue();
+        while(b.receive(received_packet))
+            received++;
+    }
+    double time = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%s: %.0f packets/s, %.1f MB/s\n", name, count / time, count * packet.getDataSize() / time / 1e6);
+
+    const int rounds = 20000;
+    start = Clock::now();
+    for(int n=0; n<rounds; n++)
+    {
+        a.send(packet);
+        while(!b.receive(received_packet)) {}
+        b.send(received_packet);
+        while(!a.receive(received_packet)) {}
+    }
+    time = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%s: %.1fus round trip\n", name, time / rounds * 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = "/tmp/seriousproton_benchmark.sock";
+    if (argc > 1)
+        path = argv[1];
+    {
+        TcpListener listener;
+        if (!listener.listen(36100))
+            return 1;
+        TcpSocket a, b;
+        a.connect(Address("127.0.0.1"), 36100);
+        while(!listener.accept(b)) {}
+        a.setDelay(false);
+        b.setDelay(false);
+        benchmark("tcp", a, b);
+    }
+    {
+        LocalListener listener;
+        if (!listener.listen(path))
+            return 1;
+        LocalSocket a, b;
+        a.connect(path);
+        while(!listener.accept(b)) {}
+        benchmark("local", a, b);
+    }
+    return 0;
+}
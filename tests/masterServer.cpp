@@ -0,0 +1,118 @@
+#include "multiplayer_master_server.h"
+#include "io/http/request.h"
+#include "io/network/tcpListener.h"
+#include "engine.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+
+//Register game servers with a local master server, list them, ask for the changes since a list version, and let one expire.
+static const int master_port = 36470;
+static const int game_port = 36480;
+
+static void pump()
+{
+    foreach(Updatable, u, updatableList)
+        u->update(0.01f);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static bool pumpUntil(const std::function<bool()>& condition, int timeout_ms = 2000)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while(!condition() && std::chrono::steady_clock::now() < end)
+        pump();
+    return condition();
+}
+
+//Requests block until the reply is there, so they run on a thread while the master server keeps updating here.
+static string httpRequest(const string& method, const string& path, const string& data = "")
+{
+    std::atomic<bool> done{false};
+    string body;
+    std::thread thread([&]()
+    {
+        sp::io::http::Request request("127.0.0.1", master_port);
+        body = request.request(method, path, data).body;
+        done = true;
+    });
+    pumpUntil([&done]() { return done.load(); }, 10000);
+    thread.join();
+    return body;
+}
+
+static string registerServer(int port, const string& name, int version)
+{
+    return httpRequest("POST", "/register.php", "port=" + string(port) + "&name=" + name + "&version=" + string(version));
+}
+
+static bool hasLine(const string& text, const string& line)
+{
+    for(auto& l : text.split("\n"))
+        if (l == line)
+            return true;
+    return false;
+}
+
+static int lineCount(const string& text)
+{
+    int count = 0;
+    for(auto& l : text.split("\n"))
+        if (!l.empty())
+            count++;
+    return count;
+}
+
+static string entry(int port, const string& name, int version)
+{
+    return "127.0.0.1:" + string(port) + ":" + string(version) + ":" + name;
+}
+
+int main()
+{
+    new Engine();
+    P<MasterServer> master = new MasterServer(master_port);
+    sp::io::network::TcpListener listeners[3];
+    for(int n=0; n<3; n++)
+        listeners[n].listen(game_port + n);
+
+    check(registerServer(game_port, "alpha", 1) == "OK", "register a server");
+    check(registerServer(game_port + 1, "beta", 2) == "OK", "register a second server");
+    check(pumpUntil([&master]() { return master->getServerCount() == 2; }), "both servers are listed after the connect check");
+
+    string list = httpRequest("GET", "/list.php");
+    check(hasLine(list, entry(game_port, "alpha", 1)) && hasLine(list, entry(game_port + 1, "beta", 2)) && lineCount(list) == 2, "list has both servers");
+
+    //A port without a listener fails the connect check, which is reported on the next registration.
+    check(registerServer(game_port + 10, "gone", 1) == "OK", "the first registration of an unreachable server is accepted");
+    string failed;
+    pumpUntil([&failed]() { failed = registerServer(game_port + 10, "gone", 1); return failed != "OK"; }, 7000);
+    check(failed == "CONNECT FAILED: 127.0.0.1:" + string(game_port + 10), "a later registration reports the failed connect check");
+    check(master->getServerCount() == 2, "the unreachable server is not listed");
+
+    uint32_t version = master->getListVersion();
+    check(httpRequest("GET", "/list.php?since=" + string(int(version))) == "#" + string(int(version)) + "\n", "no changes since the current version");
+    registerServer(game_port + 2, "gamma", 1);
+    check(pumpUntil([&master]() { return master->getServerCount() == 3; }), "the third server is listed");
+    string changes = httpRequest("GET", "/list.php?since=" + string(int(version)));
+    check(changes.startswith("#" + string(int(master->getListVersion())) + "\n") && hasLine(changes, "+" + entry(game_port + 2, "gamma", 1)) && lineCount(changes) == 2, "changes since a version only have the new server");
+    check(httpRequest("GET", "/list.php?since=1").startswith("#" + string(int(master->getListVersion())) + " full\n"), "a version from before the change log gets the full list");
+
+    //Only the next registration of alpha gets the short timeout, the others keep the default.
+    version = master->getListVersion();
+    master->setServerTimeout(0.2f);
+    registerServer(game_port, "alpha", 1);
+    check(pumpUntil([&master]() { return master->getServerCount() == 2; }), "a server that did not register again expires");
+    changes = httpRequest("GET", "/list.php?since=" + string(int(version)));
+    check(hasLine(changes, "-127.0.0.1:" + string(game_port)) && lineCount(changes) == 2, "changes have the expired server removed");
+    list = httpRequest("GET", "/list.php");
+    check(!hasLine(list, entry(game_port, "alpha", 1)) && hasLine(list, entry(game_port + 1, "beta", 2)) && hasLine(list, entry(game_port + 2, "gamma", 1)), "list no longer has the expired server");
+
+    master->destroy();
+    return checkResult();
+}
@@ -0,0 +1,137 @@
+#include "audio/resampler.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+
+//Quality of sp::audio::Resampler, measured with sines and a sine sweep at the rate pairs voice chat uses.
+static void checkLimit(bool ok, int input_rate, int output_rate, const char* what, double value, double limit)
+{
+    check(ok, "%d -> %d %s %.2f (limit %.2f)", input_rate, output_rate, what, value, limit);
+}
+
+static std::vector<int16_t> resample(int input_rate, int output_rate, const std::vector<int16_t>& input, size_t block_size)
+{
+    sp::audio::Resampler resampler(input_rate, output_rate);
+    std::vector<int16_t> output(resampler.getMaxOutputCount(input.size()) + input.size() / block_size + 1);
+    size_t output_count = 0;
+    for(size_t n=0; n<input.size(); n+=block_size)
+    {
+        size_t count = std::min(block_size, input.size() - n);
+        output_count += resampler.process(input.data() + n, count, output.data() + output_count);
+    }
+    output.resize(output_count);
+    return output;
+}
+
+static std::vector<int16_t> sine(int rate, double frequency, double amplitude, size_t count)
+{
+    std::vector<int16_t> result(count);
+    for(size_t n=0; n<count; n++)
+        result[n] = int16_t(std::lrint(amplitude * std::sin(2.0 * M_PI * frequency * double(n) / rate)));
+    return result;
+}
+
+//Least squares fit of a sine of the given frequency, ignoring skip samples at both ends for the filter delay.
+//Gives the amplitude of the fitted sine and the rms of what is left.
+static void fitSine(const std::vector<int16_t>& samples, int rate, double frequency, size_t skip, double& amplitude, double& residual)
+{
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for(size_t n=skip; n<samples.size()-skip; n++)
+    {
+        double s = std::sin(2.0 * M_PI * frequency * double(n) / rate);
+        double c = std::cos(2.0 * M_PI * frequency * double(n) / rate);
+        ss += s * s; sc += s * c; cc += c * c;
+        ys += samples[n] * s; yc += samples[n] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    amplitude = std::sqrt(a * a + b * b);
+    double error = 0;
+    for(size_t n=skip; n<samples.size()-skip; n++)
+    {
+        double v = samples[n] - (a * std::sin(2.0 * M_PI * frequency * double(n) / rate) + b * std::cos(2.0 * M_PI * frequency * double(n) / rate));
+        error += v * v;
+    }
+    residual = std::sqrt(error / double(samples.size() - skip * 2));
+}
+
+static void testRates(int input_rate, int output_rate)
+{
+    const double amplitude = 16000.0;
+    const double passband = 0.3 * std::min(input_rate, output_rate);
+    const double nyquist = 0.5 * std::min(input_rate, output_rate);
+
+    //Tones in the passband keep their level, with the error at 16 bit quantization level.
+    double worst_gain = 0;
+    double worst_snr = 1000;
+    for(double frequency : {50.0, 200.0, 1000.0, 3000.0, 6000.0, 10000.0, 14000.0})
+    {
+        if (frequency > passband)
+            continue;
+        auto output = resample(input_rate, output_rate, sine(input_rate, frequency, amplitude, input_rate), 441);
+        double fit_amplitude, residual;
+        fitSine(output, output_rate, frequency, 200, fit_amplitude, residual);
+        worst_gain = std::max(worst_gain, std::abs(20.0 * std::log10(fit_amplitude / amplitude)));
+        worst_snr = std::min(worst_snr, 20.0 * std::log10(fit_amplitude / std::sqrt(2.0) / residual));
+    }
+    checkLimit(worst_gain < 0.05, input_rate, output_rate, "passband gain error dB", worst_gain, 0.05);
+    checkLimit(worst_snr > 84.0, input_rate, output_rate, "tone SNR dB", worst_snr, 84.0);
+
+    //Exponential sweep over the passband, compared with the same sweep generated at the output rate.
+    {
+        const double f0 = 20.0;
+        const double f1 = 0.35 * std::min(input_rate, output_rate);
+        const double duration = 4.0;
+        const double k = std::log(f1 / f0);
+        auto phase = [&](double t) { return 2.0 * M_PI * f0 * duration / k * (std::exp(k * t / duration) - 1.0); };
+        std::vector<int16_t> input(size_t(input_rate * duration));
+        for(size_t n=0; n<input.size(); n++)
+            input[n] = int16_t(std::lrint(amplitude * std::sin(phase(double(n) / input_rate))));
+        auto output = resample(input_rate, output_rate, input, 512);
+
+        //The output is delayed by half the filter, in input samples.
+        int up = output_rate / std::gcd(input_rate, output_rate);
+        double delay = (double(up) * sp::audio::Resampler::taps - 1.0) / (2.0 * up) / input_rate;
+        double signal = 0, error = 0;
+        for(size_t n=output_rate/10; n<output.size()-output_rate/10; n++)
+        {
+            double reference = amplitude * std::sin(phase(double(n) / output_rate - delay));
+            signal += reference * reference;
+            error += (output[n] - reference) * (output[n] - reference);
+        }
+        double snr = 10.0 * std::log10(signal / error);
+        checkLimit(snr > 82.0, input_rate, output_rate, "sweep SNR dB", snr, 82.0);
+    }
+
+    //When going down in rate, what is above the new nyquist frequency is filtered out instead of folding back.
+    if (input_rate > output_rate)
+    {
+        double worst_level = -1000;
+        for(double frequency : {nyquist * 1.05, (nyquist * 1.05 + 0.49 * input_rate) / 2.0, 0.49 * input_rate})
+        {
+            auto output = resample(input_rate, output_rate, sine(input_rate, frequency, amplitude, input_rate), 300);
+            double energy = 0;
+            for(size_t n=200; n<output.size()-200; n++)
+                energy += double(output[n]) * output[n];
+            double level = 10.0 * std::log10(energy / double(output.size() - 400) + 1e-12) - 20.0 * std::log10(amplitude / std::sqrt(2.0));
+            worst_level = std::max(worst_level, level);
+        }
+        checkLimit(worst_level < -80.0, input_rate, output_rate, "stopband level dB", worst_level, -80.0);
+    }
+}
+
+int main()
+{
+    testRates(44100, 48000);
+    testRates(48000, 44100);
+    testRates(16000, 48000);
+    testRates(22050, 48000);
+    testRates(96000, 48000);
+    return checkResult();
+}
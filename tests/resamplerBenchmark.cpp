@@ -0,0 +1,56 @@
+#include "audio/resampler.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+
+//CPU cost of the voice chat resampling per stream. Each stream converts 20ms blocks, like the capture and playback paths do.
+//Usage: seriousproton_benchmark_resampler [stream count] [seconds of audio]
+using Clock = std::chrono::steady_clock;
+
+static void benchmark(const char* name, int input_rate, int output_rate, int channels, int stream_count, int seconds)
+{
+    size_t frames_per_block = size_t(input_rate / 50);
+    std::vector<int16_t> input(frames_per_block * channels);
+    for(size_t n=0; n<input.size(); n++)
+        input[n] = int16_t(std::lrint(8000.0 * std::sin(2.0 * M_PI * 440.0 * double(n / channels) / input_rate)));
+
+    std::vector<std::unique_ptr<sp::audio::Resampler>> streams;
+    for(int n=0; n<stream_count; n++)
+        streams.push_back(std::make_unique<sp::audio::Resampler>(input_rate, output_rate));
+    std::vector<int16_t> mono(frames_per_block);
+    std::vector<int16_t> output(streams[0]->getMaxOutputCount(frames_per_block));
+
+    auto start = Clock::now();
+    for(int block=0; block<seconds * 50; block++)
+    {
+        for(auto& stream : streams)
+        {
+            sp::audio::Resampler::downmix(input.data(), frames_per_block, channels, mono.data());
+            stream->process(mono.data(), frames_per_block, output.data());
+        }
+    }
+    double time = std::chrono::duration<double>(Clock::now() - start).count();
+    double per_stream = time / seconds / stream_count;
+    printf("%s %d -> %d, %d channel(s), %d streams: %.3fms per stream per second of audio (%.3f%% of a core)\n",
+        name, input_rate, output_rate, channels, stream_count, per_stream * 1000.0, per_stream * 100.0);
+}
+
+int main(int argc, char** argv)
+{
+    int stream_count = 16;
+    int seconds = 30;
+    if (argc > 1)
+        stream_count = std::max(1, atoi(argv[1]));
+    if (argc > 2)
+        seconds = std::max(1, atoi(argv[2]));
+
+    benchmark("capture", 44100, 48000, 2, stream_count, seconds);
+    benchmark("capture", 16000, 48000, 1, stream_count, seconds);
+    benchmark("playback", 48000, 44100, 1, stream_count, seconds);
+    return 0;
+}
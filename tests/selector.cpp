@@ -0,0 +1,37 @@
+#include "io/network/selector.h"
+#include "io/network/tcpListener.h"
+#include "io/network/tcpSocket.h"
+#include "check.h"
+
+
+//A socket added to the Selector while connecting waits for data once the connect finished, instead of staying ready.
+int main()
+{
+    sp::io::network::TcpListener listener;
+    check(listener.listen(36110), "listen");
+    sp::io::network::TcpSocket socket;
+    socket.setBlocking(false);
+    socket.connect(sp::io::network::Address("127.0.0.1"), 36110);
+
+    sp::io::network::Selector selector;
+    selector.add(socket);
+    selector.wait(1000);
+    check(selector.isReady(socket), "ready when the connect finished");
+    check(socket.getState() == sp::io::network::StreamSocket::State::Connected, "connected");
+
+    selector.wait(50);
+    check(!selector.isReady(socket), "not ready without data after the connect");
+
+    sp::io::network::TcpSocket remote;
+    while(!listener.accept(remote)) {}
+    sp::io::DataBuffer packet;
+    packet << int32_t(1);
+    remote.send(packet);
+    selector.wait(1000);
+    check(selector.isReady(socket), "ready when data arrived");
+
+    selector.remove(socket);
+    selector.wait(0);
+    check(!selector.isReady(socket), "not ready after remove");
+    return checkResult();
+}
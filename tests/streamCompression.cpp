@@ -0,0 +1,152 @@
+#include "io/streamCompression.h"
+#include "check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+
+//Chunks have to come out of the decompressor exactly as they went into the compressor, also when the history window
+//shared by the chunks fills up, the level changes halfway, the compressor resets or the data does not compress at all.
+static std::mt19937 random_engine(1234);
+
+static int randomInt(int min, int max)
+{
+    return std::uniform_int_distribution<int>(min, max)(random_engine);
+}
+
+//Looks like replication packets: the same records over and over, with a few values changed each time.
+static std::vector<uint8_t> makePacketData(std::vector<uint8_t>& state, size_t size)
+{
+    for(int n=0; n<8; n++)
+        state[randomInt(0, int(state.size()) - 1)] = uint8_t(randomInt(0, 255));
+    std::vector<uint8_t> data;
+    while(data.size() < size)
+    {
+        size_t start = randomInt(0, int(state.size()) - 1);
+        size_t length = std::min(state.size() - start, size - data.size());
+        data.insert(data.end(), state.begin() + start, state.begin() + start + length);
+    }
+    return data;
+}
+
+static std::vector<uint8_t> makeRandomData(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for(auto& b : data)
+        b = uint8_t(randomInt(0, 255));
+    return data;
+}
+
+struct Chunk
+{
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+};
+
+static std::vector<Chunk> compressChunks(sp::io::StreamCompressor& compressor, bool compressible, size_t total_size, int max_chunk_size)
+{
+    std::vector<uint8_t> state = makeRandomData(2048);
+    std::vector<Chunk> chunks;
+    size_t size = 0;
+    while(size < total_size)
+    {
+        Chunk chunk;
+        size_t chunk_size = randomInt(0, max_chunk_size);
+        chunk.raw = compressible ? makePacketData(state, chunk_size) : makeRandomData(chunk_size);
+        compressor.compress(chunk.raw.data(), chunk.raw.size(), chunk.compressed);
+        size += chunk.raw.size();
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+static bool decompressChunks(sp::io::StreamDecompressor& decompressor, const std::vector<Chunk>& chunks, size_t first = 0)
+{
+    std::vector<uint8_t> output;
+    for(size_t n=first; n<chunks.size(); n++)
+    {
+        if (!decompressor.decompress(chunks[n].compressed.data(), chunks[n].compressed.size(), output))
+            return false;
+        if (output != chunks[n].raw)
+            return false;
+    }
+    return true;
+}
+
+static void testRoundTrip(int level, bool compressible, int max_chunk_size)
+{
+    //Several times the window, so matches have to stay inside the history that both sides still have.
+    sp::io::StreamCompressor compressor(level);
+    auto chunks = compressChunks(compressor, compressible, 400 * 1024, max_chunk_size);
+    sp::io::StreamDecompressor decompressor;
+    check(decompressChunks(decompressor, chunks), "level %d, %s chunks up to %d bytes round trip", level, compressible ? "compressible" : "random", max_chunk_size);
+
+    auto& stats = compressor.getStats();
+    if (compressible)
+        check(stats.getRatio() < 0.5f, "level %d compresses packet data to %.0f%%", level, stats.getRatio() * 100.0f);
+    else
+        check(stats.compressed_bytes <= stats.raw_bytes + stats.chunks * 6, "level %d grows random data by %d bytes over %d chunks", level, int(stats.compressed_bytes - stats.raw_bytes), int(stats.chunks));
+}
+
+static void testLevelChange()
+{
+    sp::io::StreamCompressor compressor(1);
+    auto chunks = compressChunks(compressor, true, 100 * 1024, 4000);
+    for(int level=2; level<=sp::io::StreamCompression::max_level; level++)
+    {
+        compressor.setLevel(level);
+        auto more = compressChunks(compressor, true, 20 * 1024, 4000);
+        chunks.insert(chunks.end(), more.begin(), more.end());
+    }
+    sp::io::StreamDecompressor decompressor;
+    check(decompressChunks(decompressor, chunks), "level changes halfway the stream round trip");
+}
+
+static void testReset()
+{
+    sp::io::StreamCompressor compressor(5);
+    auto chunks = compressChunks(compressor, true, 100 * 1024, 4000);
+    size_t reset_index = chunks.size();
+    compressor.reset();
+    auto more = compressChunks(compressor, true, 100 * 1024, 4000);
+    chunks.insert(chunks.end(), more.begin(), more.end());
+
+    sp::io::StreamDecompressor decompressor;
+    check(decompressChunks(decompressor, chunks), "a reset halfway the stream round trips");
+    //A reset is for when chunks got lost, so the chunks after it can not depend on anything before it.
+    sp::io::StreamDecompressor late_decompressor;
+    check(decompressChunks(late_decompressor, chunks, reset_index), "a decompressor that starts at the reset round trips");
+}
+
+static void testCorruptData()
+{
+    sp::io::StreamCompressor compressor(1);
+    auto chunks = compressChunks(compressor, true, 20 * 1024, 4000);
+    sp::io::StreamDecompressor decompressor;
+    std::vector<uint8_t> output;
+    bool corrupt_refused = true;
+    for(auto& chunk : chunks)
+    {
+        //Cut off the end of every chunk, the decompressor has to refuse it instead of reading past the data.
+        if (chunk.compressed.size() > 2 && decompressor.decompress(chunk.compressed.data(), chunk.compressed.size() - 2, output) && output == chunk.raw)
+            corrupt_refused = false;
+    }
+    check(corrupt_refused, "truncated chunks are refused");
+    check(!decompressor.decompress(nullptr, 0, output), "an empty chunk is refused");
+}
+
+int main()
+{
+    for(int level : {1, 4, sp::io::StreamCompression::max_level})
+    {
+        testRoundTrip(level, true, 200);
+        testRoundTrip(level, true, 20000);
+        testRoundTrip(level, false, 20000);
+    }
+    testLevelChange();
+    testReset();
+    testCorruptData();
+    return checkResult();
+}
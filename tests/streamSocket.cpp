@@ -0,0 +1,104 @@
+#include "io/network/streamSocket.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+
+//Switching compression on or off halfway a connection, while the receiving side already read the data after the switch.
+//That data was read as is, and has to be decompressed (or not) once the switch is made on the receiving side as well.
+class PipeSocket : public sp::io::network::StreamSocket
+{
+public:
+    PipeSocket(std::shared_ptr<std::string> incoming, std::shared_ptr<std::string> outgoing, size_t max_read)
+    : incoming(incoming), outgoing(outgoing), max_read(max_read) {}
+    virtual void close() override {}
+    virtual State getState() override { return State::Connected; }
+
+protected:
+    virtual size_t _send(const void* data, size_t size) override
+    {
+        outgoing->append(static_cast<const char*>(data), size);
+        return size;
+    }
+    virtual size_t _receive(void* data, size_t size) override
+    {
+        size = std::min(std::min(size, max_read), incoming->size());
+        memcpy(data, incoming->data(), size);
+        incoming->erase(0, size);
+        return size;
+    }
+
+private:
+    std::shared_ptr<std::string> incoming;
+    std::shared_ptr<std::string> outgoing;
+    size_t max_read;
+};
+
+static sp::io::DataBuffer makePacket(int index)
+{
+    sp::io::DataBuffer packet;
+    packet << int32_t(index) << string("packet data that compresses well, packet data that compresses well");
+    for(int n=0; n<index % 50; n++)
+        packet << int32_t(n * index);
+    return packet;
+}
+
+static bool receivePacket(PipeSocket& socket, int index)
+{
+    sp::io::DataBuffer expected = makePacket(index);
+    sp::io::DataBuffer packet;
+    if (!socket.receive(packet))
+        return false;
+    return packet.getDataSize() == expected.getDataSize() && memcmp(packet.getData(), expected.getData(), packet.getDataSize()) == 0;
+}
+
+static void testSwitch(size_t max_read)
+{
+    auto a_to_b = std::make_shared<std::string>();
+    auto b_to_a = std::make_shared<std::string>();
+    PipeSocket a(b_to_a, a_to_b, max_read);
+    PipeSocket b(a_to_b, b_to_a, max_read);
+
+    //The raw packet that tells the other side to switch, and the compressed packets after it, arrive together.
+    a.queue(makePacket(0));
+    a.setSendCompression(3);
+    for(int n=1; n<20; n++)
+        a.queue(makePacket(n));
+    a.sendSendQueue();
+    bool ok = receivePacket(b, 0);
+    b.setReceiveCompression(true);
+    for(int n=1; n<20; n++)
+        ok = ok && receivePacket(b, n);
+    check(ok, "switch compression on after reading ahead, reading %d bytes at a time", int(max_read));
+
+    //And the other way around: the last compressed packet and the raw packets after it arrive together.
+    for(int n=20; n<40; n++)
+        a.queue(makePacket(n));
+    a.sendSendQueue();
+    auto stats = a.getSendCompressionStats();
+    a.setSendCompression(0);
+    for(int n=40; n<60; n++)
+        a.queue(makePacket(n));
+    a.sendSendQueue();
+    ok = true;
+    for(int n=20; n<40; n++)
+        ok = ok && receivePacket(b, n);
+    b.setReceiveCompression(false);
+    for(int n=40; n<60; n++)
+        ok = ok && receivePacket(b, n);
+    sp::io::DataBuffer packet;
+    check(ok && !b.receive(packet), "switch compression off after reading ahead, reading %d bytes at a time", int(max_read));
+    check(stats.compressed_bytes < stats.raw_bytes / 2, "the packets in between were compressed to %.0f%%", stats.getRatio() * 100.0f);
+}
+
+int main()
+{
+    testSwitch(1);
+    testSwitch(7);
+    testSwitch(64 * 1024);
+    return checkResult();
+}
@@ -0,0 +1,89 @@
+#include "multiplayer.h"
+#include "check.h"
+
+#include <random>
+
+
+//Replicated vectors send operations against the previously send contents. Apply those to a copy, and compare with the original.
+template<typename T> class VectorMirror
+{
+public:
+    typedef multiplayerReplicationFunctions<T> Functions;
+
+    VectorMirror() { prev_data = reinterpret_cast<uint64_t>(new typename Functions::VectorReplicationData()); }
+    ~VectorMirror() { Functions::cleanupVector(&prev_data); }
+
+    //Replicate the changes, as an update packet and as a create packet. True when both copies match the source afterwards.
+    bool replicate(const std::vector<T>& source)
+    {
+        if (Functions::isChangedVector(const_cast<std::vector<T>*>(&source), &prev_data))
+        {
+            sp::io::DataBuffer update;
+            Functions::sendReplicatedVector(&prev_data, update, false);
+            Functions::receiveDataVector(&copy, update);
+            if (update.available())
+                return false;
+        }
+        sp::io::DataBuffer create;
+        Functions::sendReplicatedVector(&prev_data, create, true);
+        std::vector<T> created;
+        Functions::receiveDataVector(&created, create);
+        return copy == source && created == source;
+    }
+
+    std::vector<T> copy;
+private:
+    uint64_t prev_data;
+};
+
+template<typename T, typename GENERATOR> static void testRandomChanges(const char* type, GENERATOR generate)
+{
+    std::mt19937 random(1);
+    std::vector<T> source;
+    VectorMirror<T> mirror;
+    int mismatches = 0;
+    for(int step=0; step<2000; step++)
+    {
+        switch(random() % 5)
+        {
+        case 0: if (!source.empty()) source[random() % source.size()] = generate(random); break;
+        case 1: source.push_back(generate(random)); break;
+        case 2: if (!source.empty()) source.resize(random() % source.size()); break;
+        case 3: for(auto& value : source) value = generate(random); break;
+        case 4: if (!source.empty()) { source[0] = generate(random); source.push_back(generate(random)); } break;
+        }
+        if (!mirror.replicate(source))
+            mismatches++;
+    }
+    check(mismatches == 0, "%s random changes, %d mismatches", type, mismatches);
+}
+
+int main()
+{
+    testRandomChanges<int32_t>("int32", [](std::mt19937& random) { return int32_t(random() % 100000) - 50000; });
+    testRandomChanges<float>("float", [](std::mt19937& random) { return float(random() % 1000) * 0.5f; });
+    testRandomChanges<string>("string", [](std::mt19937& random) { return string(std::string(random() % 10, 'a')); });
+
+    //Indexes and counts above what fits in 16 bits.
+    std::vector<int32_t> large(100000);
+    for(size_t n=0; n<large.size(); n++)
+        large[n] = int32_t(n);
+    VectorMirror<int32_t> mirror;
+    check(mirror.replicate(large), "100000 elements full");
+    large[90000] = -1;
+    large[70001] = -2;
+    check(mirror.replicate(large), "set above index 65535");
+    large.resize(140000, 7);
+    check(mirror.replicate(large), "append 40000 elements");
+    large.resize(70000);
+    large[66000] = -3;
+    check(mirror.replicate(large), "truncate to 70000 elements");
+
+    //A corrupt count is ignored instead of allocated.
+    sp::io::DataBuffer corrupt;
+    corrupt << uint32_t(1) << uint8_t(0) << uint32_t(0x7fffffff) << int32_t(1);
+    std::vector<int32_t> target{1, 2, 3};
+    multiplayerReplicationFunctions<int32_t>::receiveDataVector(&target, corrupt);
+    check(target.size() == 3, "corrupt element count ignored");
+    return checkResult();
+}